@@ -0,0 +1,78 @@
+#include "aligned_matrix.h"
+
+#include <new>
+
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace {
+    constexpr size_t SmallPage = 4096;
+    constexpr size_t Page2M = 2u << 20;
+    constexpr size_t Page1G = 1u << 30;
+
+    size_t RoundUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void* MapAnonymous(size_t size, int extraFlags) {
+        void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+        return data == MAP_FAILED ? nullptr : data;
+    }
+}
+
+const char* ToString(EPageBacking backing) {
+    switch (backing) {
+        case EPageBacking::Small: return "small";
+        case EPageBacking::Transparent: return "thp";
+        case EPageBacking::Huge2M: return "hugetlb-2m";
+        case EPageBacking::Huge1G: return "hugetlb-1g";
+    }
+    return "unknown";
+}
+
+THugePageBuffer::THugePageBuffer(size_t size, EPageBacking wanted) {
+    if (wanted == EPageBacking::Huge1G) {
+        Size_ = RoundUp(size, Page1G);
+        if ((Data_ = MapAnonymous(Size_, MAP_HUGETLB | MAP_HUGE_1GB))) {
+            Backing_ = EPageBacking::Huge1G;
+            return;
+        }
+        wanted = EPageBacking::Huge2M;
+    }
+    if (wanted == EPageBacking::Huge2M) {
+        Size_ = RoundUp(size, Page2M);
+        if ((Data_ = MapAnonymous(Size_, MAP_HUGETLB | MAP_HUGE_2MB))) {
+            Backing_ = EPageBacking::Huge2M;
+            return;
+        }
+        wanted = EPageBacking::Transparent;
+    }
+    // rounded to 2 MB so the tail of the buffer can be a huge page too
+    Size_ = wanted == EPageBacking::Transparent ? RoundUp(size, Page2M) : RoundUp(size, SmallPage);
+    if (!(Data_ = MapAnonymous(Size_, 0))) {
+        Size_ = 0;
+        throw std::bad_alloc();
+    }
+    if (wanted == EPageBacking::Transparent && ::madvise(Data_, Size_, MADV_HUGEPAGE) == 0) {
+        Backing_ = EPageBacking::Transparent;
+        return;
+    }
+    // with thp set to always the small pages have to be asked for explicitly
+    ::madvise(Data_, Size_, MADV_NOHUGEPAGE);
+    Backing_ = EPageBacking::Small;
+}
+
+THugePageBuffer::~THugePageBuffer() {
+    if (Data_) {
+        ::munmap(Data_, Size_);
+    }
+}
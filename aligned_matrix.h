@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+enum class EPageBacking {
+    Small,
+    // madvise(MADV_HUGEPAGE), khugepaged and the fault handler decide
+    Transparent,
+    // MAP_HUGETLB, needs pages reserved in /proc/sys/vm/nr_hugepages (or the 1 GB pool)
+    Huge2M,
+    Huge1G,
+};
+
+const char* ToString(EPageBacking backing);
+
+// anonymous mapping, the wanted backing is tried first and every smaller one after it,
+// Backing() tells which one was got. Throws std::bad_alloc if not even small pages are available
+class THugePageBuffer {
+public:
+    THugePageBuffer() = default;
+    THugePageBuffer(size_t size, EPageBacking wanted);
+    ~THugePageBuffer();
+
+    THugePageBuffer(THugePageBuffer&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    THugePageBuffer& operator=(THugePageBuffer&& other) noexcept {
+        std::swap(Data_, other.Data_);
+        std::swap(Size_, other.Size_);
+        std::swap(Backing_, other.Backing_);
+        return *this;
+    }
+
+    void* Data() const {
+        return Data_;
+    }
+
+    EPageBacking Backing() const {
+        return Backing_;
+    }
+
+private:
+    void* Data_ = nullptr;
+    size_t Size_ = 0;
+    EPageBacking Backing_ = EPageBacking::Small;
+};
+
+// rows of dim elements at a stride rounded up to a cache line, so every row starts on a line boundary and a
+// uint8 row of dim 96 takes two lines instead of straddling three. Padding is zero: the kernels run over
+// KernelDim() with a query zero padded to it, or over Dim() as long as dim * id addressing is not needed
+template<class T>
+class TAlignedMatrix {
+public:
+    static constexpr size_t LineBytes = 64;
+
+    TAlignedMatrix(size_t rows, size_t dim, EPageBacking backing = EPageBacking::Transparent)
+        : Rows_(rows)
+        , Dim_(dim)
+        , Stride_((dim * sizeof(T) + LineBytes - 1) / LineBytes * LineBytes / sizeof(T))
+        , Buffer_(rows * Stride_ * sizeof(T), backing)
+    {
+    }
+
+    // rows packed at dim stride as in a plain vector
+    void CopyRows(const T* rows) {
+        for(size_t r = 0; r < Rows_; r += 1) {
+            std::memcpy(Row(r), rows + r * Dim_, Dim_ * sizeof(T));
+        }
+    }
+
+    size_t Rows() const {
+        return Rows_;
+    }
+
+    size_t Dim() const {
+        return Dim_;
+    }
+
+    // the dim to give the kernels as allB is addressed by dim * id
+    size_t KernelDim() const {
+        return Stride_;
+    }
+
+    T* Data() const {
+        return static_cast<T*>(Buffer_.Data());
+    }
+
+    T* Row(size_t row) const {
+        return Data() + row * Stride_;
+    }
+
+    EPageBacking Backing() const {
+        return Buffer_.Backing();
+    }
+
+private:
+    size_t Rows_;
+    size_t Dim_;
+    size_t Stride_;
+    THugePageBuffer Buffer_;
+};
@@ -0,0 +1,244 @@
+#include "autotune.h"
+#include "multidot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cpuid.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t MinStep = 2;
+    constexpr size_t StepsNum = 15; // 2..16, as DeclByStep instantiates them
+    // distinct id sets the trials cycle through, so a candidate does not find the rows its predecessor loaded
+    constexpr size_t IdSlices = 64;
+
+    template<template<size_t> class TKernel, size_t... Steps>
+    void AddSteps(std::vector<TTunedKernel>& candidates, const char* name, std::index_sequence<Steps...>) {
+        (candidates.push_back({
+            std::string(name) + "<" + std::to_string(Steps + MinStep) + ">",
+            &TKernel<Steps + MinStep>::MultiDotProduct
+        }), ...);
+    }
+
+    template<size_t Distance, EPrefetchHint Hint>
+    void DeepPrefetch(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TMultiDotDeepPrefetchAVX512::MultiDotProductWith({Distance, Hint}, a, allB, dim, elemsIds, elemsNum, results);
+    }
+
+    template<size_t Distance, EPrefetchHint Hint>
+    void AddDeepPrefetch(std::vector<TTunedKernel>& candidates, const char* hint) {
+        candidates.push_back({
+            "TMultiDotDeepPrefetchAVX512<" + std::to_string(Distance) + "," + hint + ">",
+            &DeepPrefetch<Distance, Hint>
+        });
+    }
+}
+
+std::string CpuModel() {
+    uint32_t brand[12] = {};
+    uint32_t maxLeaf = __get_cpuid_max(0x80000000u, nullptr);
+    if (maxLeaf < 0x80000004u) {
+        return "unknown";
+    }
+    for(uint32_t i = 0; i < 3; i += 1) {
+        __get_cpuid(0x80000002u + i, &brand[4 * i], &brand[4 * i + 1], &brand[4 * i + 2], &brand[4 * i + 3]);
+    }
+    std::string model(reinterpret_cast<const char*>(brand), sizeof(brand));
+    model.resize(model.find('\0') == std::string::npos ? model.size() : model.find('\0'));
+    // the cache file is tab separated
+    std::replace(model.begin(), model.end(), '\t', ' ');
+    const size_t first = model.find_first_not_of(' ');
+    const size_t last = model.find_last_not_of(' ');
+    return first == std::string::npos ? "unknown" : model.substr(first, last - first + 1);
+}
+
+std::vector<TTunedKernel> MultiDotCandidates(const TCpuFeatures& features) {
+    std::vector<TTunedKernel> candidates;
+    AddSteps<TMultiDotCTStepV2FloatOpts_SSE42>(candidates, "TMultiDotCTStepV2FloatOpts_SSE42", std::make_index_sequence<StepsNum>());
+    if (features.UsableAvx()) {
+        AddSteps<TMultiDotCTStepV2FloatOpts_AVX>(candidates, "TMultiDotCTStepV2FloatOpts_AVX", std::make_index_sequence<StepsNum>());
+    }
+    if (features.UsableAvx2()) {
+        AddSteps<TMultiDotCTStepV2FloatOpts_AVX2>(candidates, "TMultiDotCTStepV2FloatOpts_AVX2", std::make_index_sequence<StepsNum>());
+    }
+    if (features.UsableAvx512()) {
+        AddSteps<TMultiDotCTStepV2FloatOpts_AVX512>(candidates, "TMultiDotCTStepV2FloatOpts_AVX512", std::make_index_sequence<StepsNum>());
+        candidates.push_back({"TMultiDotV3_ASM_AVX512", &TMultiDotV3_ASM_AVX512::MultiDotProduct});
+        candidates.push_back({"TMultiDotV3_ASM_PREFETCH_AVX512", &TMultiDotV3_ASM_PREFETCH_AVX512::MultiDotProduct});
+        AddDeepPrefetch<2, EPrefetchHint::T0>(candidates, "t0");
+        AddDeepPrefetch<4, EPrefetchHint::T0>(candidates, "t0");
+        AddDeepPrefetch<8, EPrefetchHint::T0>(candidates, "t0");
+        AddDeepPrefetch<4, EPrefetchHint::Nta>(candidates, "nta");
+        AddDeepPrefetch<8, EPrefetchHint::Nta>(candidates, "nta");
+    }
+    return candidates;
+}
+
+TMultiDotAutotuner::TMultiDotAutotuner(const TCpuFeatures& features, const TOptions& options)
+    : Options_(options)
+    , CpuModel_(CpuModel())
+    , Candidates_(MultiDotCandidates(features))
+{
+    Load();
+}
+
+TMultiDotProductFunc TMultiDotAutotuner::Select(size_t dim) {
+    std::lock_guard<std::mutex> guard(Mutex_);
+    return Candidates_[Choose(dim).Kernel].Func;
+}
+
+std::string TMultiDotAutotuner::SelectedName(size_t dim) {
+    std::lock_guard<std::mutex> guard(Mutex_);
+    return Candidates_[Choose(dim).Kernel].Name;
+}
+
+void TMultiDotAutotuner::Tune(const std::vector<size_t>& dims) {
+    std::lock_guard<std::mutex> guard(Mutex_);
+    for(size_t dim : dims) {
+        Choose(dim);
+    }
+}
+
+std::string TMultiDotAutotuner::DefaultCachePath() {
+    if (const char* path = std::getenv("DOT_PRODUCT_AUTOTUNE_CACHE")) {
+        return path;
+    }
+    std::string dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        dir = xdg;
+    } else if (const char* home = std::getenv("HOME")) {
+        dir = std::string(home) + "/.cache";
+        ::mkdir(dir.c_str(), 0755);
+    } else {
+        return "";
+    }
+    return dir + "/dot_product_autotune.tsv";
+}
+
+TMultiDotAutotuner& TMultiDotAutotuner::Default() {
+    static TMultiDotAutotuner tuner(TRuntimeCpuInfoDispatch::Features, TOptions{DefaultCachePath()});
+    return tuner;
+}
+
+const TMultiDotAutotuner::TChoice& TMultiDotAutotuner::Choose(size_t dim) {
+    auto it = Chosen_.find(dim);
+    if (it == Chosen_.end()) {
+        it = Chosen_.emplace(dim, Measure(dim)).first;
+        Save();
+    }
+    return it->second;
+}
+
+TMultiDotAutotuner::TChoice TMultiDotAutotuner::Measure(size_t dim) const {
+    const size_t elemsNum = std::max<size_t>(Options_.ElemsNum, 1);
+    const size_t rowsNum = std::max(elemsNum, Options_.MatrixBytes / (std::max<size_t>(dim, 1) * sizeof(float)));
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> values(-1.f, 1.f);
+    std::vector<float> matrix(rowsNum * dim);
+    for(float& value : matrix) {
+        value = values(rng);
+    }
+    std::vector<float> query(dim);
+    for(float& value : query) {
+        value = values(rng);
+    }
+    std::uniform_int_distribution<uint32_t> rows(0, uint32_t(rowsNum - 1));
+    std::vector<uint32_t> ids(IdSlices * elemsNum);
+    for(uint32_t& id : ids) {
+        id = rows(rng);
+    }
+    std::vector<float> results(elemsNum);
+
+    std::vector<double> best(Candidates_.size(), std::numeric_limits<double>::max());
+    size_t slice = 0;
+    for(size_t round = 0; round < Options_.Rounds + 1; round += 1) {
+        for(size_t c = 0; c < Candidates_.size(); c += 1) {
+            const uint32_t* sliceIds = ids.data() + slice * elemsNum;
+            slice = (slice + 1) % IdSlices;
+            const auto start = std::chrono::steady_clock::now();
+            Candidates_[c].Func(query.data(), matrix.data(), dim, sliceIds, elemsNum, results.data());
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            // round 0 warms the code and the page tables up
+            if (round > 0) {
+                best[c] = std::min(best[c], elapsed.count());
+            }
+        }
+    }
+    const size_t winner = std::min_element(best.begin(), best.end()) - best.begin();
+    return {winner, best[winner] / elemsNum};
+}
+
+void TMultiDotAutotuner::Load() {
+    if (Options_.CachePath.empty()) {
+        return;
+    }
+    std::ifstream file(Options_.CachePath);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream fields(line);
+        std::string model;
+        std::string dim;
+        std::string name;
+        std::string nsPerRow;
+        if (!std::getline(fields, model, '\t') || model != CpuModel_ || !std::getline(fields, dim, '\t')
+            || !std::getline(fields, name, '\t') || !std::getline(fields, nsPerRow, '\t')) {
+            continue;
+        }
+        // a kernel this build or this host does not have any more is tuned again
+        const auto candidate = std::find_if(Candidates_.begin(), Candidates_.end(), [&](const TTunedKernel& kernel) {
+            return kernel.Name == name;
+        });
+        if (candidate != Candidates_.end()) {
+            Chosen_[std::strtoull(dim.c_str(), nullptr, 10)] = {size_t(candidate - Candidates_.begin()), std::atof(nsPerRow.c_str())};
+        }
+    }
+}
+
+void TMultiDotAutotuner::Save() const {
+    if (Options_.CachePath.empty()) {
+        return;
+    }
+    // lines of other cpu models stay, those of this one are written anew
+    std::string kept;
+    {
+        std::ifstream file(Options_.CachePath);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.compare(0, CpuModel_.size() + 1, CpuModel_ + "\t") != 0) {
+                kept += line + "\n";
+            }
+        }
+    }
+    // several processes may tune at once, rename keeps the file whole for the readers
+    const std::string tmpPath = Options_.CachePath + "." + std::to_string(::getpid()) + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        file << kept;
+        for(const auto& [dim, choice] : Chosen_) {
+            file << CpuModel_ << "\t" << dim << "\t" << Candidates_[choice.Kernel].Name << "\t" << choice.NsPerRow << "\n";
+        }
+        if (!file) {
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), Options_.CachePath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+    }
+}
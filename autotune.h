@@ -0,0 +1,92 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// cpuid brand string, what tuning decisions are keyed by
+std::string CpuModel();
+
+struct TTunedKernel {
+    // written to the cache file, e.g. TMultiDotCTStepV2FloatOpts_AVX2<5>
+    std::string Name;
+    TMultiDotProductFunc Func;
+};
+
+// every float MultiDotProduct the host can run: V2 FloatOpts of each usable isa for Step 2..16, the avx512 asm
+// kernels and the deep prefetch one over a few distances and hints
+std::vector<TTunedKernel> MultiDotCandidates(const TCpuFeatures& features);
+
+// picks the fastest candidate per dim by timing them on a synthetic matrix, once per dim: at startup by Tune
+// or on the first Select of the dim. Decisions go to a tab separated cache file of
+// "cpu model, dim, kernel name, ns per row" lines, so the next process on the same cpu model skips the timing.
+// A broken or unwritable cache only costs a retune
+class TMultiDotAutotuner {
+public:
+    struct TOptions {
+        // empty keeps decisions in memory only
+        std::string CachePath;
+        // the trial matrix is well above L2, so the gathered rows miss as in serving
+        size_t MatrixBytes = 64u << 20;
+        size_t ElemsNum = 4096;
+        // the best of Rounds timings, candidates take turns within a round
+        size_t Rounds = 5;
+    };
+
+    TMultiDotAutotuner(const TCpuFeatures& features, const TOptions& options);
+
+    TMultiDotProductFunc Select(size_t dim);
+    std::string SelectedName(size_t dim);
+    void Tune(const std::vector<size_t>& dims);
+
+    const std::vector<TTunedKernel>& Candidates() const {
+        return Candidates_;
+    }
+
+    // $DOT_PRODUCT_AUTOTUNE_CACHE, else dot_product_autotune.tsv in $XDG_CACHE_HOME or ~/.cache
+    static std::string DefaultCachePath();
+    // runtime features and the default cache path, created on first use
+    static TMultiDotAutotuner& Default();
+
+private:
+    struct TChoice {
+        size_t Kernel;
+        double NsPerRow;
+    };
+
+    // callers hold Mutex_
+    const TChoice& Choose(size_t dim);
+    TChoice Measure(size_t dim) const;
+    void Load();
+    void Save() const;
+
+    TOptions Options_;
+    std::string CpuModel_;
+    std::vector<TTunedKernel> Candidates_;
+    std::mutex Mutex_;
+    std::map<size_t, TChoice> Chosen_;
+};
+
+// MultiDotProduct through the default tuner, the kernel of the last dim is kept per thread
+struct TMultiDotAutotuned {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        thread_local size_t lastDim = 0;
+        thread_local TMultiDotProductFunc lastFunc = nullptr;
+        if (dim != lastDim || !lastFunc) {
+            lastFunc = TMultiDotAutotuner::Default().Select(dim);
+            lastDim = dim;
+        }
+        lastFunc(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
@@ -1,5 +1,17 @@
 #include "dot_product.h"
 #include "multidot.h"
+#include "dotpacked.h"
+#include "dotnibble.h"
+#include "dotscaled.h"
+#include "pq.h"
+#include "dotbinary.h"
+#include "topk.h"
+#include "roofline.h"
+#include "fixed_dim_impl.h"
+#include "distance_impl.h"
+#include "fullscan.h"
+
+#include <immintrin.h>
 
 float TNaiveAvx2Auto::DotProduct(const float* a, const float* b, size_t dim) {
     return TNaive::DotProduct(a, b, dim);
@@ -33,6 +45,12 @@ DeclByStep(14)
 DeclByStep(15)
 DeclByStep(16)
 
+#define DeclFixedDim(Dim) DeclFixedDimByIsa(AVX2, Dim)
+
+ForEachFixedDim(DeclFixedDim)
+
+DeclDistanceByIsa(AVX2)
+
 
 void TMultiDotCTStepV3FloatOpts_AVX2::MultiDotProduct(
     const float* a,
@@ -44,3 +62,575 @@ void TMultiDotCTStepV3FloatOpts_AVX2::MultiDotProduct(
 ) {
     TMultiDotCTStepV3::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, results);
 }
+
+void TMultiQueryFloatOpts_AVX2::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    TMultiQueryCTStep<4, 3>::MultiQueryDotProduct(queries, queriesNum, allB, dim, elemsIds, elemsNum, results);
+}
+
+void TPackedMultiQueryOpts_AVX2::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    TPackedMultiQueryCTStep<4, 3>::MultiQueryDotProduct(
+        queries, queriesNum, allB, dim, elemsIds, elemsNum, bias, coeff, results
+    );
+}
+
+
+static inline int32_t ReduceAdd(__m256i v) {
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+// u8 x s8 -> pairs of s16 -> quads of s32
+static inline __m256i DotStep(__m256i sum, __m256i row, __m256i left, __m256i ones) {
+    return _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(row, left), ones));
+}
+
+// no masked byte loads on avx2: the tail is loaded by dwords with vpmaskmovd, the last dim % 4 bytes are scalar
+static inline int32_t TailRest(const int8_t* left, const uint8_t* row, size_t from, size_t to) {
+    int32_t res = 0;
+    for(size_t i = from; i < to; i += 1) {
+        res += int32_t(left[i]) * row[i];
+    }
+    return res;
+}
+
+void TPackedProductAvx2Int8ASM::MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+    const TInt8Query query(a, dim, QueryMaxValue);
+    const int8_t* left = query.Values.data();
+    const float scale = query.Scale * coeff;
+    const float bb = query.Bias(bias, coeff);
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m256i) / sizeof(uint8_t));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const size_t dwordsDim = dim - dim % sizeof(int32_t);
+    const __m256i tail = _mm256_cmpgt_epi32(
+        _mm256_set1_epi32(int((dwordsDim - bodyDim) / sizeof(int32_t))),
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+    );
+    for(; e + Step <= elemsNum; e += Step) {
+        __m256i sum0 = _mm256_setzero_si256();
+        __m256i sum1 = _mm256_setzero_si256();
+        __m256i sum2 = _mm256_setzero_si256();
+        __m256i sum3 = _mm256_setzero_si256();
+
+        const uint8_t* e0 = allB + dim * elemsIds[e + 0];
+        const uint8_t* e1 = allB + dim * elemsIds[e + 1];
+        const uint8_t* e2 = allB + dim * elemsIds[e + 2];
+        const uint8_t* e3 = allB + dim * elemsIds[e + 3];
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m256i l = _mm256_loadu_si256((const __m256i*)(left + position));
+            sum0 = DotStep(sum0, _mm256_loadu_si256((const __m256i*)(e0 + position)), l, ones);
+            sum1 = DotStep(sum1, _mm256_loadu_si256((const __m256i*)(e1 + position)), l, ones);
+            sum2 = DotStep(sum2, _mm256_loadu_si256((const __m256i*)(e2 + position)), l, ones);
+            sum3 = DotStep(sum3, _mm256_loadu_si256((const __m256i*)(e3 + position)), l, ones);
+        }
+        int32_t rest0 = 0;
+        int32_t rest1 = 0;
+        int32_t rest2 = 0;
+        int32_t rest3 = 0;
+        if (bodyDim < dim) {
+            __m256i l = _mm256_loadu_si256((const __m256i*)(left + bodyDim));
+            sum0 = DotStep(sum0, _mm256_maskload_epi32((const int*)(e0 + bodyDim), tail), l, ones);
+            sum1 = DotStep(sum1, _mm256_maskload_epi32((const int*)(e1 + bodyDim), tail), l, ones);
+            sum2 = DotStep(sum2, _mm256_maskload_epi32((const int*)(e2 + bodyDim), tail), l, ones);
+            sum3 = DotStep(sum3, _mm256_maskload_epi32((const int*)(e3 + bodyDim), tail), l, ones);
+            rest0 = TailRest(left, e0, dwordsDim, dim);
+            rest1 = TailRest(left, e1, dwordsDim, dim);
+            rest2 = TailRest(left, e2, dwordsDim, dim);
+            rest3 = TailRest(left, e3, dwordsDim, dim);
+        }
+
+        results[e + 0] = (ReduceAdd(sum0) + rest0) * scale + bb;
+        results[e + 1] = (ReduceAdd(sum1) + rest1) * scale + bb;
+        results[e + 2] = (ReduceAdd(sum2) + rest2) * scale + bb;
+        results[e + 3] = (ReduceAdd(sum3) + rest3) * scale + bb;
+    }
+    for(; e < elemsNum; e += 1) {
+        __m256i sum0 = _mm256_setzero_si256();
+        const uint8_t* e0 = allB + dim * elemsIds[e];
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m256i l = _mm256_loadu_si256((const __m256i*)(left + position));
+            sum0 = DotStep(sum0, _mm256_loadu_si256((const __m256i*)(e0 + position)), l, ones);
+        }
+        int32_t rest0 = 0;
+        if (bodyDim < dim) {
+            __m256i l = _mm256_loadu_si256((const __m256i*)(left + bodyDim));
+            sum0 = DotStep(sum0, _mm256_maskload_epi32((const int*)(e0 + bodyDim), tail), l, ones);
+            rest0 = TailRest(left, e0, dwordsDim, dim);
+        }
+        results[e] = (ReduceAdd(sum0) + rest0) * scale + bb;
+    }
+}
+
+// one 32 byte block of 64 dims: low nibbles against the first half of the query block, high ones against the second,
+// 15 * 127 * 4 fits int16 so both products are added before widening
+static inline __m256i NibbleStep(__m256i sum, __m256i row, __m256i left0, __m256i left1, __m256i mask, __m256i ones) {
+    const __m256i low = _mm256_and_si256(row, mask);
+    const __m256i high = _mm256_and_si256(_mm256_srli_epi16(row, 4), mask);
+    const __m256i pairs = _mm256_add_epi16(_mm256_maddubs_epi16(low, left0), _mm256_maddubs_epi16(high, left1));
+    return _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, ones));
+}
+
+void TNibbleProductAvx2::MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+    const TNibbleQuery query(a, dim);
+    const int8_t* left = query.Values.data();
+    const size_t blocks = query.Values.size() / TNibbleRows::BlockDims;
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    for(; e + Step <= elemsNum; e += Step) {
+        __m256i sum0 = _mm256_setzero_si256();
+        __m256i sum1 = _mm256_setzero_si256();
+        __m256i sum2 = _mm256_setzero_si256();
+        __m256i sum3 = _mm256_setzero_si256();
+
+        const uint8_t* r0 = TNibbleRows::Row(allB, dim, elemsIds[e + 0]);
+        const uint8_t* r1 = TNibbleRows::Row(allB, dim, elemsIds[e + 1]);
+        const uint8_t* r2 = TNibbleRows::Row(allB, dim, elemsIds[e + 2]);
+        const uint8_t* r3 = TNibbleRows::Row(allB, dim, elemsIds[e + 3]);
+        const uint8_t* e0 = TNibbleRows::Nibbles(r0);
+        const uint8_t* e1 = TNibbleRows::Nibbles(r1);
+        const uint8_t* e2 = TNibbleRows::Nibbles(r2);
+        const uint8_t* e3 = TNibbleRows::Nibbles(r3);
+
+        for(size_t block = 0; block < blocks; block += 1) {
+            const size_t position = block * TNibbleRows::BlockBytes;
+            __m256i l0 = _mm256_loadu_si256((const __m256i*)(left + block * TNibbleRows::BlockDims));
+            __m256i l1 = _mm256_loadu_si256((const __m256i*)(left + block * TNibbleRows::BlockDims + 32));
+            sum0 = NibbleStep(sum0, _mm256_loadu_si256((const __m256i*)(e0 + position)), l0, l1, mask, ones);
+            sum1 = NibbleStep(sum1, _mm256_loadu_si256((const __m256i*)(e1 + position)), l0, l1, mask, ones);
+            sum2 = NibbleStep(sum2, _mm256_loadu_si256((const __m256i*)(e2 + position)), l0, l1, mask, ones);
+            sum3 = NibbleStep(sum3, _mm256_loadu_si256((const __m256i*)(e3 + position)), l0, l1, mask, ones);
+        }
+
+        results[e + 0] = query.Finish(r0, ReduceAdd(sum0), bias, coeff);
+        results[e + 1] = query.Finish(r1, ReduceAdd(sum1), bias, coeff);
+        results[e + 2] = query.Finish(r2, ReduceAdd(sum2), bias, coeff);
+        results[e + 3] = query.Finish(r3, ReduceAdd(sum3), bias, coeff);
+    }
+    for(; e < elemsNum; e += 1) {
+        __m256i sum0 = _mm256_setzero_si256();
+        const uint8_t* r0 = TNibbleRows::Row(allB, dim, elemsIds[e]);
+        const uint8_t* e0 = TNibbleRows::Nibbles(r0);
+        for(size_t block = 0; block < blocks; block += 1) {
+            __m256i l0 = _mm256_loadu_si256((const __m256i*)(left + block * TNibbleRows::BlockDims));
+            __m256i l1 = _mm256_loadu_si256((const __m256i*)(left + block * TNibbleRows::BlockDims + 32));
+            sum0 = NibbleStep(sum0, _mm256_loadu_si256((const __m256i*)(e0 + block * TNibbleRows::BlockBytes)), l0, l1, mask, ones);
+        }
+        results[e] = query.Finish(r0, ReduceAdd(sum0), bias, coeff);
+    }
+}
+
+static inline float ReduceAdd(__m256 v) {
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+}
+
+static inline __m256 WidenU8x8(const uint8_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+void TRowScaledProductAvx2::MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+    float aa = 0;
+    for(size_t i = 0; i < dim; i += 1) {
+        aa += a[i];
+    }
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m256) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    for(; e + Step <= elemsNum; e += Step) {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps();
+        __m256 sum3 = _mm256_setzero_ps();
+
+        const uint8_t* r0 = TScaledRows::Row(allB, dim, elemsIds[e + 0]);
+        const uint8_t* r1 = TScaledRows::Row(allB, dim, elemsIds[e + 1]);
+        const uint8_t* r2 = TScaledRows::Row(allB, dim, elemsIds[e + 2]);
+        const uint8_t* r3 = TScaledRows::Row(allB, dim, elemsIds[e + 3]);
+        const uint8_t* e0 = TScaledRows::Bytes(r0);
+        const uint8_t* e1 = TScaledRows::Bytes(r1);
+        const uint8_t* e2 = TScaledRows::Bytes(r2);
+        const uint8_t* e3 = TScaledRows::Bytes(r3);
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m256 left = _mm256_loadu_ps(a + position);
+            sum0 = _mm256_fmadd_ps(left, WidenU8x8(e0 + position), sum0);
+            sum1 = _mm256_fmadd_ps(left, WidenU8x8(e1 + position), sum1);
+            sum2 = _mm256_fmadd_ps(left, WidenU8x8(e2 + position), sum2);
+            sum3 = _mm256_fmadd_ps(left, WidenU8x8(e3 + position), sum3);
+        }
+        float rest0 = 0;
+        float rest1 = 0;
+        float rest2 = 0;
+        float rest3 = 0;
+        for(size_t i = bodyDim; i < dim; i += 1) {
+            rest0 += a[i] * float(e0[i]);
+            rest1 += a[i] * float(e1[i]);
+            rest2 += a[i] * float(e2[i]);
+            rest3 += a[i] * float(e3[i]);
+        }
+
+        results[e + 0] = TScaledRows::Scale(r0) * (ReduceAdd(sum0) + rest0) + TScaledRows::Offset(r0) * aa;
+        results[e + 1] = TScaledRows::Scale(r1) * (ReduceAdd(sum1) + rest1) + TScaledRows::Offset(r1) * aa;
+        results[e + 2] = TScaledRows::Scale(r2) * (ReduceAdd(sum2) + rest2) + TScaledRows::Offset(r2) * aa;
+        results[e + 3] = TScaledRows::Scale(r3) * (ReduceAdd(sum3) + rest3) + TScaledRows::Offset(r3) * aa;
+    }
+
+    TRowScaledProductNaive::MultiDotProduct(a, allB, dim, elemsIds + e, elemsNum - e, results + e);
+}
+
+// subspace s of a gathered dword per lane: the nibble goes to the low byte, the other bytes get the high bit set,
+// so vpshufb gives the table byte zero extended to the dword
+static inline __m256i PqLookupDwords(__m256i table, __m256i codes, int s) {
+    const __m256i index = _mm256_or_si256(
+        _mm256_and_si256(_mm256_srl_epi32(codes, _mm_cvtsi32_si128(4 * s)), _mm256_set1_epi32(0x0f)),
+        _mm256_set1_epi32(int(0x80808000))
+    );
+    return _mm256_shuffle_epi8(table, index);
+}
+
+void TPqProductAvx2::MultiDotProduct(
+        const TPqLookup& lookup,
+        const uint8_t* codes,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+    const __m256 delta = _mm256_set1_ps(lookup.Delta);
+    const __m256 bias = _mm256_set1_ps(lookup.Bias);
+    const __m256i codeBytes = _mm256_set1_epi64x(lookup.CodeBytes);
+    const uint8_t* tables = lookup.Quantized.data();
+
+    size_t e = 0;
+    constexpr size_t Step = 8;
+    for(; e + Step <= elemsNum; e += Step) {
+        const __m256i offsets0 = _mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(elemsIds + e))), codeBytes);
+        const __m256i offsets1 = _mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(elemsIds + e + 4))), codeBytes);
+        __m256i sum = _mm256_setzero_si256();
+        for(size_t dword = 0; dword < lookup.CodeBytes; dword += sizeof(int32_t)) {
+            const int* base = (const int*)(codes + dword);
+            const __m256i gathered = _mm256_set_m128i(
+                _mm256_i64gather_epi32(base, offsets1, 1),
+                _mm256_i64gather_epi32(base, offsets0, 1)
+            );
+            const uint8_t* table = tables + dword * 2 * TPqCodebook::Centroids;
+            for(int s = 0; s < 8; s += 1) {
+                const __m256i t = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + s * TPqCodebook::Centroids)));
+                sum = _mm256_add_epi32(sum, PqLookupDwords(t, gathered, s));
+            }
+        }
+        _mm256_storeu_ps(results + e, _mm256_fmadd_ps(_mm256_cvtepi32_ps(sum), delta, bias));
+    }
+    for(; e < elemsNum; e += 1) {
+        results[e] = lookup.QuantizedScore(codes + lookup.CodeBytes * elemsIds[e]);
+    }
+}
+
+static inline __m256i AddLanesU8(__m256i sum, __m256i bytes) {
+    return _mm256_add_epi16(sum, _mm256_add_epi16(
+        _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)),
+        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1))
+    ));
+}
+
+static inline void StorePqRows(float* results, __m256i sums, __m256 delta, __m256 bias) {
+    _mm256_storeu_ps(results, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(sums))), delta, bias));
+    _mm256_storeu_ps(results + 8, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(sums, 1))), delta, bias));
+}
+
+void TPqProductAvx2::FullScan(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results) {
+    const __m256 delta = _mm256_set1_ps(lookup.Delta);
+    const __m256 bias = _mm256_set1_ps(lookup.Bias);
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const size_t subspaces = lookup.Subspaces;
+    const uint8_t* tables = lookup.Quantized.data();
+    const size_t blockBytes = subspaces * 16;
+
+    alignas(32) float tail[PqBlockRows];
+    for(size_t row = 0; row < rowsNum; row += PqBlockRows) {
+        const uint8_t* block = blocks + row / PqBlockRows * blockBytes;
+        __m256i sum0 = _mm256_setzero_si256();
+        __m256i sum1 = _mm256_setzero_si256();
+        // a load covers two subspaces, lane by lane as the tables are laid out
+        for(size_t m = 0; m < subspaces; m += 2) {
+            const __m256i codes = _mm256_loadu_si256((const __m256i*)(block + m * 16));
+            const __m256i table = _mm256_loadu_si256((const __m256i*)(tables + m * TPqCodebook::Centroids));
+            sum0 = AddLanesU8(sum0, _mm256_shuffle_epi8(table, _mm256_and_si256(codes, mask)));
+            sum1 = AddLanesU8(sum1, _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(codes, 4), mask)));
+        }
+        float* out = row + PqBlockRows <= rowsNum ? results + row : tail;
+        StorePqRows(out, sum0, delta, bias);
+        StorePqRows(out + 16, sum1, delta, bias);
+        if (out == tail) {
+            std::copy(tail, tail + rowsNum - row, results + row);
+        }
+    }
+}
+
+// the query lanes whose bit is set, the others zero
+static inline __m256 SelectByBits(__m256 left, uint32_t bits) {
+    const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes);
+    return _mm256_and_ps(_mm256_castsi256_ps(mask), left);
+}
+
+void TBinaryProductAvx2::MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+    const size_t rowWords = TBinaryRows::RowWords(dim);
+    const size_t paddedDim = rowWords * TBinaryRows::WordDims;
+    // the padding bits are zero, the query only has to be readable up to them
+    std::vector<float> left(a, a + dim);
+    left.resize(paddedDim, 0.f);
+    float aa = 0;
+    for(size_t i = 0; i < dim; i += 1) {
+        aa += a[i];
+    }
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m256) / sizeof(float));
+    for(; e + Step <= elemsNum; e += Step) {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps();
+        __m256 sum3 = _mm256_setzero_ps();
+
+        const uint64_t* e0 = allB + rowWords * elemsIds[e + 0];
+        const uint64_t* e1 = allB + rowWords * elemsIds[e + 1];
+        const uint64_t* e2 = allB + rowWords * elemsIds[e + 2];
+        const uint64_t* e3 = allB + rowWords * elemsIds[e + 3];
+
+        for(size_t position = 0; position < paddedDim; position += ElemsInVec) {
+            const size_t word = position / TBinaryRows::WordDims;
+            const size_t shift = position % TBinaryRows::WordDims;
+            __m256 l = _mm256_loadu_ps(left.data() + position);
+            sum0 = _mm256_add_ps(sum0, SelectByBits(l, uint32_t(e0[word] >> shift) & 0xff));
+            sum1 = _mm256_add_ps(sum1, SelectByBits(l, uint32_t(e1[word] >> shift) & 0xff));
+            sum2 = _mm256_add_ps(sum2, SelectByBits(l, uint32_t(e2[word] >> shift) & 0xff));
+            sum3 = _mm256_add_ps(sum3, SelectByBits(l, uint32_t(e3[word] >> shift) & 0xff));
+        }
+
+        results[e + 0] = 2 * ReduceAdd(sum0) - aa;
+        results[e + 1] = 2 * ReduceAdd(sum1) - aa;
+        results[e + 2] = 2 * ReduceAdd(sum2) - aa;
+        results[e + 3] = 2 * ReduceAdd(sum3) - aa;
+    }
+
+    TBinaryProductNaive::MultiDotProduct(a, allB, dim, elemsIds + e, elemsNum - e, results + e);
+}
+
+// bits set per byte by two nibble lookups
+static inline __m256i PopcountBytes(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+    );
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    return _mm256_add_epi8(
+        _mm256_shuffle_epi8(table, _mm256_and_si256(v, mask)),
+        _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask))
+    );
+}
+
+// per word counts, a byte holds at most 8 so vpsadbw does not overflow
+static inline __m256i HammingStep(__m256i sum, __m256i row, __m256i query) {
+    return _mm256_add_epi64(sum, _mm256_sad_epu8(PopcountBytes(_mm256_xor_si256(row, query)), _mm256_setzero_si256()));
+}
+
+static inline uint64_t ReduceAdd64(__m256i v) {
+    const __m128i x = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return uint64_t(_mm_cvtsi128_si64(x)) + uint64_t(_mm_extract_epi64(x, 1));
+}
+
+void THammingProductAvx2::MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+    const size_t rowWords = TBinaryRows::RowWords(dim);
+    constexpr size_t WordsInVec = (sizeof(__m256i) / sizeof(uint64_t));
+    std::vector<uint64_t> query((rowWords + WordsInVec - 1) / WordsInVec * WordsInVec);
+    TBinaryRows::PackRow(a, dim, query.data());
+    const uint64_t* right = query.data();
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    const size_t bodyWords = rowWords - rowWords % WordsInVec;
+    const __m256i tail = _mm256_cmpgt_epi64(
+        _mm256_set1_epi64x(int64_t(rowWords - bodyWords)),
+        _mm256_setr_epi64x(0, 1, 2, 3)
+    );
+    for(; e + Step <= elemsNum; e += Step) {
+        __m256i sum0 = _mm256_setzero_si256();
+        __m256i sum1 = _mm256_setzero_si256();
+        __m256i sum2 = _mm256_setzero_si256();
+        __m256i sum3 = _mm256_setzero_si256();
+
+        const uint64_t* e0 = allB + rowWords * elemsIds[e + 0];
+        const uint64_t* e1 = allB + rowWords * elemsIds[e + 1];
+        const uint64_t* e2 = allB + rowWords * elemsIds[e + 2];
+        const uint64_t* e3 = allB + rowWords * elemsIds[e + 3];
+
+        for(size_t position = 0; position < bodyWords; position += WordsInVec) {
+            __m256i q = _mm256_loadu_si256((const __m256i*)(right + position));
+            sum0 = HammingStep(sum0, _mm256_loadu_si256((const __m256i*)(e0 + position)), q);
+            sum1 = HammingStep(sum1, _mm256_loadu_si256((const __m256i*)(e1 + position)), q);
+            sum2 = HammingStep(sum2, _mm256_loadu_si256((const __m256i*)(e2 + position)), q);
+            sum3 = HammingStep(sum3, _mm256_loadu_si256((const __m256i*)(e3 + position)), q);
+        }
+        if (bodyWords < rowWords) {
+            // masked off words are zero in the row and in the padded query
+            __m256i q = _mm256_loadu_si256((const __m256i*)(right + bodyWords));
+            sum0 = HammingStep(sum0, _mm256_maskload_epi64((const long long*)(e0 + bodyWords), tail), q);
+            sum1 = HammingStep(sum1, _mm256_maskload_epi64((const long long*)(e1 + bodyWords), tail), q);
+            sum2 = HammingStep(sum2, _mm256_maskload_epi64((const long long*)(e2 + bodyWords), tail), q);
+            sum3 = HammingStep(sum3, _mm256_maskload_epi64((const long long*)(e3 + bodyWords), tail), q);
+        }
+
+        results[e + 0] = float(dim) - 2.f * ReduceAdd64(sum0);
+        results[e + 1] = float(dim) - 2.f * ReduceAdd64(sum1);
+        results[e + 2] = float(dim) - 2.f * ReduceAdd64(sum2);
+        results[e + 3] = float(dim) - 2.f * ReduceAdd64(sum3);
+    }
+    for(; e < elemsNum; e += 1) {
+        __m256i sum0 = _mm256_setzero_si256();
+        const uint64_t* e0 = allB + rowWords * elemsIds[e];
+        for(size_t position = 0; position < bodyWords; position += WordsInVec) {
+            sum0 = HammingStep(sum0, _mm256_loadu_si256((const __m256i*)(e0 + position)), _mm256_loadu_si256((const __m256i*)(right + position)));
+        }
+        if (bodyWords < rowWords) {
+            sum0 = HammingStep(sum0, _mm256_maskload_epi64((const long long*)(e0 + bodyWords), tail), _mm256_loadu_si256((const __m256i*)(right + bodyWords)));
+        }
+        results[e] = float(dim) - 2.f * ReduceAdd64(sum0);
+    }
+}
+
+uint32_t TTopKFilterAvx2::Above(const float* scores, float threshold) {
+    const __m256 t = _mm256_set1_ps(threshold);
+    const uint32_t low = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_load_ps(scores), t, _CMP_GT_OQ));
+    const uint32_t high = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_load_ps(scores + 8), t, _CMP_GT_OQ));
+    return low | (high << 8);
+}
+
+void TInterleavedScanAvx2::FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results) {
+    constexpr size_t Phases = 4;
+    const size_t bodyDim = dim - dim % Phases;
+    alignas(32) float tail[ScanBlockRows];
+    for(size_t row = 0; row < rowsNum; row += ScanBlockRows) {
+        const float* block = blocks + row * dim;
+        __m256 low[Phases];
+        __m256 high[Phases];
+        for(size_t p = 0; p < Phases; p += 1) {
+            low[p] = _mm256_setzero_ps();
+            high[p] = _mm256_setzero_ps();
+        }
+        for(size_t i = 0; i < bodyDim; i += Phases) {
+            for(size_t p = 0; p < Phases; p += 1) { //unroll by constexpr size
+                const __m256 left = _mm256_broadcast_ss(a + i + p);
+                const float* values = block + (i + p) * ScanBlockRows;
+                low[p] = _mm256_fmadd_ps(left, _mm256_loadu_ps(values), low[p]);
+                high[p] = _mm256_fmadd_ps(left, _mm256_loadu_ps(values + 8), high[p]);
+            }
+        }
+        for(size_t i = bodyDim; i < dim; i += 1) {
+            const __m256 left = _mm256_broadcast_ss(a + i);
+            low[0] = _mm256_fmadd_ps(left, _mm256_loadu_ps(block + i * ScanBlockRows), low[0]);
+            high[0] = _mm256_fmadd_ps(left, _mm256_loadu_ps(block + i * ScanBlockRows + 8), high[0]);
+        }
+        low[0] = _mm256_add_ps(_mm256_add_ps(low[0], low[1]), _mm256_add_ps(low[2], low[3]));
+        high[0] = _mm256_add_ps(_mm256_add_ps(high[0], high[1]), _mm256_add_ps(high[2], high[3]));
+
+        float* out = row + ScanBlockRows <= rowsNum ? results + row : tail;
+        _mm256_storeu_ps(out, low[0]);
+        _mm256_storeu_ps(out + 8, high[0]);
+        if (out == tail) {
+            std::copy(tail, tail + rowsNum - row, results + row);
+        }
+    }
+}
+
+uint64_t TFmaPeakAvx2::Run(size_t iterations, float* sink) {
+    // two fma ports of 4-5 cycles latency need 8-10 chains in flight, 12 leave slack
+    constexpr size_t Chains = 12;
+    __m256 acc[Chains];
+    for(size_t i = 0; i < Chains; i += 1) {
+        acc[i] = _mm256_set1_ps(float(i));
+    }
+    const __m256 mul = _mm256_set1_ps(0.999f);
+    const __m256 add = _mm256_set1_ps(0.001f);
+    for(size_t it = 0; it < iterations; it += 1) {
+#pragma GCC unroll 12
+        for(size_t i = 0; i < Chains; i += 1) {
+            acc[i] = _mm256_fmadd_ps(acc[i], mul, add);
+        }
+    }
+    for(size_t i = 1; i < Chains; i += 1) {
+        acc[0] = _mm256_add_ps(acc[0], acc[i]);
+    }
+    _mm256_storeu_ps(sink, acc[0]);
+    return uint64_t(iterations) * Chains * 8 * 2;
+}
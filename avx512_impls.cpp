@@ -1,9 +1,29 @@
 #include "dot_product.h"
 #include "multidot.h"
 #include "dotpacked.h"
+#include "topk.h"
+#include "halfdot.h"
+#include "dotnibble.h"
+#include "dotscaled.h"
+#include "pq.h"
+#include "dotbinary.h"
+#include "roofline.h"
+#include "fixed_dim_impl.h"
+#include "distance_impl.h"
+#include "fullscan.h"
 
 #include <immintrin.h>
 
+// all kernels below use unaligned loads - on avx512 hardware loadu of aligned data costs the same as load,
+// and dim % 16 (% 64 for the V2 packed) is handled by one masked step after the main loop
+static inline __mmask16 TailMask16(size_t rest) {
+    return _cvtu32_mask16((1u << rest) - 1u);
+}
+
+static inline __mmask64 TailMask64(size_t rest) {
+    return _cvtu64_mask64((uint64_t(1) << rest) - 1u);
+}
+
 float TNaiveAvx512Auto::DotProduct(const float* a, const float* b, size_t dim) {
     return TNaive::DotProduct(a, b, dim);
 }
@@ -12,11 +32,18 @@ float TNaiveAvx512Auto::DotProduct(const float* a, const float* b, size_t dim) {
 float TNaiveAvx512ASM::DotProduct(
     const float* a, const float* b, size_t dim
 ) {
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
     __m512 sum0 = _mm512_setzero_ps();
 
-    for(size_t position = 0; position < dim; position += (sizeof(__m512) / sizeof(float))) {
-        __m512 left = _mm512_load_ps(a + position);
-        sum0 = _mm512_fmadd_ps(left, _mm512_load_ps(b + position), sum0);
+    for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+        __m512 left = _mm512_loadu_ps(a + position);
+        sum0 = _mm512_fmadd_ps(left, _mm512_loadu_ps(b + position), sum0);
+    }
+    if (bodyDim < dim) {
+        const __mmask16 tail = TailMask16(dim - bodyDim);
+        __m512 left = _mm512_maskz_loadu_ps(tail, a + bodyDim);
+        sum0 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, b + bodyDim), sum0);
     }
 
     return _mm512_reduce_add_ps(sum0);
@@ -50,6 +77,12 @@ DeclByStep(14)
 DeclByStep(15)
 DeclByStep(16)
 
+#define DeclFixedDim(Dim) DeclFixedDimByIsa(AVX512, Dim)
+
+ForEachFixedDim(DeclFixedDim)
+
+DeclDistanceByIsa(AVX512)
+
 void TMultiDotCTStepV3FloatOpts_AVX512::MultiDotProduct(
     const float* a,
     const float* allB,
@@ -71,6 +104,9 @@ void TMultiDotV3_ASM_AVX512::MultiDotProduct(
 ) {
     size_t e = 0;
     constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
     for(; e + Step <= elemsNum; e += Step) {
         __m512 sum0 = _mm512_setzero_ps();
         __m512 sum1 = _mm512_setzero_ps();
@@ -90,16 +126,23 @@ void TMultiDotV3_ASM_AVX512::MultiDotProduct(
         // const float* e6 = allB + dim * elemsIds[e + 6];
         // const float* e7 = allB + dim * elemsIds[e + 7];
 
-        for(size_t position = 0; position < dim; position += (sizeof(__m512) / sizeof(float))) {
-            __m512 left = _mm512_load_ps(a + position);
-            sum0 = _mm512_fmadd_ps(left, _mm512_load_ps(e0 + position), sum0);
-            sum1 = _mm512_fmadd_ps(left, _mm512_load_ps(e1 + position), sum1);
-            sum2 = _mm512_fmadd_ps(left, _mm512_load_ps(e2 + position), sum2);
-            sum3 = _mm512_fmadd_ps(left, _mm512_load_ps(e3 + position), sum3);
-            // sum4 = _mm512_fmadd_ps(left, _mm512_load_ps(e4 + position), sum4);
-            // sum5 = _mm512_fmadd_ps(left, _mm512_load_ps(e5 + position), sum5);
-            // sum6 = _mm512_fmadd_ps(left, _mm512_load_ps(e6 + position), sum6);
-            // sum7 = _mm512_fmadd_ps(left, _mm512_load_ps(e7 + position), sum7);
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m512 left = _mm512_loadu_ps(a + position);
+            sum0 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e0 + position), sum0);
+            sum1 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e1 + position), sum1);
+            sum2 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e2 + position), sum2);
+            sum3 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e3 + position), sum3);
+            // sum4 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e4 + position), sum4);
+            // sum5 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e5 + position), sum5);
+            // sum6 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e6 + position), sum6);
+            // sum7 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e7 + position), sum7);
+        }
+        if (bodyDim < dim) {
+            __m512 left = _mm512_maskz_loadu_ps(tail, a + bodyDim);
+            sum0 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e0 + bodyDim), sum0);
+            sum1 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e1 + bodyDim), sum1);
+            sum2 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e2 + bodyDim), sum2);
+            sum3 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e3 + bodyDim), sum3);
         }
 
         results[e + 0] = _mm512_reduce_add_ps(sum0);
@@ -127,6 +170,8 @@ void TMultiDotV3_ASM_PREFETCH_AVX512::MultiDotProduct(
     size_t e = 0;
     constexpr size_t Step = 4;
     constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
     for(; e + Step <= elemsNum; e += Step) {
         __m512 sum0 = _mm512_setzero_ps();
         __m512 sum1 = _mm512_setzero_ps();
@@ -138,18 +183,27 @@ void TMultiDotV3_ASM_PREFETCH_AVX512::MultiDotProduct(
         const float* e2 = allB + dim * elemsIds[e + 2];
         const float* e3 = allB + dim * elemsIds[e + 3];
 
-        for(size_t position = 0; position < dim; position += ElemsInVec) {
-            __m512 left = _mm512_load_ps(a + position);
-            sum0 = _mm512_fmadd_ps(left, _mm512_load_ps(e0 + position), sum0);
-            sum1 = _mm512_fmadd_ps(left, _mm512_load_ps(e1 + position), sum1);
-            sum2 = _mm512_fmadd_ps(left, _mm512_load_ps(e2 + position), sum2);
-            sum3 = _mm512_fmadd_ps(left, _mm512_load_ps(e3 + position), sum3);
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m512 left = _mm512_loadu_ps(a + position);
+            sum0 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e0 + position), sum0);
+            sum1 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e1 + position), sum1);
+            sum2 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e2 + position), sum2);
+            sum3 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e3 + position), sum3);
+        }
+        if (bodyDim < dim) {
+            __m512 left = _mm512_maskz_loadu_ps(tail, a + bodyDim);
+            sum0 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e0 + bodyDim), sum0);
+            sum1 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e1 + bodyDim), sum1);
+            sum2 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e2 + bodyDim), sum2);
+            sum3 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e3 + bodyDim), sum3);
+        }
+        if (e + 2 * Step <= elemsNum) { // do not read elemsIds past the end
+            __builtin_prefetch(a, 0);
+            __builtin_prefetch(allB + dim * elemsIds[e + 4 + 0], 0);
+            __builtin_prefetch(allB + dim * elemsIds[e + 4 + 1], 0);
+            __builtin_prefetch(allB + dim * elemsIds[e + 4 + 2], 0);
+            __builtin_prefetch(allB + dim * elemsIds[e + 4 + 3], 0);
         }
-        __builtin_prefetch(a, 0);
-        __builtin_prefetch(allB + dim * elemsIds[e + 4 + 0], 0);
-        __builtin_prefetch(allB + dim * elemsIds[e + 4 + 1], 0);
-        __builtin_prefetch(allB + dim * elemsIds[e + 4 + 2], 0);
-        __builtin_prefetch(allB + dim * elemsIds[e + 4 + 3], 0);
 
         results[e + 0] = _mm512_reduce_add_ps(sum0);
         results[e + 1] = _mm512_reduce_add_ps(sum1);
@@ -162,6 +216,126 @@ void TMultiDotV3_ASM_PREFETCH_AVX512::MultiDotProduct(
 }
 
 
+void TMultiQueryFloatOpts_AVX512::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    TMultiQueryCTStep<4, 4>::MultiQueryDotProduct(queries, queriesNum, allB, dim, elemsIds, elemsNum, results);
+}
+
+void TPackedMultiQueryOpts_AVX512::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    TPackedMultiQueryCTStep<4, 4>::MultiQueryDotProduct(
+        queries, queriesNum, allB, dim, elemsIds, elemsNum, bias, coeff, results
+    );
+}
+
+static inline void FmaddRows(
+    __m512 left, __m512 r0, __m512 r1, __m512 r2, __m512 r3,
+    __m512& sum0, __m512& sum1, __m512& sum2, __m512& sum3
+) {
+    sum0 = _mm512_fmadd_ps(left, r0, sum0);
+    sum1 = _mm512_fmadd_ps(left, r1, sum1);
+    sum2 = _mm512_fmadd_ps(left, r2, sum2);
+    sum3 = _mm512_fmadd_ps(left, r3, sum3);
+}
+
+static inline void StoreReduced(
+    float* results, __m512 sum0, __m512 sum1, __m512 sum2, __m512 sum3, float coeff = 1.f, float bb = 0.f
+) {
+    results[0] = _mm512_reduce_add_ps(sum0) * coeff + bb;
+    results[1] = _mm512_reduce_add_ps(sum1) * coeff + bb;
+    results[2] = _mm512_reduce_add_ps(sum2) * coeff + bb;
+    results[3] = _mm512_reduce_add_ps(sum3) * coeff + bb;
+}
+
+void TMultiQueryASM_AVX512::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t QStep = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
+    for(; e + Step <= elemsNum; e += Step) {
+        const float* e0 = allB + dim * elemsIds[e + 0];
+        const float* e1 = allB + dim * elemsIds[e + 1];
+        const float* e2 = allB + dim * elemsIds[e + 2];
+        const float* e3 = allB + dim * elemsIds[e + 3];
+
+        // rows are fetched from memory by the first block of queries, the next blocks find them in L1/L2
+        size_t q = 0;
+        for(; q + QStep <= queriesNum; q += QStep) {
+            const float* q0 = queries + (q + 0) * dim;
+            const float* q1 = queries + (q + 1) * dim;
+            const float* q2 = queries + (q + 2) * dim;
+            const float* q3 = queries + (q + 3) * dim;
+
+            __m512 sum00 = _mm512_setzero_ps(), sum01 = _mm512_setzero_ps(), sum02 = _mm512_setzero_ps(), sum03 = _mm512_setzero_ps();
+            __m512 sum10 = _mm512_setzero_ps(), sum11 = _mm512_setzero_ps(), sum12 = _mm512_setzero_ps(), sum13 = _mm512_setzero_ps();
+            __m512 sum20 = _mm512_setzero_ps(), sum21 = _mm512_setzero_ps(), sum22 = _mm512_setzero_ps(), sum23 = _mm512_setzero_ps();
+            __m512 sum30 = _mm512_setzero_ps(), sum31 = _mm512_setzero_ps(), sum32 = _mm512_setzero_ps(), sum33 = _mm512_setzero_ps();
+
+            for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+                __m512 r0 = _mm512_loadu_ps(e0 + position);
+                __m512 r1 = _mm512_loadu_ps(e1 + position);
+                __m512 r2 = _mm512_loadu_ps(e2 + position);
+                __m512 r3 = _mm512_loadu_ps(e3 + position);
+                FmaddRows(_mm512_loadu_ps(q0 + position), r0, r1, r2, r3, sum00, sum01, sum02, sum03);
+                FmaddRows(_mm512_loadu_ps(q1 + position), r0, r1, r2, r3, sum10, sum11, sum12, sum13);
+                FmaddRows(_mm512_loadu_ps(q2 + position), r0, r1, r2, r3, sum20, sum21, sum22, sum23);
+                FmaddRows(_mm512_loadu_ps(q3 + position), r0, r1, r2, r3, sum30, sum31, sum32, sum33);
+            }
+            if (bodyDim < dim) {
+                __m512 r0 = _mm512_maskz_loadu_ps(tail, e0 + bodyDim);
+                __m512 r1 = _mm512_maskz_loadu_ps(tail, e1 + bodyDim);
+                __m512 r2 = _mm512_maskz_loadu_ps(tail, e2 + bodyDim);
+                __m512 r3 = _mm512_maskz_loadu_ps(tail, e3 + bodyDim);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q0 + bodyDim), r0, r1, r2, r3, sum00, sum01, sum02, sum03);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q1 + bodyDim), r0, r1, r2, r3, sum10, sum11, sum12, sum13);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q2 + bodyDim), r0, r1, r2, r3, sum20, sum21, sum22, sum23);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q3 + bodyDim), r0, r1, r2, r3, sum30, sum31, sum32, sum33);
+            }
+
+            StoreReduced(results + (q + 0) * elemsNum + e, sum00, sum01, sum02, sum03);
+            StoreReduced(results + (q + 1) * elemsNum + e, sum10, sum11, sum12, sum13);
+            StoreReduced(results + (q + 2) * elemsNum + e, sum20, sum21, sum22, sum23);
+            StoreReduced(results + (q + 3) * elemsNum + e, sum30, sum31, sum32, sum33);
+        }
+        for(; q < queriesNum; q += 1) {
+            TMultiDotV3_ASM_AVX512::MultiDotProduct(
+                queries + q * dim, allB, dim, elemsIds + e, Step, results + q * elemsNum + e
+            );
+        }
+    }
+    for(size_t q = 0; q < queriesNum && e < elemsNum; q += 1) {
+        TMultiDotV3_ASM_AVX512::MultiDotProduct(
+            queries + q * dim, allB, dim, elemsIds + e, elemsNum - e, results + q * elemsNum + e
+        );
+    }
+}
+
 
 void TPackedProductInlinedAvx512Auto::MultiDotProduct(
         const float* a,
@@ -213,6 +387,8 @@ void TPackedProductAvx512ASM::MultiDotProduct(
     size_t e = 0;
     constexpr size_t Step = 4;
     constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
     for(; e + Step <= elemsNum; e += Step) {
         __m512 sum0 = _mm512_setzero_ps();
         __m512 sum1 = _mm512_setzero_ps();
@@ -224,8 +400,8 @@ void TPackedProductAvx512ASM::MultiDotProduct(
         const uint8_t* e2 = allB + dim * elemsIds[e + 2];
         const uint8_t* e3 = allB + dim * elemsIds[e + 3];
 
-        for(size_t position = 0; position < dim; position += ElemsInVec) {
-            __m512 left = _mm512_load_ps(a + position);
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m512 left = _mm512_loadu_ps(a + position);
             __m512 right0 = _mm512_cvtepi32_ps(
                 _mm512_cvtepu16_epi32(
                     _mm256_cvtepu8_epi16(
@@ -260,6 +436,18 @@ void TPackedProductAvx512ASM::MultiDotProduct(
             sum2 = _mm512_fmadd_ps(left, right2, sum2);
             sum3 = _mm512_fmadd_ps(left, right3, sum3);
         }
+        if (bodyDim < dim) {
+            __m512 left = _mm512_maskz_loadu_ps(tail, a + bodyDim);
+            __m512 right0 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(tail, e0 + bodyDim)));
+            __m512 right1 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(tail, e1 + bodyDim)));
+            __m512 right2 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(tail, e2 + bodyDim)));
+            __m512 right3 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(tail, e3 + bodyDim)));
+
+            sum0 = _mm512_fmadd_ps(left, right0, sum0);
+            sum1 = _mm512_fmadd_ps(left, right1, sum1);
+            sum2 = _mm512_fmadd_ps(left, right2, sum2);
+            sum3 = _mm512_fmadd_ps(left, right3, sum3);
+        }
 
         results[e + 0] = _mm512_reduce_add_ps(sum0) * coeff + bb;
         results[e + 1] = _mm512_reduce_add_ps(sum1) * coeff + bb;
@@ -289,6 +477,12 @@ void TPackedProductV2Avx512ASM::MultiDotProduct(
     size_t e = 0;
     constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(uint8_t));
     constexpr size_t ElemsInVecLeft = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask64 tail = TailMask64(dim - bodyDim);
+    const __mmask16 tail0 = __mmask16(tail >> (0 * ElemsInVecLeft));
+    const __mmask16 tail1 = __mmask16(tail >> (1 * ElemsInVecLeft));
+    const __mmask16 tail2 = __mmask16(tail >> (2 * ElemsInVecLeft));
+    const __mmask16 tail3 = __mmask16(tail >> (3 * ElemsInVecLeft));
     for(; e < elemsNum; e += 1) {
         __m512 sum0 = _mm512_setzero_ps();
         __m512 sum1 = _mm512_setzero_ps();
@@ -297,11 +491,11 @@ void TPackedProductV2Avx512ASM::MultiDotProduct(
 
         const uint8_t* row = allB + dim * elemsIds[e + 0];
 
-        for(size_t position = 0; position < dim; position += ElemsInVec) {
-            __m512 left0 = _mm512_load_ps(a + position + 0 * ElemsInVecLeft);
-            __m512 left1 = _mm512_load_ps(a + position + 1 * ElemsInVecLeft);
-            __m512 left2 = _mm512_load_ps(a + position + 2 * ElemsInVecLeft);
-            __m512 left3 = _mm512_load_ps(a + position + 3 * ElemsInVecLeft);
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m512 left0 = _mm512_loadu_ps(a + position + 0 * ElemsInVecLeft);
+            __m512 left1 = _mm512_loadu_ps(a + position + 1 * ElemsInVecLeft);
+            __m512 left2 = _mm512_loadu_ps(a + position + 2 * ElemsInVecLeft);
+            __m512 left3 = _mm512_loadu_ps(a + position + 3 * ElemsInVecLeft);
 
             __m512i rightLoaded = _mm512_loadu_epi8(row + position);
             __m128i right0 = _mm512_extracti32x4_epi32(rightLoaded, 0);
@@ -341,6 +535,19 @@ void TPackedProductV2Avx512ASM::MultiDotProduct(
                 )
             ), left3, sum3);
         }
+        if (bodyDim < dim) {
+            // masked off lanes are zero in both operands, so they add nothing
+            __m512 left0 = _mm512_maskz_loadu_ps(tail0, a + bodyDim + 0 * ElemsInVecLeft);
+            __m512 left1 = _mm512_maskz_loadu_ps(tail1, a + bodyDim + 1 * ElemsInVecLeft);
+            __m512 left2 = _mm512_maskz_loadu_ps(tail2, a + bodyDim + 2 * ElemsInVecLeft);
+            __m512 left3 = _mm512_maskz_loadu_ps(tail3, a + bodyDim + 3 * ElemsInVecLeft);
+
+            __m512i rightLoaded = _mm512_maskz_loadu_epi8(tail, row + bodyDim);
+            sum0 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rightLoaded, 0))), left0, sum0);
+            sum1 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rightLoaded, 1))), left1, sum1);
+            sum2 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rightLoaded, 2))), left2, sum2);
+            sum3 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rightLoaded, 3))), left3, sum3);
+        }
 
         results[e] = _mm512_reduce_add_ps(_mm512_add_ps(
             _mm512_add_ps(sum0, sum1),
@@ -348,3 +555,783 @@ void TPackedProductV2Avx512ASM::MultiDotProduct(
         )) * coeff + bb;
     }
 }
+
+
+static inline __m512 WidenU8(__m128i v) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(v));
+}
+
+void TPackedMultiQueryAvx512ASM::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    std::vector<float> bb(queriesNum, 0.f);
+    for(size_t q = 0; q < queriesNum; q += 1) {
+        for(size_t i = 0; i < dim; i += 1) {
+            bb[q] += queries[q * dim + i];
+        }
+        bb[q] *= bias;
+    }
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t QStep = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
+    for(; e + Step <= elemsNum; e += Step) {
+        const uint8_t* e0 = allB + dim * elemsIds[e + 0];
+        const uint8_t* e1 = allB + dim * elemsIds[e + 1];
+        const uint8_t* e2 = allB + dim * elemsIds[e + 2];
+        const uint8_t* e3 = allB + dim * elemsIds[e + 3];
+
+        size_t q = 0;
+        for(; q + QStep <= queriesNum; q += QStep) {
+            const float* q0 = queries + (q + 0) * dim;
+            const float* q1 = queries + (q + 1) * dim;
+            const float* q2 = queries + (q + 2) * dim;
+            const float* q3 = queries + (q + 3) * dim;
+
+            __m512 sum00 = _mm512_setzero_ps(), sum01 = _mm512_setzero_ps(), sum02 = _mm512_setzero_ps(), sum03 = _mm512_setzero_ps();
+            __m512 sum10 = _mm512_setzero_ps(), sum11 = _mm512_setzero_ps(), sum12 = _mm512_setzero_ps(), sum13 = _mm512_setzero_ps();
+            __m512 sum20 = _mm512_setzero_ps(), sum21 = _mm512_setzero_ps(), sum22 = _mm512_setzero_ps(), sum23 = _mm512_setzero_ps();
+            __m512 sum30 = _mm512_setzero_ps(), sum31 = _mm512_setzero_ps(), sum32 = _mm512_setzero_ps(), sum33 = _mm512_setzero_ps();
+
+            // the row bytes are widened once and used by all 4 queries
+            for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+                __m512 r0 = WidenU8(_mm_loadu_si128((const __m128i*)(e0 + position)));
+                __m512 r1 = WidenU8(_mm_loadu_si128((const __m128i*)(e1 + position)));
+                __m512 r2 = WidenU8(_mm_loadu_si128((const __m128i*)(e2 + position)));
+                __m512 r3 = WidenU8(_mm_loadu_si128((const __m128i*)(e3 + position)));
+                FmaddRows(_mm512_loadu_ps(q0 + position), r0, r1, r2, r3, sum00, sum01, sum02, sum03);
+                FmaddRows(_mm512_loadu_ps(q1 + position), r0, r1, r2, r3, sum10, sum11, sum12, sum13);
+                FmaddRows(_mm512_loadu_ps(q2 + position), r0, r1, r2, r3, sum20, sum21, sum22, sum23);
+                FmaddRows(_mm512_loadu_ps(q3 + position), r0, r1, r2, r3, sum30, sum31, sum32, sum33);
+            }
+            if (bodyDim < dim) {
+                __m512 r0 = WidenU8(_mm_maskz_loadu_epi8(tail, e0 + bodyDim));
+                __m512 r1 = WidenU8(_mm_maskz_loadu_epi8(tail, e1 + bodyDim));
+                __m512 r2 = WidenU8(_mm_maskz_loadu_epi8(tail, e2 + bodyDim));
+                __m512 r3 = WidenU8(_mm_maskz_loadu_epi8(tail, e3 + bodyDim));
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q0 + bodyDim), r0, r1, r2, r3, sum00, sum01, sum02, sum03);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q1 + bodyDim), r0, r1, r2, r3, sum10, sum11, sum12, sum13);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q2 + bodyDim), r0, r1, r2, r3, sum20, sum21, sum22, sum23);
+                FmaddRows(_mm512_maskz_loadu_ps(tail, q3 + bodyDim), r0, r1, r2, r3, sum30, sum31, sum32, sum33);
+            }
+
+            StoreReduced(results + (q + 0) * elemsNum + e, sum00, sum01, sum02, sum03, coeff, bb[q + 0]);
+            StoreReduced(results + (q + 1) * elemsNum + e, sum10, sum11, sum12, sum13, coeff, bb[q + 1]);
+            StoreReduced(results + (q + 2) * elemsNum + e, sum20, sum21, sum22, sum23, coeff, bb[q + 2]);
+            StoreReduced(results + (q + 3) * elemsNum + e, sum30, sum31, sum32, sum33, coeff, bb[q + 3]);
+        }
+        for(; q < queriesNum; q += 1) {
+            TPackedProductAvx512ASM::MultiDotProduct(
+                queries + q * dim, allB, dim, elemsIds + e, Step, bias, coeff, results + q * elemsNum + e
+            );
+        }
+    }
+    for(size_t q = 0; q < queriesNum && e < elemsNum; q += 1) {
+        TPackedProductAvx512ASM::MultiDotProduct(
+            queries + q * dim, allB, dim, elemsIds + e, elemsNum - e, bias, coeff, results + q * elemsNum + e
+        );
+    }
+}
+
+uint32_t TTopKFilterAvx512::Above(const float* scores, float threshold) {
+    return _mm512_cmp_ps_mask(_mm512_load_ps(scores), _mm512_set1_ps(threshold), _CMP_GT_OQ);
+}
+
+// the 4 rows of the block distance blocks ahead, Locality as in __builtin_prefetch: 3 - t0, 2 - t1, 0 - nta,
+// < 0 compiles the prefetches out
+template<int Locality>
+struct TAheadRows {
+    const char* Row[4];
+
+    inline void Line(size_t offset) const {
+        if constexpr (Locality >= 0) {
+            __builtin_prefetch(Row[0] + offset, 0, Locality);
+            __builtin_prefetch(Row[1] + offset, 0, Locality);
+            __builtin_prefetch(Row[2] + offset, 0, Locality);
+            __builtin_prefetch(Row[3] + offset, 0, Locality);
+        }
+    }
+};
+
+// past the end the current block is prefetched again, it is in flight already and the loop keeps no branch
+template<int Locality, class TElem>
+static inline TAheadRows<Locality> AheadRows(
+    const TElem* allB, size_t dim, const uint32_t* elemsIds, size_t elemsNum, size_t e, size_t ahead
+) {
+    constexpr size_t Step = 4;
+    const size_t f = e + ahead + Step <= elemsNum ? e + ahead : e;
+    return {{
+        (const char*)(allB + dim * elemsIds[f + 0]),
+        (const char*)(allB + dim * elemsIds[f + 1]),
+        (const char*)(allB + dim * elemsIds[f + 2]),
+        (const char*)(allB + dim * elemsIds[f + 3]),
+    }};
+}
+
+template<int Locality>
+static void MultiDotDeepPrefetch(
+    size_t distance,
+    const float* a,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
+    const size_t rowBytes = dim * sizeof(float);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps();
+        __m512 sum3 = _mm512_setzero_ps();
+
+        const float* e0 = allB + dim * elemsIds[e + 0];
+        const float* e1 = allB + dim * elemsIds[e + 1];
+        const float* e2 = allB + dim * elemsIds[e + 2];
+        const float* e3 = allB + dim * elemsIds[e + 3];
+        const TAheadRows<Locality> next = AheadRows<Locality>(allB, dim, elemsIds, elemsNum, e, distance * Step);
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            next.Line(position * sizeof(float));
+            __m512 left = _mm512_loadu_ps(a + position);
+            sum0 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e0 + position), sum0);
+            sum1 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e1 + position), sum1);
+            sum2 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e2 + position), sum2);
+            sum3 = _mm512_fmadd_ps(left, _mm512_loadu_ps(e3 + position), sum3);
+        }
+        // the tail and the extra line of a row that does not start on a line boundary
+        next.Line(rowBytes - 1);
+        if (bodyDim < dim) {
+            __m512 left = _mm512_maskz_loadu_ps(tail, a + bodyDim);
+            sum0 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e0 + bodyDim), sum0);
+            sum1 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e1 + bodyDim), sum1);
+            sum2 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e2 + bodyDim), sum2);
+            sum3 = _mm512_fmadd_ps(left, _mm512_maskz_loadu_ps(tail, e3 + bodyDim), sum3);
+        }
+
+        StoreReduced(results + e, sum0, sum1, sum2, sum3);
+    }
+    for(; e < elemsNum; e += 1) {
+        results[e] = TNaiveAvx512Auto::DotProduct(a, allB + dim * elemsIds[e], dim);
+    }
+}
+
+template<int Locality>
+static void PackedDeepPrefetch(
+    size_t distance,
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    float bb = 0;
+    for(size_t i = 0; i < dim; i += 1) {
+        bb += a[i];
+    }
+    bb *= bias;
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    constexpr size_t LineBytes = 64;
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps();
+        __m512 sum3 = _mm512_setzero_ps();
+
+        const uint8_t* e0 = allB + dim * elemsIds[e + 0];
+        const uint8_t* e1 = allB + dim * elemsIds[e + 1];
+        const uint8_t* e2 = allB + dim * elemsIds[e + 2];
+        const uint8_t* e3 = allB + dim * elemsIds[e + 3];
+        const TAheadRows<Locality> next = AheadRows<Locality>(allB, dim, elemsIds, elemsNum, e, distance * Step);
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            if (position % LineBytes == 0) {
+                next.Line(position);
+            }
+            __m512 left = _mm512_loadu_ps(a + position);
+            FmaddRows(
+                left,
+                WidenU8(_mm_loadu_si128((const __m128i*)(e0 + position))),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e1 + position))),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e2 + position))),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e3 + position))),
+                sum0, sum1, sum2, sum3
+            );
+        }
+        next.Line(dim - 1);
+        if (bodyDim < dim) {
+            __m512 left = _mm512_maskz_loadu_ps(tail, a + bodyDim);
+            FmaddRows(
+                left,
+                WidenU8(_mm_maskz_loadu_epi8(tail, e0 + bodyDim)),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e1 + bodyDim)),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e2 + bodyDim)),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e3 + bodyDim)),
+                sum0, sum1, sum2, sum3
+            );
+        }
+
+        StoreReduced(results + e, sum0, sum1, sum2, sum3, coeff, bb);
+    }
+
+    TPackedProductInlinedWithMath::MultiDotProduct(a, allB, dim, elemsIds + e, elemsNum - e, bias, coeff, results + e);
+}
+
+TPrefetchConfig TMultiDotDeepPrefetchAVX512::Config;
+TPrefetchConfig TPackedProductDeepPrefetchAvx512ASM::Config;
+
+void TMultiDotDeepPrefetchAVX512::MultiDotProductWith(
+    const TPrefetchConfig& config,
+    const float* a,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    const size_t d = config.Distance;
+    if (d == 0) {
+        return MultiDotDeepPrefetch<-1>(d, a, allB, dim, elemsIds, elemsNum, results);
+    }
+    switch (config.Hint) {
+        case EPrefetchHint::T0: return MultiDotDeepPrefetch<3>(d, a, allB, dim, elemsIds, elemsNum, results);
+        case EPrefetchHint::T1: return MultiDotDeepPrefetch<2>(d, a, allB, dim, elemsIds, elemsNum, results);
+        case EPrefetchHint::Nta: return MultiDotDeepPrefetch<0>(d, a, allB, dim, elemsIds, elemsNum, results);
+    }
+}
+
+void TPackedProductDeepPrefetchAvx512ASM::MultiDotProductWith(
+    const TPrefetchConfig& config,
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    const size_t d = config.Distance;
+    if (d == 0) {
+        return PackedDeepPrefetch<-1>(d, a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+    switch (config.Hint) {
+        case EPrefetchHint::T0:
+            return PackedDeepPrefetch<3>(d, a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+        case EPrefetchHint::T1:
+            return PackedDeepPrefetch<2>(d, a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+        case EPrefetchHint::Nta:
+            return PackedDeepPrefetch<0>(d, a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+}
+
+struct TWidenHalf512 {
+    static inline __m512 Load(const uint16_t* p) {
+        return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p));
+    }
+
+    static inline __m512 LoadMasked(__mmask16 mask, const uint16_t* p) {
+        return _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(mask, p));
+    }
+};
+
+struct TWidenBf16512 {
+    static inline __m512 Widen(__m256i v) {
+        return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(v), 16));
+    }
+
+    static inline __m512 Load(const uint16_t* p) {
+        return Widen(_mm256_loadu_si256((const __m256i*)p));
+    }
+
+    static inline __m512 LoadMasked(__mmask16 mask, const uint16_t* p) {
+        return Widen(_mm256_maskz_loadu_epi16(mask, p));
+    }
+};
+
+template<class TWiden>
+static void MultiDotHalfRows(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps();
+        __m512 sum3 = _mm512_setzero_ps();
+
+        const uint16_t* e0 = allB + dim * elemsIds[e + 0];
+        const uint16_t* e1 = allB + dim * elemsIds[e + 1];
+        const uint16_t* e2 = allB + dim * elemsIds[e + 2];
+        const uint16_t* e3 = allB + dim * elemsIds[e + 3];
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            FmaddRows(
+                _mm512_loadu_ps(a + position),
+                TWiden::Load(e0 + position),
+                TWiden::Load(e1 + position),
+                TWiden::Load(e2 + position),
+                TWiden::Load(e3 + position),
+                sum0, sum1, sum2, sum3
+            );
+        }
+        if (bodyDim < dim) {
+            FmaddRows(
+                _mm512_maskz_loadu_ps(tail, a + bodyDim),
+                TWiden::LoadMasked(tail, e0 + bodyDim),
+                TWiden::LoadMasked(tail, e1 + bodyDim),
+                TWiden::LoadMasked(tail, e2 + bodyDim),
+                TWiden::LoadMasked(tail, e3 + bodyDim),
+                sum0, sum1, sum2, sum3
+            );
+        }
+
+        StoreReduced(results + e, sum0, sum1, sum2, sum3);
+    }
+    for(; e < elemsNum; e += 1) {
+        const uint16_t* e0 = allB + dim * elemsIds[e];
+        __m512 sum0 = _mm512_setzero_ps();
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + position), TWiden::Load(e0 + position), sum0);
+        }
+        if (bodyDim < dim) {
+            sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, a + bodyDim), TWiden::LoadMasked(tail, e0 + bodyDim), sum0);
+        }
+        results[e] = _mm512_reduce_add_ps(sum0);
+    }
+}
+
+void THalfProductAvx512ASM::MultiDotProduct(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    MultiDotHalfRows<TWidenHalf512>(a, allB, dim, elemsIds, elemsNum, results);
+}
+
+void TBf16ProductAvx512ASM::MultiDotProduct(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    MultiDotHalfRows<TWidenBf16512>(a, allB, dim, elemsIds, elemsNum, results);
+}
+
+// two 32 byte nibble blocks per load, the query regrouped by TNibbleQuery::SplitPairs
+static inline __m512i NibbleStep(__m512i sum, __m512i row, __m512i low, __m512i high, __m512i mask, __m512i ones) {
+    const __m512i pairs = _mm512_add_epi16(
+        _mm512_maddubs_epi16(_mm512_and_si512(row, mask), low),
+        _mm512_maddubs_epi16(_mm512_and_si512(_mm512_srli_epi16(row, 4), mask), high)
+    );
+    return _mm512_add_epi32(sum, _mm512_madd_epi16(pairs, ones));
+}
+
+// the odd last block at half width, left is the query block in natural order
+static inline __m512i NibbleLastBlock(__m512i sum, const uint8_t* row, const int8_t* left) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i b = _mm256_loadu_si256((const __m256i*)row);
+    const __m256i pairs = _mm256_add_epi16(
+        _mm256_maddubs_epi16(_mm256_and_si256(b, mask), _mm256_loadu_si256((const __m256i*)left)),
+        _mm256_maddubs_epi16(_mm256_and_si256(_mm256_srli_epi16(b, 4), mask), _mm256_loadu_si256((const __m256i*)(left + 32)))
+    );
+    return _mm512_add_epi32(sum, _mm512_zextsi256_si512(_mm256_madd_epi16(pairs, _mm256_set1_epi16(1))));
+}
+
+void TNibbleProductAvx512::MultiDotProduct(
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    const TNibbleQuery query(a, dim);
+    std::vector<int8_t> lowLeft;
+    std::vector<int8_t> highLeft;
+    query.SplitPairs(lowLeft, highLeft);
+    const size_t blocks = query.Values.size() / TNibbleRows::BlockDims;
+    const size_t bodyBytes = blocks / 2 * 2 * TNibbleRows::BlockBytes;
+    const int8_t* lastLeft = query.Values.data() + (blocks - 1) * TNibbleRows::BlockDims;
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    const __m512i ones = _mm512_set1_epi16(1);
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t BytesInVec = sizeof(__m512i);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512i sum0 = _mm512_setzero_si512();
+        __m512i sum1 = _mm512_setzero_si512();
+        __m512i sum2 = _mm512_setzero_si512();
+        __m512i sum3 = _mm512_setzero_si512();
+
+        const uint8_t* r0 = TNibbleRows::Row(allB, dim, elemsIds[e + 0]);
+        const uint8_t* r1 = TNibbleRows::Row(allB, dim, elemsIds[e + 1]);
+        const uint8_t* r2 = TNibbleRows::Row(allB, dim, elemsIds[e + 2]);
+        const uint8_t* r3 = TNibbleRows::Row(allB, dim, elemsIds[e + 3]);
+        const uint8_t* e0 = TNibbleRows::Nibbles(r0);
+        const uint8_t* e1 = TNibbleRows::Nibbles(r1);
+        const uint8_t* e2 = TNibbleRows::Nibbles(r2);
+        const uint8_t* e3 = TNibbleRows::Nibbles(r3);
+
+        for(size_t position = 0; position < bodyBytes; position += BytesInVec) {
+            __m512i low = _mm512_loadu_si512(lowLeft.data() + position);
+            __m512i high = _mm512_loadu_si512(highLeft.data() + position);
+            sum0 = NibbleStep(sum0, _mm512_loadu_si512(e0 + position), low, high, mask, ones);
+            sum1 = NibbleStep(sum1, _mm512_loadu_si512(e1 + position), low, high, mask, ones);
+            sum2 = NibbleStep(sum2, _mm512_loadu_si512(e2 + position), low, high, mask, ones);
+            sum3 = NibbleStep(sum3, _mm512_loadu_si512(e3 + position), low, high, mask, ones);
+        }
+        if (blocks % 2) {
+            sum0 = NibbleLastBlock(sum0, e0 + bodyBytes, lastLeft);
+            sum1 = NibbleLastBlock(sum1, e1 + bodyBytes, lastLeft);
+            sum2 = NibbleLastBlock(sum2, e2 + bodyBytes, lastLeft);
+            sum3 = NibbleLastBlock(sum3, e3 + bodyBytes, lastLeft);
+        }
+
+        results[e + 0] = query.Finish(r0, _mm512_reduce_add_epi32(sum0), bias, coeff);
+        results[e + 1] = query.Finish(r1, _mm512_reduce_add_epi32(sum1), bias, coeff);
+        results[e + 2] = query.Finish(r2, _mm512_reduce_add_epi32(sum2), bias, coeff);
+        results[e + 3] = query.Finish(r3, _mm512_reduce_add_epi32(sum3), bias, coeff);
+    }
+    for(; e < elemsNum; e += 1) {
+        __m512i sum0 = _mm512_setzero_si512();
+        const uint8_t* r0 = TNibbleRows::Row(allB, dim, elemsIds[e]);
+        const uint8_t* e0 = TNibbleRows::Nibbles(r0);
+        for(size_t position = 0; position < bodyBytes; position += BytesInVec) {
+            __m512i low = _mm512_loadu_si512(lowLeft.data() + position);
+            __m512i high = _mm512_loadu_si512(highLeft.data() + position);
+            sum0 = NibbleStep(sum0, _mm512_loadu_si512(e0 + position), low, high, mask, ones);
+        }
+        if (blocks % 2) {
+            sum0 = NibbleLastBlock(sum0, e0 + bodyBytes, lastLeft);
+        }
+        results[e] = query.Finish(r0, _mm512_reduce_add_epi32(sum0), bias, coeff);
+    }
+}
+
+void TRowScaledProductAvx512ASM::MultiDotProduct(
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    float aa = 0;
+    for(size_t i = 0; i < dim; i += 1) {
+        aa += a[i];
+    }
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask16 tail = TailMask16(dim - bodyDim);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps();
+        __m512 sum3 = _mm512_setzero_ps();
+
+        const uint8_t* r0 = TScaledRows::Row(allB, dim, elemsIds[e + 0]);
+        const uint8_t* r1 = TScaledRows::Row(allB, dim, elemsIds[e + 1]);
+        const uint8_t* r2 = TScaledRows::Row(allB, dim, elemsIds[e + 2]);
+        const uint8_t* r3 = TScaledRows::Row(allB, dim, elemsIds[e + 3]);
+        const uint8_t* e0 = TScaledRows::Bytes(r0);
+        const uint8_t* e1 = TScaledRows::Bytes(r1);
+        const uint8_t* e2 = TScaledRows::Bytes(r2);
+        const uint8_t* e3 = TScaledRows::Bytes(r3);
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            FmaddRows(
+                _mm512_loadu_ps(a + position),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e0 + position))),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e1 + position))),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e2 + position))),
+                WidenU8(_mm_loadu_si128((const __m128i*)(e3 + position))),
+                sum0, sum1, sum2, sum3
+            );
+        }
+        if (bodyDim < dim) {
+            FmaddRows(
+                _mm512_maskz_loadu_ps(tail, a + bodyDim),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e0 + bodyDim)),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e1 + bodyDim)),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e2 + bodyDim)),
+                WidenU8(_mm_maskz_loadu_epi8(tail, e3 + bodyDim)),
+                sum0, sum1, sum2, sum3
+            );
+        }
+
+        results[e + 0] = TScaledRows::Scale(r0) * _mm512_reduce_add_ps(sum0) + TScaledRows::Offset(r0) * aa;
+        results[e + 1] = TScaledRows::Scale(r1) * _mm512_reduce_add_ps(sum1) + TScaledRows::Offset(r1) * aa;
+        results[e + 2] = TScaledRows::Scale(r2) * _mm512_reduce_add_ps(sum2) + TScaledRows::Offset(r2) * aa;
+        results[e + 3] = TScaledRows::Scale(r3) * _mm512_reduce_add_ps(sum3) + TScaledRows::Offset(r3) * aa;
+    }
+    for(; e < elemsNum; e += 1) {
+        __m512 sum0 = _mm512_setzero_ps();
+        const uint8_t* r0 = TScaledRows::Row(allB, dim, elemsIds[e]);
+        const uint8_t* e0 = TScaledRows::Bytes(r0);
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + position), WidenU8(_mm_loadu_si128((const __m128i*)(e0 + position))), sum0);
+        }
+        if (bodyDim < dim) {
+            sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, a + bodyDim), WidenU8(_mm_maskz_loadu_epi8(tail, e0 + bodyDim)), sum0);
+        }
+        results[e] = TScaledRows::Scale(r0) * _mm512_reduce_add_ps(sum0) + TScaledRows::Offset(r0) * aa;
+    }
+}
+
+// see PqLookupDwords in avx2_impls.cpp, the mask and the or are one vpternlogd
+static inline __m512i PqLookupDwords(__m512i table, __m512i codes, int s) {
+    const __m512i index = _mm512_ternarylogic_epi32(
+        _mm512_srl_epi32(codes, _mm_cvtsi32_si128(4 * s)), _mm512_set1_epi32(0x0f), _mm512_set1_epi32(int(0x80808000)), 0xea
+    );
+    return _mm512_shuffle_epi8(table, index);
+}
+
+void TPqProductAvx512::MultiDotProduct(
+    const TPqLookup& lookup,
+    const uint8_t* codes,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    const __m512 delta = _mm512_set1_ps(lookup.Delta);
+    const __m512 bias = _mm512_set1_ps(lookup.Bias);
+    const __m512i codeBytes = _mm512_set1_epi64(lookup.CodeBytes);
+    const uint8_t* tables = lookup.Quantized.data();
+
+    size_t e = 0;
+    constexpr size_t Step = 16;
+    for(; e + Step <= elemsNum; e += Step) {
+        const __m512i offsets0 = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)(elemsIds + e))), codeBytes);
+        const __m512i offsets1 = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)(elemsIds + e + 8))), codeBytes);
+        __m512i sum = _mm512_setzero_si512();
+        for(size_t dword = 0; dword < lookup.CodeBytes; dword += sizeof(int32_t)) {
+            const int* base = (const int*)(codes + dword);
+            const __m512i gathered = _mm512_inserti64x4(
+                _mm512_castsi256_si512(_mm512_i64gather_epi32(offsets0, base, 1)),
+                _mm512_i64gather_epi32(offsets1, base, 1),
+                1
+            );
+            const uint8_t* table = tables + dword * 2 * TPqCodebook::Centroids;
+            for(int s = 0; s < 8; s += 1) {
+                const __m512i t = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(table + s * TPqCodebook::Centroids)));
+                sum = _mm512_add_epi32(sum, PqLookupDwords(t, gathered, s));
+            }
+        }
+        _mm512_storeu_ps(results + e, _mm512_fmadd_ps(_mm512_cvtepi32_ps(sum), delta, bias));
+    }
+    for(; e < elemsNum; e += 1) {
+        results[e] = lookup.QuantizedScore(codes + lookup.CodeBytes * elemsIds[e]);
+    }
+}
+
+static inline __m512i AddLanesU8(__m512i sum, __m512i bytes) {
+    return _mm512_add_epi16(sum, _mm512_add_epi16(
+        _mm512_cvtepu8_epi16(_mm512_castsi512_si256(bytes)),
+        _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(bytes, 1))
+    ));
+}
+
+// sums has the rows in both halves, for two different subspaces
+static inline void StorePqRows(float* results, __m512i sums, __m512 delta, __m512 bias) {
+    const __m256i rows = _mm256_add_epi16(_mm512_castsi512_si256(sums), _mm512_extracti64x4_epi64(sums, 1));
+    _mm512_storeu_ps(results, _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(rows)), delta, bias));
+}
+
+void TPqProductAvx512::FullScan(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results) {
+    const __m512 delta = _mm512_set1_ps(lookup.Delta);
+    const __m512 bias = _mm512_set1_ps(lookup.Bias);
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    const size_t subspaces = lookup.Subspaces;
+    const uint8_t* tables = lookup.Quantized.data();
+    const size_t blockBytes = subspaces * 16;
+
+    alignas(64) float tail[PqBlockRows];
+    for(size_t row = 0; row < rowsNum; row += PqBlockRows) {
+        const uint8_t* block = blocks + row / PqBlockRows * blockBytes;
+        __m512i sum0 = _mm512_setzero_si512();
+        __m512i sum1 = _mm512_setzero_si512();
+        // four subspaces per load, one per lane
+        for(size_t m = 0; m < subspaces; m += 4) {
+            const __m512i codes = _mm512_loadu_si512(block + m * 16);
+            const __m512i table = _mm512_loadu_si512(tables + m * TPqCodebook::Centroids);
+            sum0 = AddLanesU8(sum0, _mm512_shuffle_epi8(table, _mm512_and_si512(codes, mask)));
+            sum1 = AddLanesU8(sum1, _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(codes, 4), mask)));
+        }
+        float* out = row + PqBlockRows <= rowsNum ? results + row : tail;
+        StorePqRows(out, sum0, delta, bias);
+        StorePqRows(out + 16, sum1, delta, bias);
+        if (out == tail) {
+            std::copy(tail, tail + rowsNum - row, results + row);
+        }
+    }
+}
+
+void TBinaryProductAvx512::MultiDotProduct(
+    const float* a,
+    const uint64_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    const size_t rowWords = TBinaryRows::RowWords(dim);
+    const size_t paddedDim = rowWords * TBinaryRows::WordDims;
+    // the padding bits are zero, the query only has to be readable up to them
+    std::vector<float> left(a, a + dim);
+    left.resize(paddedDim, 0.f);
+    float aa = 0;
+    for(size_t i = 0; i < dim; i += 1) {
+        aa += a[i];
+    }
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(float));
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps();
+        __m512 sum3 = _mm512_setzero_ps();
+
+        const uint64_t* e0 = allB + rowWords * elemsIds[e + 0];
+        const uint64_t* e1 = allB + rowWords * elemsIds[e + 1];
+        const uint64_t* e2 = allB + rowWords * elemsIds[e + 2];
+        const uint64_t* e3 = allB + rowWords * elemsIds[e + 3];
+
+        for(size_t position = 0; position < paddedDim; position += ElemsInVec) {
+            const size_t word = position / TBinaryRows::WordDims;
+            const size_t shift = position % TBinaryRows::WordDims;
+            __m512 l = _mm512_loadu_ps(left.data() + position);
+            sum0 = _mm512_mask_add_ps(sum0, __mmask16(e0[word] >> shift), sum0, l);
+            sum1 = _mm512_mask_add_ps(sum1, __mmask16(e1[word] >> shift), sum1, l);
+            sum2 = _mm512_mask_add_ps(sum2, __mmask16(e2[word] >> shift), sum2, l);
+            sum3 = _mm512_mask_add_ps(sum3, __mmask16(e3[word] >> shift), sum3, l);
+        }
+
+        StoreReduced(results + e, sum0, sum1, sum2, sum3, 2.f, -aa);
+    }
+
+    TBinaryProductNaive::MultiDotProduct(a, allB, dim, elemsIds + e, elemsNum - e, results + e);
+}
+
+// vmovntdqa wants 64 byte aligned data, every dim of a TInterleavedMatrix block is
+template<bool Stream>
+static inline __m512 LoadScanLine(const float* p) {
+    if constexpr (Stream) {
+        return _mm512_castsi512_ps(_mm512_stream_load_si512((void*)p));
+    } else {
+        return _mm512_loadu_ps(p);
+    }
+}
+
+template<bool Stream, size_t Distance>
+static void InterleavedScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results) {
+    constexpr size_t Phases = 8;
+    const size_t bodyDim = dim - dim % Phases;
+    const size_t ahead = Distance * dim * ScanBlockRows;
+    for(size_t row = 0; row < rowsNum; row += ScanBlockRows) {
+        const float* block = blocks + row * dim;
+        __m512 sums[Phases];
+        for(size_t p = 0; p < Phases; p += 1) {
+            sums[p] = _mm512_setzero_ps();
+        }
+        for(size_t i = 0; i < bodyDim; i += Phases) {
+            for(size_t p = 0; p < Phases; p += 1) { //unroll by constexpr size
+                const float* values = block + (i + p) * ScanBlockRows;
+                if constexpr (Stream) {
+                    // a dim is a line, the same line of the block Distance ahead; prefetches never fault past the end
+                    _mm_prefetch((const char*)(values + ahead), _MM_HINT_NTA);
+                }
+                sums[p] = _mm512_fmadd_ps(_mm512_set1_ps(a[i + p]), LoadScanLine<Stream>(values), sums[p]);
+            }
+        }
+        for(size_t i = bodyDim; i < dim; i += 1) {
+            const float* values = block + i * ScanBlockRows;
+            if constexpr (Stream) {
+                _mm_prefetch((const char*)(values + ahead), _MM_HINT_NTA);
+            }
+            sums[0] = _mm512_fmadd_ps(_mm512_set1_ps(a[i]), LoadScanLine<Stream>(values), sums[0]);
+        }
+        for(size_t half = Phases / 2; half > 0; half /= 2) {
+            for(size_t p = 0; p < half; p += 1) {
+                sums[p] = _mm512_add_ps(sums[p], sums[p + half]);
+            }
+        }
+        _mm512_mask_storeu_ps(results + row, TailMask16(std::min(ScanBlockRows, rowsNum - row)), sums[0]);
+    }
+}
+
+void TInterleavedScanAvx512::FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results) {
+    InterleavedScan<false, 0>(a, blocks, dim, rowsNum, results);
+}
+
+void TInterleavedScanStreamAvx512::FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results) {
+    InterleavedScan<true, Distance>(a, blocks, dim, rowsNum, results);
+}
+
+uint64_t TFmaPeakAvx512::Run(size_t iterations, float* sink) {
+    // two fma ports of 4 cycles latency need 8 chains in flight, 12 leave slack
+    constexpr size_t Chains = 12;
+    __m512 acc[Chains];
+    for(size_t i = 0; i < Chains; i += 1) {
+        acc[i] = _mm512_set1_ps(float(i));
+    }
+    const __m512 mul = _mm512_set1_ps(0.999f);
+    const __m512 add = _mm512_set1_ps(0.001f);
+    for(size_t it = 0; it < iterations; it += 1) {
+#pragma GCC unroll 12
+        for(size_t i = 0; i < Chains; i += 1) {
+            acc[i] = _mm512_fmadd_ps(acc[i], mul, add);
+        }
+    }
+    for(size_t i = 1; i < Chains; i += 1) {
+        acc[0] = _mm512_add_ps(acc[0], acc[i]);
+    }
+    _mm512_storeu_ps(sink, acc[0]);
+    return uint64_t(iterations) * Chains * 16 * 2;
+}
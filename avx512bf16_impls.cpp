@@ -0,0 +1,84 @@
+#include "halfdot.h"
+
+#include <immintrin.h>
+
+static inline __mmask32 TailMask32(size_t rest) {
+    return _cvtu32_mask32(uint32_t((uint64_t(1) << rest) - 1u));
+}
+
+// query rounded to bf16 and zero padded to 32, so its masked tail needs no mask
+static inline std::vector<uint16_t> Bf16Query(const float* a, size_t dim) {
+    std::vector<uint16_t> query((dim + 31) / 32 * 32, 0);
+    for(size_t i = 0; i < dim; i += 1) {
+        query[i] = FloatToBf16(a[i]);
+    }
+    return query;
+}
+
+static inline __m512bh LoadBf16(const uint16_t* p) {
+    return (__m512bh)_mm512_loadu_si512(p);
+}
+
+static inline __m512bh LoadBf16Masked(__mmask32 mask, const uint16_t* p) {
+    return (__m512bh)_mm512_maskz_loadu_epi16(mask, p);
+}
+
+void TBf16ProductAvx512Bf16ASM::MultiDotProduct(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    const std::vector<uint16_t> query = Bf16Query(a, dim);
+    const uint16_t* q = query.data();
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512) / sizeof(uint16_t));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask32 tail = TailMask32(dim - bodyDim);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps();
+        __m512 sum3 = _mm512_setzero_ps();
+
+        const uint16_t* e0 = allB + dim * elemsIds[e + 0];
+        const uint16_t* e1 = allB + dim * elemsIds[e + 1];
+        const uint16_t* e2 = allB + dim * elemsIds[e + 2];
+        const uint16_t* e3 = allB + dim * elemsIds[e + 3];
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m512bh left = LoadBf16(q + position);
+            sum0 = _mm512_dpbf16_ps(sum0, left, LoadBf16(e0 + position));
+            sum1 = _mm512_dpbf16_ps(sum1, left, LoadBf16(e1 + position));
+            sum2 = _mm512_dpbf16_ps(sum2, left, LoadBf16(e2 + position));
+            sum3 = _mm512_dpbf16_ps(sum3, left, LoadBf16(e3 + position));
+        }
+        if (bodyDim < dim) {
+            __m512bh left = LoadBf16(q + bodyDim);
+            sum0 = _mm512_dpbf16_ps(sum0, left, LoadBf16Masked(tail, e0 + bodyDim));
+            sum1 = _mm512_dpbf16_ps(sum1, left, LoadBf16Masked(tail, e1 + bodyDim));
+            sum2 = _mm512_dpbf16_ps(sum2, left, LoadBf16Masked(tail, e2 + bodyDim));
+            sum3 = _mm512_dpbf16_ps(sum3, left, LoadBf16Masked(tail, e3 + bodyDim));
+        }
+
+        results[e + 0] = _mm512_reduce_add_ps(sum0);
+        results[e + 1] = _mm512_reduce_add_ps(sum1);
+        results[e + 2] = _mm512_reduce_add_ps(sum2);
+        results[e + 3] = _mm512_reduce_add_ps(sum3);
+    }
+    for(; e < elemsNum; e += 1) {
+        const uint16_t* e0 = allB + dim * elemsIds[e];
+        __m512 sum0 = _mm512_setzero_ps();
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            sum0 = _mm512_dpbf16_ps(sum0, LoadBf16(q + position), LoadBf16(e0 + position));
+        }
+        if (bodyDim < dim) {
+            sum0 = _mm512_dpbf16_ps(sum0, LoadBf16(q + bodyDim), LoadBf16Masked(tail, e0 + bodyDim));
+        }
+        results[e] = _mm512_reduce_add_ps(sum0);
+    }
+}
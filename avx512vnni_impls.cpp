@@ -0,0 +1,157 @@
+#include "dot_product.h"
+#include "dotpacked.h"
+#include "dotnibble.h"
+
+#include <immintrin.h>
+
+void TPackedProductAvx512VnniASM::MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+    const TInt8Query query(a, dim);
+    const int8_t* left = query.Values.data();
+    const float scale = query.Scale * coeff;
+    const float bb = query.Bias(bias, coeff);
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t ElemsInVec = (sizeof(__m512i) / sizeof(uint8_t));
+    const size_t bodyDim = dim - dim % ElemsInVec;
+    const __mmask64 tail = _cvtu64_mask64((uint64_t(1) << (dim - bodyDim)) - 1u);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512i sum0 = _mm512_setzero_si512();
+        __m512i sum1 = _mm512_setzero_si512();
+        __m512i sum2 = _mm512_setzero_si512();
+        __m512i sum3 = _mm512_setzero_si512();
+
+        const uint8_t* e0 = allB + dim * elemsIds[e + 0];
+        const uint8_t* e1 = allB + dim * elemsIds[e + 1];
+        const uint8_t* e2 = allB + dim * elemsIds[e + 2];
+        const uint8_t* e3 = allB + dim * elemsIds[e + 3];
+
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            __m512i l = _mm512_loadu_si512(left + position);
+            sum0 = _mm512_dpbusd_epi32(sum0, _mm512_loadu_si512(e0 + position), l);
+            sum1 = _mm512_dpbusd_epi32(sum1, _mm512_loadu_si512(e1 + position), l);
+            sum2 = _mm512_dpbusd_epi32(sum2, _mm512_loadu_si512(e2 + position), l);
+            sum3 = _mm512_dpbusd_epi32(sum3, _mm512_loadu_si512(e3 + position), l);
+        }
+        if (bodyDim < dim) {
+            // query is zero padded, rows must not be read past dim
+            __m512i l = _mm512_loadu_si512(left + bodyDim);
+            sum0 = _mm512_dpbusd_epi32(sum0, _mm512_maskz_loadu_epi8(tail, e0 + bodyDim), l);
+            sum1 = _mm512_dpbusd_epi32(sum1, _mm512_maskz_loadu_epi8(tail, e1 + bodyDim), l);
+            sum2 = _mm512_dpbusd_epi32(sum2, _mm512_maskz_loadu_epi8(tail, e2 + bodyDim), l);
+            sum3 = _mm512_dpbusd_epi32(sum3, _mm512_maskz_loadu_epi8(tail, e3 + bodyDim), l);
+        }
+
+        results[e + 0] = _mm512_reduce_add_epi32(sum0) * scale + bb;
+        results[e + 1] = _mm512_reduce_add_epi32(sum1) * scale + bb;
+        results[e + 2] = _mm512_reduce_add_epi32(sum2) * scale + bb;
+        results[e + 3] = _mm512_reduce_add_epi32(sum3) * scale + bb;
+    }
+    for(; e < elemsNum; e += 1) {
+        __m512i sum0 = _mm512_setzero_si512();
+        const uint8_t* e0 = allB + dim * elemsIds[e];
+        for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+            sum0 = _mm512_dpbusd_epi32(sum0, _mm512_loadu_si512(e0 + position), _mm512_loadu_si512(left + position));
+        }
+        if (bodyDim < dim) {
+            sum0 = _mm512_dpbusd_epi32(sum0, _mm512_maskz_loadu_epi8(tail, e0 + bodyDim), _mm512_loadu_si512(left + bodyDim));
+        }
+        results[e] = _mm512_reduce_add_epi32(sum0) * scale + bb;
+    }
+}
+
+static inline __m512i NibbleStep(__m512i sum, __m512i row, __m512i low, __m512i high, __m512i mask) {
+    sum = _mm512_dpbusd_epi32(sum, _mm512_and_si512(row, mask), low);
+    return _mm512_dpbusd_epi32(sum, _mm512_and_si512(_mm512_srli_epi16(row, 4), mask), high);
+}
+
+static inline __m512i NibbleLastBlock(__m512i sum, const uint8_t* row, const int8_t* left) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i b = _mm256_loadu_si256((const __m256i*)row);
+    __m256i half = _mm256_dpbusd_epi32(_mm256_setzero_si256(), _mm256_and_si256(b, mask), _mm256_loadu_si256((const __m256i*)left));
+    half = _mm256_dpbusd_epi32(half, _mm256_and_si256(_mm256_srli_epi16(b, 4), mask), _mm256_loadu_si256((const __m256i*)(left + 32)));
+    return _mm512_add_epi32(sum, _mm512_zextsi256_si512(half));
+}
+
+void TNibbleProductAvx512Vnni::MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+    const TNibbleQuery query(a, dim);
+    std::vector<int8_t> lowLeft;
+    std::vector<int8_t> highLeft;
+    query.SplitPairs(lowLeft, highLeft);
+    const size_t blocks = query.Values.size() / TNibbleRows::BlockDims;
+    const size_t bodyBytes = blocks / 2 * 2 * TNibbleRows::BlockBytes;
+    const int8_t* lastLeft = query.Values.data() + (blocks - 1) * TNibbleRows::BlockDims;
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    constexpr size_t BytesInVec = sizeof(__m512i);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512i sum0 = _mm512_setzero_si512();
+        __m512i sum1 = _mm512_setzero_si512();
+        __m512i sum2 = _mm512_setzero_si512();
+        __m512i sum3 = _mm512_setzero_si512();
+
+        const uint8_t* r0 = TNibbleRows::Row(allB, dim, elemsIds[e + 0]);
+        const uint8_t* r1 = TNibbleRows::Row(allB, dim, elemsIds[e + 1]);
+        const uint8_t* r2 = TNibbleRows::Row(allB, dim, elemsIds[e + 2]);
+        const uint8_t* r3 = TNibbleRows::Row(allB, dim, elemsIds[e + 3]);
+        const uint8_t* e0 = TNibbleRows::Nibbles(r0);
+        const uint8_t* e1 = TNibbleRows::Nibbles(r1);
+        const uint8_t* e2 = TNibbleRows::Nibbles(r2);
+        const uint8_t* e3 = TNibbleRows::Nibbles(r3);
+
+        for(size_t position = 0; position < bodyBytes; position += BytesInVec) {
+            __m512i low = _mm512_loadu_si512(lowLeft.data() + position);
+            __m512i high = _mm512_loadu_si512(highLeft.data() + position);
+            sum0 = NibbleStep(sum0, _mm512_loadu_si512(e0 + position), low, high, mask);
+            sum1 = NibbleStep(sum1, _mm512_loadu_si512(e1 + position), low, high, mask);
+            sum2 = NibbleStep(sum2, _mm512_loadu_si512(e2 + position), low, high, mask);
+            sum3 = NibbleStep(sum3, _mm512_loadu_si512(e3 + position), low, high, mask);
+        }
+        if (blocks % 2) {
+            sum0 = NibbleLastBlock(sum0, e0 + bodyBytes, lastLeft);
+            sum1 = NibbleLastBlock(sum1, e1 + bodyBytes, lastLeft);
+            sum2 = NibbleLastBlock(sum2, e2 + bodyBytes, lastLeft);
+            sum3 = NibbleLastBlock(sum3, e3 + bodyBytes, lastLeft);
+        }
+
+        results[e + 0] = query.Finish(r0, _mm512_reduce_add_epi32(sum0), bias, coeff);
+        results[e + 1] = query.Finish(r1, _mm512_reduce_add_epi32(sum1), bias, coeff);
+        results[e + 2] = query.Finish(r2, _mm512_reduce_add_epi32(sum2), bias, coeff);
+        results[e + 3] = query.Finish(r3, _mm512_reduce_add_epi32(sum3), bias, coeff);
+    }
+    for(; e < elemsNum; e += 1) {
+        __m512i sum0 = _mm512_setzero_si512();
+        const uint8_t* r0 = TNibbleRows::Row(allB, dim, elemsIds[e]);
+        const uint8_t* e0 = TNibbleRows::Nibbles(r0);
+        for(size_t position = 0; position < bodyBytes; position += BytesInVec) {
+            sum0 = NibbleStep(
+                sum0, _mm512_loadu_si512(e0 + position),
+                _mm512_loadu_si512(lowLeft.data() + position), _mm512_loadu_si512(highLeft.data() + position), mask
+            );
+        }
+        if (blocks % 2) {
+            sum0 = NibbleLastBlock(sum0, e0 + bodyBytes, lastLeft);
+        }
+        results[e] = query.Finish(r0, _mm512_reduce_add_epi32(sum0), bias, coeff);
+    }
+}
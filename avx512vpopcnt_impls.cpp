@@ -0,0 +1,71 @@
+#include "dot_product.h"
+#include "dotbinary.h"
+
+#include <immintrin.h>
+
+static inline __m512i HammingStep(__m512i sum, __m512i row, __m512i query) {
+    return _mm512_add_epi64(sum, _mm512_popcnt_epi64(_mm512_xor_si512(row, query)));
+}
+
+void THammingProductAvx512Vpopcnt::MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+    const size_t rowWords = TBinaryRows::RowWords(dim);
+    constexpr size_t WordsInVec = (sizeof(__m512i) / sizeof(uint64_t));
+    std::vector<uint64_t> query((rowWords + WordsInVec - 1) / WordsInVec * WordsInVec);
+    TBinaryRows::PackRow(a, dim, query.data());
+    const uint64_t* right = query.data();
+
+    size_t e = 0;
+    constexpr size_t Step = 4;
+    const size_t bodyWords = rowWords - rowWords % WordsInVec;
+    const __mmask8 tail = _cvtu32_mask8((1u << (rowWords - bodyWords)) - 1u);
+    for(; e + Step <= elemsNum; e += Step) {
+        __m512i sum0 = _mm512_setzero_si512();
+        __m512i sum1 = _mm512_setzero_si512();
+        __m512i sum2 = _mm512_setzero_si512();
+        __m512i sum3 = _mm512_setzero_si512();
+
+        const uint64_t* e0 = allB + rowWords * elemsIds[e + 0];
+        const uint64_t* e1 = allB + rowWords * elemsIds[e + 1];
+        const uint64_t* e2 = allB + rowWords * elemsIds[e + 2];
+        const uint64_t* e3 = allB + rowWords * elemsIds[e + 3];
+
+        for(size_t position = 0; position < bodyWords; position += WordsInVec) {
+            __m512i q = _mm512_loadu_si512(right + position);
+            sum0 = HammingStep(sum0, _mm512_loadu_si512(e0 + position), q);
+            sum1 = HammingStep(sum1, _mm512_loadu_si512(e1 + position), q);
+            sum2 = HammingStep(sum2, _mm512_loadu_si512(e2 + position), q);
+            sum3 = HammingStep(sum3, _mm512_loadu_si512(e3 + position), q);
+        }
+        if (bodyWords < rowWords) {
+            // masked off words are zero in the row and in the padded query
+            __m512i q = _mm512_loadu_si512(right + bodyWords);
+            sum0 = HammingStep(sum0, _mm512_maskz_loadu_epi64(tail, e0 + bodyWords), q);
+            sum1 = HammingStep(sum1, _mm512_maskz_loadu_epi64(tail, e1 + bodyWords), q);
+            sum2 = HammingStep(sum2, _mm512_maskz_loadu_epi64(tail, e2 + bodyWords), q);
+            sum3 = HammingStep(sum3, _mm512_maskz_loadu_epi64(tail, e3 + bodyWords), q);
+        }
+
+        results[e + 0] = float(dim) - 2.f * _mm512_reduce_add_epi64(sum0);
+        results[e + 1] = float(dim) - 2.f * _mm512_reduce_add_epi64(sum1);
+        results[e + 2] = float(dim) - 2.f * _mm512_reduce_add_epi64(sum2);
+        results[e + 3] = float(dim) - 2.f * _mm512_reduce_add_epi64(sum3);
+    }
+    for(; e < elemsNum; e += 1) {
+        __m512i sum0 = _mm512_setzero_si512();
+        const uint64_t* e0 = allB + rowWords * elemsIds[e];
+        for(size_t position = 0; position < bodyWords; position += WordsInVec) {
+            sum0 = HammingStep(sum0, _mm512_loadu_si512(e0 + position), _mm512_loadu_si512(right + position));
+        }
+        if (bodyWords < rowWords) {
+            sum0 = HammingStep(sum0, _mm512_maskz_loadu_epi64(tail, e0 + bodyWords), _mm512_loadu_si512(right + bodyWords));
+        }
+        results[e] = float(dim) - 2.f * _mm512_reduce_add_epi64(sum0);
+    }
+}
@@ -1,5 +1,8 @@
 #include "dot_product.h"
 #include "multidot.h"
+#include "dotpacked.h"
+#include "fixed_dim_impl.h"
+#include "distance_impl.h"
 
 float TNaiveAvxAuto::DotProduct(const float* a, const float* b, size_t dim) {
     return TNaive::DotProduct(a, b, dim);
@@ -33,6 +36,12 @@ DeclByStep(14)
 DeclByStep(15)
 DeclByStep(16)
 
+#define DeclFixedDim(Dim) DeclFixedDimByIsa(AVX, Dim)
+
+ForEachFixedDim(DeclFixedDim)
+
+DeclDistanceByIsa(AVX)
+
 
 void TMultiDotCTStepV3FloatOpts_AVX::MultiDotProduct(
     const float* a,
@@ -44,3 +53,32 @@ void TMultiDotCTStepV3FloatOpts_AVX::MultiDotProduct(
 ) {
     TMultiDotCTStepV3::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, results);
 }
+
+void TMultiQueryFloatOpts_AVX::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    TMultiQueryCTStep<4, 2>::MultiQueryDotProduct(queries, queriesNum, allB, dim, elemsIds, elemsNum, results);
+}
+
+void TPackedMultiQueryOpts_AVX::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    TPackedMultiQueryCTStep<4, 2>::MultiQueryDotProduct(
+        queries, queriesNum, allB, dim, elemsIds, elemsNum, bias, coeff, results
+    );
+}
+
@@ -0,0 +1,134 @@
+#pragma once
+
+// bodies of the dotdistance.h kernels on the vectors of fixed_dim_impl.h, with the same rules: only isa files
+// include this and each of them gets its own copy. The dim is a runtime value here, whole vectors go through
+// TFixedVec and the last dim % 16 values are a scalar tail
+
+#include "dotdistance.h"
+#include "fixed_dim_impl.h"
+
+namespace {
+    template<class TElem>
+    inline float DistanceTail(const float* a, const TElem* b, size_t begin, size_t dim) {
+        float res = 0;
+        for(size_t i = begin; i < dim; i += 1) {
+            res += a[i] * float(b[i]);
+        }
+        return res;
+    }
+
+    // finish(dot, row id) is the epilogue of the family, it is applied to a row right after its sum
+    template<class TElem, class TFinish>
+    inline void DistanceMultiDotProduct(
+        const float* a,
+        const TElem* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results,
+        TFinish finish
+    ) {
+        const size_t bodyDim = dim - dim % FixedVecFloats;
+        TFixedVec left;
+        TFixedVec right;
+        size_t e = 0;
+        for(; e + FixedRowsStep <= elemsNum; e += FixedRowsStep) {
+            const TElem* r0 = allB + dim * elemsIds[e + 0];
+            const TElem* r1 = allB + dim * elemsIds[e + 1];
+            const TElem* r2 = allB + dim * elemsIds[e + 2];
+            const TElem* r3 = allB + dim * elemsIds[e + 3];
+            TFixedVec s0 = {};
+            TFixedVec s1 = {};
+            TFixedVec s2 = {};
+            TFixedVec s3 = {};
+            for(size_t i = 0; i < bodyDim; i += FixedVecFloats) {
+                LoadFixed(left, a + i);
+                LoadFixed(right, r0 + i);
+                s0 += left * right;
+                LoadFixed(right, r1 + i);
+                s1 += left * right;
+                LoadFixed(right, r2 + i);
+                s2 += left * right;
+                LoadFixed(right, r3 + i);
+                s3 += left * right;
+            }
+            results[e + 0] = finish(SumFixed(s0) + DistanceTail(a, r0, bodyDim, dim), elemsIds[e + 0]);
+            results[e + 1] = finish(SumFixed(s1) + DistanceTail(a, r1, bodyDim, dim), elemsIds[e + 1]);
+            results[e + 2] = finish(SumFixed(s2) + DistanceTail(a, r2, bodyDim, dim), elemsIds[e + 2]);
+            results[e + 3] = finish(SumFixed(s3) + DistanceTail(a, r3, bodyDim, dim), elemsIds[e + 3]);
+        }
+        for(; e < elemsNum; e += 1) {
+            const TElem* r0 = allB + dim * elemsIds[e];
+            TFixedVec s0 = {};
+            for(size_t i = 0; i < bodyDim; i += FixedVecFloats) {
+                LoadFixed(left, a + i);
+                LoadFixed(right, r0 + i);
+                s0 += left * right;
+            }
+            results[e] = finish(SumFixed(s0) + DistanceTail(a, r0, bodyDim, dim), elemsIds[e]);
+        }
+    }
+}
+
+// the four kernels of Isa, for the isa files to instantiate
+#define DeclDistanceByIsa(Isa) \
+void TL2MultiDot_##Isa::MultiDotProduct(\
+    const float* a,\
+    const float* allB,\
+    size_t dim,\
+    const float* norms,\
+    const uint32_t* elemsIds,\
+    size_t elemsNum,\
+    float* results\
+) {\
+    const TDistanceQuery query(a, dim);\
+    DistanceMultiDotProduct(a, allB, dim, elemsIds, elemsNum, results, [&](float dot, uint32_t id) {\
+        return query.L2(dot, norms[id]);\
+    });\
+}\
+void TCosineMultiDot_##Isa::MultiDotProduct(\
+    const float* a,\
+    const float* allB,\
+    size_t dim,\
+    const float* norms,\
+    const uint32_t* elemsIds,\
+    size_t elemsNum,\
+    float* results\
+) {\
+    const TDistanceQuery query(a, dim);\
+    DistanceMultiDotProduct(a, allB, dim, elemsIds, elemsNum, results, [&](float dot, uint32_t id) {\
+        return query.Cosine(dot, norms[id]);\
+    });\
+}\
+void TL2Packed_##Isa::MultiDotProduct(\
+    const float* a,\
+    const uint8_t* allB,\
+    size_t dim,\
+    const float* norms,\
+    const uint32_t* elemsIds,\
+    size_t elemsNum,\
+    float bias,\
+    float coeff,\
+    float* results\
+) {\
+    const TDistanceQuery query(a, dim);\
+    DistanceMultiDotProduct(a, allB, dim, elemsIds, elemsNum, results, [&](float dot, uint32_t id) {\
+        return query.L2(query.Packed(dot, bias, coeff), norms[id]);\
+    });\
+}\
+void TCosinePacked_##Isa::MultiDotProduct(\
+    const float* a,\
+    const uint8_t* allB,\
+    size_t dim,\
+    const float* norms,\
+    const uint32_t* elemsIds,\
+    size_t elemsNum,\
+    float bias,\
+    float coeff,\
+    float* results\
+) {\
+    const TDistanceQuery query(a, dim);\
+    DistanceMultiDotProduct(a, allB, dim, elemsIds, elemsNum, results, [&](float dot, uint32_t id) {\
+        return query.Cosine(query.Packed(dot, bias, coeff), norms[id]);\
+    });\
+}
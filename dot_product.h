@@ -1,7 +1,10 @@
 #pragma once
+#include <array>
 #include <vector>
+#include <memory>
 #include <cstring>
 #include <cstdint>
+#include <utility>
 
 struct IDotProduct {
     virtual float VDotProduct(const float* a, const float* b, size_t dim) const  = 0;
@@ -119,7 +122,198 @@ struct TNaiveAvx512ASM {
     static float DotProduct(const float* a, const float* b, size_t dim);
 };
 
+enum class EPrefetchHint {
+    T0,
+    T1,
+    Nta,
+};
+
+// for the gathering kernels: every line of the rows Distance blocks ahead is prefetched during the current block,
+// Distance 0 turns prefetching off
+struct TPrefetchConfig {
+    size_t Distance = 4;
+    EPrefetchHint Hint = EPrefetchHint::T0;
+};
+
+struct TCpuFeatures {
+    bool Sse42 = false;
+    bool Popcnt = false;
+    bool Avx = false;
+    bool Fma = false;
+    bool F16c = false;
+    bool Avx2 = false;
+    bool Avx512F = false;
+    bool Avx512Dq = false;
+    bool Avx512Cd = false;
+    bool Avx512Bw = false;
+    bool Avx512Vl = false;
+    bool Avx512Vnni = false;
+    bool Avx512Bf16 = false;
+    bool Avx512Vpopcntdq = false;
+
+    // XCR0 says the OS saves the register state on context switch,
+    // without it the instructions fault even if cpuid reports them
+    bool OsYmm = false;
+    bool OsZmm = false;
+
+    static TCpuFeatures Detect(); // cpuid + xgetbv, see sse4_impls.cpp
+
+    bool UsableAvx() const {
+        return Avx && OsYmm;
+    }
+    bool UsableAvx2() const {
+        return UsableAvx() && Avx2 && Fma;
+    }
+    // everything avx512_impls.cpp is compiled with
+    bool UsableAvx512() const {
+        return UsableAvx2() && OsZmm && Avx512F && Avx512Dq && Avx512Cd && Avx512Bw && Avx512Vl;
+    }
+    bool UsableAvx512Vnni() const {
+        return UsableAvx512() && Avx512Vnni;
+    }
+    bool UsableAvx512Bf16() const {
+        return UsableAvx512() && Avx512Bf16;
+    }
+    bool UsableAvx512Vpopcntdq() const {
+        return UsableAvx512() && Avx512Vpopcntdq;
+    }
+};
+
+using TDotProductFunc = float (*)(const float* a, const float* b, size_t dim);
+
+using TMultiDotProductFunc = void (*)(
+    const float* a,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+using TPackedMultiDotProductFunc = void (*)(
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+);
+
+using TMultiQueryDotProductFunc = void (*)(
+    const float* queries,
+    size_t queriesNum,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+using TPackedMultiQueryDotProductFunc = void (*)(
+    const float* queries,
+    size_t queriesNum,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+);
+
+// rows of fp16 or bf16, see halfdot.h
+using THalfMultiDotProductFunc = void (*)(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+// uint8 rows with a scale and offset in front of every row, see dotscaled.h
+using TScaledMultiDotProductFunc = void (*)(
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+// product quantization codes, see pq.h
+struct TPqLookup;
+
+using TPqMultiDotProductFunc = void (*)(
+    const TPqLookup& lookup,
+    const uint8_t* codes,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+using TPqFullScanFunc = void (*)(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results);
+
+// rows of sign bits, see dotbinary.h
+using TBinaryMultiDotProductFunc = void (*)(
+    const float* a,
+    const uint64_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+// l2 and cosine over the dot, norms are per row id, see dotdistance.h
+using TDistanceMultiDotProductFunc = void (*)(
+    const float* a,
+    const float* allB,
+    size_t dim,
+    const float* norms,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+);
+
+using TPackedDistanceMultiDotProductFunc = void (*)(
+    const float* a,
+    const uint8_t* allB,
+    size_t dim,
+    const float* norms,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+);
+
+// every row of a layout without ids, results[r] for row r, see fullscan.h
+using TFullScanFunc = void (*)(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results);
+
+// dims every isa also has kernels for with dim a compile time constant, see fixed_dim.h. The only list of them:
+// X(dim) for each, the isa files instantiate their kernels by it and everything else goes from FixedDims
+#define ForEachFixedDim(X) X(64) X(96) X(128) X(256) X(384) X(512) X(768) X(1024)
+
+#define FixedDimsItem(Dim) Dim,
+constexpr size_t FixedDims[] = {ForEachFixedDim(FixedDimsItem)};
+#undef FixedDimsItem
+constexpr size_t FixedDimsNum = sizeof(FixedDims) / sizeof(FixedDims[0]);
+
+// position in FixedDims or -1
+constexpr int FixedDimIndex(size_t dim) {
+    for(size_t i = 0; i < FixedDimsNum; i += 1) {
+        if (FixedDims[i] == dim) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
 struct TRuntimeCpuInfoDispatch {
+    static const TCpuFeatures Features;
+
     static const bool HaveAvx;
     static const bool HaveAvx2;
     static const bool HaveAvx512;
@@ -130,6 +324,55 @@ struct TRuntimeCpuInfoDispatch {
 
     static const uint32_t LevelJump; // HaveAvx + HaveAvx2 + HaveAvx512
     static const std::unique_ptr<const IDotProduct> Fabric;
+
+    // resolved once at load time by level, calls go through the pointer without any branch
+    static const TDotProductFunc DotProductImpl;
+    static const TMultiDotProductFunc MultiDotProductImpl;
+    static const TPackedMultiDotProductFunc PackedMultiDotProductImpl;
+    static const TPackedMultiDotProductFunc QuantizedPackedMultiDotProductImpl; // int8 query when the host has int dot
+    static const TMultiQueryDotProductFunc MultiQueryDotProductImpl;
+    static const TPackedMultiQueryDotProductFunc PackedMultiQueryDotProductImpl;
+    static const THalfMultiDotProductFunc HalfMultiDotProductImpl;
+    static const THalfMultiDotProductFunc Bf16MultiDotProductImpl;
+    static const TPackedMultiDotProductFunc NibbleMultiDotProductImpl; // 4 bit rows, see dotnibble.h
+    static const TScaledMultiDotProductFunc RowScaledMultiDotProductImpl;
+    static const TPqMultiDotProductFunc PqMultiDotProductImpl;
+    static const TPqFullScanFunc PqFullScanImpl;
+    static const TBinaryMultiDotProductFunc BinaryMultiDotProductImpl;
+    static const TBinaryMultiDotProductFunc HammingMultiDotProductImpl;
+    static const TDistanceMultiDotProductFunc L2MultiDotProductImpl;
+    static const TDistanceMultiDotProductFunc CosineMultiDotProductImpl;
+    static const TPackedDistanceMultiDotProductFunc PackedL2MultiDotProductImpl;
+    static const TPackedDistanceMultiDotProductFunc PackedCosineMultiDotProductImpl;
+    static const TFullScanFunc InterleavedScanImpl; // blocks of TInterleavedMatrix
+    // indexed by FixedDimIndex
+    static const std::array<TDotProductFunc, FixedDimsNum> FixedDimDotProductImpls;
+    static const std::array<TMultiDotProductFunc, FixedDimsNum> FixedDimMultiDotProductImpls;
+    static const std::array<TPackedMultiDotProductFunc, FixedDimsNum> FixedDimPackedMultiDotProductImpls;
+
+    static std::unique_ptr<const IDotProduct> MakeFabric(uint32_t level);
+    static TDotProductFunc SelectDotProduct(uint32_t level);
+    static TMultiDotProductFunc SelectMultiDotProduct(uint32_t level);
+    static TPackedMultiDotProductFunc SelectPackedMultiDotProduct(uint32_t level);
+    static TPackedMultiDotProductFunc SelectQuantizedPackedMultiDotProduct(const TCpuFeatures& features, uint32_t level);
+    static TMultiQueryDotProductFunc SelectMultiQueryDotProduct(uint32_t level);
+    static TPackedMultiQueryDotProductFunc SelectPackedMultiQueryDotProduct(uint32_t level);
+    static THalfMultiDotProductFunc SelectHalfMultiDotProduct(const TCpuFeatures& features, uint32_t level);
+    static THalfMultiDotProductFunc SelectBf16MultiDotProduct(const TCpuFeatures& features, uint32_t level);
+    static TPackedMultiDotProductFunc SelectNibbleMultiDotProduct(const TCpuFeatures& features, uint32_t level);
+    static TScaledMultiDotProductFunc SelectRowScaledMultiDotProduct(uint32_t level);
+    static TPqMultiDotProductFunc SelectPqMultiDotProduct(uint32_t level);
+    static TPqFullScanFunc SelectPqFullScan(uint32_t level);
+    static TBinaryMultiDotProductFunc SelectBinaryMultiDotProduct(uint32_t level);
+    static TBinaryMultiDotProductFunc SelectHammingMultiDotProduct(const TCpuFeatures& features, uint32_t level);
+    static TDistanceMultiDotProductFunc SelectL2MultiDotProduct(uint32_t level);
+    static TDistanceMultiDotProductFunc SelectCosineMultiDotProduct(uint32_t level);
+    static TPackedDistanceMultiDotProductFunc SelectPackedL2MultiDotProduct(uint32_t level);
+    static TPackedDistanceMultiDotProductFunc SelectPackedCosineMultiDotProduct(uint32_t level);
+    static TFullScanFunc SelectInterleavedScan(uint32_t level);
+    static std::array<TDotProductFunc, FixedDimsNum> SelectFixedDimDotProducts(uint32_t level);
+    static std::array<TMultiDotProductFunc, FixedDimsNum> SelectFixedDimMultiDotProducts(uint32_t level);
+    static std::array<TPackedMultiDotProductFunc, FixedDimsNum> SelectFixedDimPackedMultiDotProducts(uint32_t level);
 };
 
 struct TDetectOptimistic {
@@ -147,3 +390,10 @@ struct TDetectJump {
 struct TVirtualJump {
     static float DotProduct(const float* a, const float* b, size_t dim);
 };
+
+
+struct TDetectPointer {
+    inline static float DotProduct(const float* a, const float* b, size_t dim) {
+        return TRuntimeCpuInfoDispatch::DotProductImpl(a, b, dim);
+    }
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <algorithm>
+#include <vector>
+
+// 1 bit a dim: bit i of a row is row[i] > 0, dims in uint64 words from the lowest bit, the last word zero padded.
+// Same MultiDotProduct shape as multidot.h with allB of uint64_t addressed by RowWords(dim) * id. The scores are
+// dots with the +-1 signs of the rows, a ranking proxy for the float kernels rather than their values
+struct TBinaryRows {
+    static constexpr size_t WordDims = 64;
+
+    static size_t RowWords(size_t dim) {
+        return (dim + WordDims - 1) / WordDims;
+    }
+
+    static void PackRow(const float* row, size_t dim, uint64_t* out) {
+        std::fill(out, out + RowWords(dim), 0);
+        for(size_t i = 0; i < dim; i += 1) {
+            out[i / WordDims] |= uint64_t(row[i] > 0) << (i % WordDims);
+        }
+    }
+
+    static bool Bit(const uint64_t* row, size_t i) {
+        return (row[i / WordDims] >> (i % WordDims)) & 1;
+    }
+};
+
+inline std::vector<uint64_t> PackSignMatrix(const float* rows, size_t rowsNum, size_t dim) {
+    const size_t rowWords = TBinaryRows::RowWords(dim);
+    std::vector<uint64_t> result(rowsNum * rowWords);
+    for(size_t r = 0; r < rowsNum; r += 1) {
+        TBinaryRows::PackRow(rows + r * dim, dim, result.data() + r * rowWords);
+    }
+    return result;
+}
+
+// asymmetric: float query against the signs, dot(a, s) = 2 * (sum of a over the set bits) - sum(a)
+struct TBinaryProductNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        const size_t rowWords = TBinaryRows::RowWords(dim);
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            const uint64_t* row = allB + rowWords * elemsIds[e];
+            float sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                sum += TBinaryRows::Bit(row, i) ? a[i] : -a[i];
+            }
+            results[e] = sum;
+        }
+    }
+};
+
+// a bit selects the query lanes by a compare against the lane bits, 4 rows x 8 dims per step
+struct TBinaryProductAvx2 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// the row bits are the write mask of vaddps, 4 rows x 16 dims per step
+struct TBinaryProductAvx512 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// symmetric: the query is signed the same way, dot of the signs = dim - 2 * hamming distance
+struct THammingProductNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        const size_t rowWords = TBinaryRows::RowWords(dim);
+        std::vector<uint64_t> query(rowWords);
+        TBinaryRows::PackRow(a, dim, query.data());
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            const uint64_t* row = allB + rowWords * elemsIds[e];
+            size_t distance = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                distance += TBinaryRows::Bit(row, i) != TBinaryRows::Bit(query.data(), i);
+            }
+            results[e] = float(dim) - 2.f * distance;
+        }
+    }
+};
+
+// popcnt per word
+struct THammingProductPopcnt {
+    static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// popcount of nibbles by vpshufb, bytes summed by vpsadbw, 4 rows x 4 words per step
+struct THammingProductAvx2 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// vpopcntq, 4 rows x 8 words per step, needs avx512 vpopcntdq
+struct THammingProductAvx512Vpopcnt {
+    static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TBinaryProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::BinaryMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
+
+struct THammingProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint64_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::HammingMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
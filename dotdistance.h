@@ -0,0 +1,280 @@
+#pragma once
+
+#include "dot_product.h"
+#include "dotpacked.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// squared l2 distance and cosine similarity out of the inner product: |a - b|^2 = |a|^2 + |b|^2 - 2 * dot(a, b)
+// and cos(a, b) = dot(a, b) / (|a| * |b|). The row norms are computed with the matrix, the query ones once per call,
+// so the kernels read every row once for its dot and finish it as TPackedProductInlinedWithMath does with bb
+
+// norms of the rows as the kernels index them, row id at allB + dim * id
+struct TRowNorms {
+    // |b|^2, the norms argument of the l2 kernels
+    std::vector<float> Squared;
+    // 1 / |b|, 0 for a zero row, the norms argument of the cosine kernels
+    std::vector<float> Inverse;
+
+    static TRowNorms Compute(const float* rows, size_t rowsNum, size_t dim) {
+        return ComputeBy(rowsNum, [=](size_t r) {
+            double sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                sum += double(rows[r * dim + i]) * rows[r * dim + i];
+            }
+            return sum;
+        });
+    }
+
+    // uint8 rows of dotpacked.h, norms of the values coeff * byte + bias
+    static TRowNorms Compute(const uint8_t* rows, size_t rowsNum, size_t dim, float bias, float coeff) {
+        return ComputeBy(rowsNum, [=](size_t r) {
+            double sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                const double value = double(coeff) * rows[r * dim + i] + bias;
+                sum += value * value;
+            }
+            return sum;
+        });
+    }
+
+private:
+    template<class TSquaredNorm>
+    static TRowNorms ComputeBy(size_t rowsNum, TSquaredNorm squaredNorm) {
+        TRowNorms norms;
+        norms.Squared.resize(rowsNum);
+        norms.Inverse.resize(rowsNum);
+        for(size_t r = 0; r < rowsNum; r += 1) {
+            const double squared = squaredNorm(r);
+            norms.Squared[r] = float(squared);
+            norms.Inverse[r] = squared > 0 ? float(1 / std::sqrt(squared)) : 0.f;
+        }
+        return norms;
+    }
+};
+
+// what the epilogues take of the query
+struct TDistanceQuery {
+    float Sum = 0;
+    float SquaredNorm = 0;
+    float InverseNorm = 0;
+
+    TDistanceQuery(const float* a, size_t dim) {
+        for(size_t i = 0; i < dim; i += 1) {
+            Sum += a[i];
+            SquaredNorm += a[i] * a[i];
+        }
+        InverseNorm = SquaredNorm > 0 ? 1 / std::sqrt(SquaredNorm) : 0.f;
+    }
+
+    // the cancellation of close vectors may leave a small negative, a distance is not
+    float L2(float dot, float rowSquared) const {
+        return std::max(0.f, SquaredNorm + rowSquared - 2 * dot);
+    }
+
+    float Cosine(float dot, float rowInverse) const {
+        return dot * InverseNorm * rowInverse;
+    }
+
+    // dot(a, bytes) to the dot with the row values coeff * byte + bias
+    float Packed(float dot, float bias, float coeff) const {
+        return dot * coeff + bias * Sum;
+    }
+};
+
+struct TL2MultiDotNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        const TDistanceQuery query(a, dim);
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            results[e] = query.L2(TNaive::DotProduct(a, allB + dim * elemsIds[e], dim), norms[elemsIds[e]]);
+        }
+    }
+};
+
+struct TCosineMultiDotNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        const TDistanceQuery query(a, dim);
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            results[e] = query.Cosine(TNaive::DotProduct(a, allB + dim * elemsIds[e], dim), norms[elemsIds[e]]);
+        }
+    }
+};
+
+struct TL2PackedNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        const TDistanceQuery query(a, dim);
+        TPackedProductInlinedWithMath::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, 0.f, 1.f, results);
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            results[e] = query.L2(query.Packed(results[e], bias, coeff), norms[elemsIds[e]]);
+        }
+    }
+};
+
+struct TCosinePackedNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        const TDistanceQuery query(a, dim);
+        TPackedProductInlinedWithMath::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, 0.f, 1.f, results);
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            results[e] = query.Cosine(query.Packed(results[e], bias, coeff), norms[elemsIds[e]]);
+        }
+    }
+};
+
+// 4 rows x 16 dims per step with the epilogue applied to the 4 sums, any dim. Bodies are in distance_impl.h,
+// each isa file instantiates them under its own flags
+#define DeclDistanceKernels(Isa) \
+struct TL2MultiDot_##Isa { \
+    static void MultiDotProduct( \
+        const float* a, \
+        const float* allB, \
+        size_t dim, \
+        const float* norms, \
+        const uint32_t* elemsIds, \
+        size_t elemsNum, \
+        float* results \
+    ); \
+}; \
+struct TCosineMultiDot_##Isa { \
+    static void MultiDotProduct( \
+        const float* a, \
+        const float* allB, \
+        size_t dim, \
+        const float* norms, \
+        const uint32_t* elemsIds, \
+        size_t elemsNum, \
+        float* results \
+    ); \
+}; \
+struct TL2Packed_##Isa { \
+    static void MultiDotProduct( \
+        const float* a, \
+        const uint8_t* allB, \
+        size_t dim, \
+        const float* norms, \
+        const uint32_t* elemsIds, \
+        size_t elemsNum, \
+        float bias, \
+        float coeff, \
+        float* results \
+    ); \
+}; \
+struct TCosinePacked_##Isa { \
+    static void MultiDotProduct( \
+        const float* a, \
+        const uint8_t* allB, \
+        size_t dim, \
+        const float* norms, \
+        const uint32_t* elemsIds, \
+        size_t elemsNum, \
+        float bias, \
+        float coeff, \
+        float* results \
+    ); \
+};
+
+DeclDistanceKernels(SSE42)
+DeclDistanceKernels(AVX)
+DeclDistanceKernels(AVX2)
+DeclDistanceKernels(AVX512)
+
+#undef DeclDistanceKernels
+
+struct TL2MultiDotDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::L2MultiDotProductImpl(a, allB, dim, norms, elemsIds, elemsNum, results);
+    }
+};
+
+struct TCosineMultiDotDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::CosineMultiDotProductImpl(a, allB, dim, norms, elemsIds, elemsNum, results);
+    }
+};
+
+struct TL2PackedDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::PackedL2MultiDotProductImpl(a, allB, dim, norms, elemsIds, elemsNum, bias, coeff, results);
+    }
+};
+
+struct TCosinePackedDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const float* norms,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::PackedCosineMultiDotProductImpl(
+            a, allB, dim, norms, elemsIds, elemsNum, bias, coeff, results
+        );
+    }
+};
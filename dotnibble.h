@@ -0,0 +1,196 @@
+#pragma once
+
+#include "dot_product.h"
+#include "dotpacked.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// 4 bit rows: a row is a float scale and a float offset, then the dims in blocks of 64 by 32 bytes,
+// byte j of a block has dim j in the low nibble and dim 32 + j in the high one. So a 32 byte load split by
+// the nibble mask gives two runs of 32 consecutive dims and the query is used in its natural order.
+// The last block is zero padded, row value is nibble * scale + offset, then * coeff + bias as in dotpacked.h
+struct TNibbleRows {
+    static constexpr size_t BlockDims = 64;
+    static constexpr size_t BlockBytes = BlockDims / 2;
+    static constexpr size_t HeaderBytes = 2 * sizeof(float);
+    static constexpr float Levels = 15;
+
+    static size_t RowBytes(size_t dim) {
+        return HeaderBytes + (dim + BlockDims - 1) / BlockDims * BlockBytes;
+    }
+
+    static const uint8_t* Row(const uint8_t* allB, size_t dim, uint32_t id) {
+        return allB + RowBytes(dim) * id;
+    }
+
+    static float Scale(const uint8_t* row) {
+        float scale;
+        std::memcpy(&scale, row, sizeof(scale));
+        return scale;
+    }
+
+    static float Offset(const uint8_t* row) {
+        float offset;
+        std::memcpy(&offset, row + sizeof(float), sizeof(offset));
+        return offset;
+    }
+
+    static const uint8_t* Nibbles(const uint8_t* row) {
+        return row + HeaderBytes;
+    }
+
+    static uint8_t Nibble(const uint8_t* row, size_t i) {
+        const size_t j = i % BlockDims;
+        const uint8_t byte = Nibbles(row)[i / BlockDims * BlockBytes + j % BlockBytes];
+        return j < BlockBytes ? byte & 0x0f : byte >> 4;
+    }
+
+    // min/max of the row to 16 levels with rounding to nearest
+    static void PackRow(const float* row, size_t dim, uint8_t* out) {
+        const auto [minIt, maxIt] = std::minmax_element(row, row + dim);
+        const float offset = dim ? *minIt : 0.f;
+        const float scale = dim ? (*maxIt - *minIt) / Levels : 0.f;
+        std::memcpy(out, &scale, sizeof(scale));
+        std::memcpy(out + sizeof(float), &offset, sizeof(offset));
+        uint8_t* nibbles = out + HeaderBytes;
+        std::memset(nibbles, 0, RowBytes(dim) - HeaderBytes);
+        const float inv = scale > 0 ? 1 / scale : 0.f;
+        for(size_t i = 0; i < dim; i += 1) {
+            const uint8_t nibble = std::min<int>(Levels, std::lrint((row[i] - offset) * inv));
+            const size_t j = i % BlockDims;
+            nibbles[i / BlockDims * BlockBytes + j % BlockBytes] |= j < BlockBytes ? nibble : nibble << 4;
+        }
+    }
+};
+
+inline std::vector<uint8_t> PackNibbleMatrix(const float* rows, size_t rowsNum, size_t dim) {
+    const size_t rowBytes = TNibbleRows::RowBytes(dim);
+    std::vector<uint8_t> result(rowsNum * rowBytes);
+    for(size_t r = 0; r < rowsNum; r += 1) {
+        TNibbleRows::PackRow(rows + r * dim, dim, result.data() + r * rowBytes);
+    }
+    return result;
+}
+
+// the int8 query of TInt8Query, its rounding errors are taken against the middle of the nibble range
+struct TNibbleQuery : public TInt8Query {
+    float Correction;
+
+    TNibbleQuery(const float* a, size_t dim)
+        : TInt8Query(a, dim)
+        , Correction(TNibbleRows::Levels / 2 * Residual())
+    {
+    }
+
+    // for a 64 byte load of two blocks: the low nibbles are dims [0, 32) and [64, 96) of the pair,
+    // the high ones [32, 64) and [96, 128), so the query is regrouped the same way once per call.
+    // An odd last block stays in Values
+    void SplitPairs(std::vector<int8_t>& low, std::vector<int8_t>& high) const {
+        const size_t pairs = Values.size() / (2 * TNibbleRows::BlockDims);
+        low.resize(pairs * TNibbleRows::BlockDims);
+        high.resize(pairs * TNibbleRows::BlockDims);
+        for(size_t p = 0; p < pairs; p += 1) {
+            const int8_t* src = Values.data() + p * 2 * TNibbleRows::BlockDims;
+            int8_t* lo = low.data() + p * TNibbleRows::BlockDims;
+            int8_t* hi = high.data() + p * TNibbleRows::BlockDims;
+            std::memcpy(lo, src, 32);
+            std::memcpy(lo + 32, src + 64, 32);
+            std::memcpy(hi, src + 32, 32);
+            std::memcpy(hi + 32, src + 96, 32);
+        }
+    }
+
+    // dot(a, row) ~= rowScale * (Scale * dot(Values, nibbles) + Correction) + rowOffset * Sum
+    float Finish(const uint8_t* row, int32_t dot, float bias, float coeff) const {
+        return coeff * (TNibbleRows::Scale(row) * (Scale * dot + Correction) + TNibbleRows::Offset(row) * Sum) + bias * Sum;
+    }
+};
+
+// exact float math over the nibbles, the reference for the quantized kernels
+struct TNibbleProductNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        float bb = 0;
+        for(size_t i = 0; i < dim; i += 1) {
+            bb += a[i];
+        }
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            const uint8_t* row = TNibbleRows::Row(allB, dim, elemsIds[e]);
+            float sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                sum += a[i] * TNibbleRows::Nibble(row, i);
+            }
+            results[e] = coeff * (TNibbleRows::Scale(row) * sum + TNibbleRows::Offset(row) * bb) + bias * bb;
+        }
+    }
+};
+
+// the kernels below take allB of PackNibbleMatrix and quantize the query as TNibbleQuery
+
+// nibble mask + vpmaddubsw/vpmaddwd, 4 rows x 64 dims per step
+struct TNibbleProductAvx2 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+// the same on zmm, 4 rows x 128 dims per step
+struct TNibbleProductAvx512 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+// vpdpbusd instead of the maddubs/madd pair
+struct TNibbleProductAvx512Vnni {
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+struct TNibbleProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::NibbleMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include "dot_product.h"
 
+#include <algorithm>
+#include <cmath>
+
 template<class TDotProductImpl>
 struct TPackedProductUnpack {
     inline static void MultiDotProduct(
@@ -73,6 +76,46 @@ struct TPackedProductInlinedWithMath {
     }
 };
 
+// query quantized once per call for the integer kernels: a[i] ~= Values[i] * Scale,
+// Values are padded by zeros up to a multiple of 64 so a full vector load never reads past them
+struct TInt8Query {
+    std::vector<int8_t> Values;
+    float Scale = 0;
+    float Sum = 0;
+    int32_t QuantizedSum = 0;
+
+    TInt8Query(const float* a, size_t dim, int maxValue = 127)
+        : Values((dim + 63) / 64 * 64, 0)
+    {
+        float maxAbs = 0;
+        for(size_t i = 0; i < dim; i += 1) {
+            Sum += a[i];
+            maxAbs = std::max(maxAbs, std::fabs(a[i]));
+        }
+        if (maxAbs == 0) {
+            return;
+        }
+        Scale = maxAbs / maxValue;
+        const float inv = maxValue / maxAbs;
+        for(size_t i = 0; i < dim; i += 1) {
+            Values[i] = int8_t(std::lrint(a[i] * inv));
+            QuantizedSum += Values[i];
+        }
+    }
+
+    // row bytes are all positive, so the rounding errors of the query would add a shift common to all rows;
+    // scoring against (b - 128) removes it: dot(a, b) ~= Scale * (dot(Values, b) - 128 * QuantizedSum) + 128 * Sum,
+    // all the constants are folded here, so the kernel result is just dot(Values, b) * Scale * coeff + Bias(...)
+    float Bias(float bias, float coeff) const {
+        return Sum * bias + 128 * coeff * Residual();
+    }
+
+    // sum of the query rounding errors
+    float Residual() const {
+        return Sum - Scale * QuantizedSum;
+    }
+};
+
 struct TPackedProductInlinedAvx512Auto {
     static void MultiDotProduct(
         const float* a,
@@ -112,6 +155,37 @@ struct TPackedProductAvx512ASM {
     );
 };
 
+// TPackedProductAvx512ASM with the rows Config.Distance blocks ahead prefetched line by line,
+// a packed row line is consumed in 4 steps so one prefetch per row goes every 4th step
+struct TPackedProductDeepPrefetchAvx512ASM {
+    static TPrefetchConfig Config;
+
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        MultiDotProductWith(Config, a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+
+    static void MultiDotProductWith(
+        const TPrefetchConfig& config,
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
 struct TPackedProductV2Avx512ASM {
     static void MultiDotProduct(
         const float* a,
@@ -125,3 +199,247 @@ struct TPackedProductV2Avx512ASM {
     );
 };
 
+
+
+// query is quantized to int8, rows are scored by vpdpbusd into int32, coeff/bias are applied once at the end
+struct TPackedProductAvx512VnniASM {
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+// same for avx2 hosts: vpmaddubsw + vpmaddwd, query is quantized to [-64, 64] so int16 pair sums never saturate
+struct TPackedProductAvx2Int8ASM {
+    static constexpr int QueryMaxValue = 64;
+
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+// batched packed product, same layout as TMultiQueryCTStep
+template<class TPackedImpl>
+struct TPackedMultiQueryFromMulti {
+    inline static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        for(size_t q = 0; q < queriesNum; q += 1) {
+            TPackedImpl::MultiDotProduct(
+                queries + q * dim, allB, dim, elemsIds, elemsNum, bias, coeff, results + q * elemsNum
+            );
+        }
+    }
+};
+
+// the math of TPackedProductInlinedWithMath over a QStep x Step tile, each row byte is converted once per tile
+template<size_t QStep, size_t Step>
+struct TPackedMultiQueryCTStep {
+    inline static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        std::vector<float> bb(queriesNum, 0.f);
+        for(size_t q = 0; q < queriesNum; q += 1) {
+            for(size_t i = 0; i < dim; i += 1) {
+                bb[q] += queries[q * dim + i];
+            }
+            bb[q] *= bias;
+        }
+
+        size_t e = 0;
+        for(; e + Step <= elemsNum; e += Step) {
+            const uint8_t* rows[Step];
+            for(size_t ee = 0; ee < Step; ee += 1) { //unroll by constexpr size
+                rows[ee] = allB + dim * elemsIds[e + ee];
+            }
+            size_t q = 0;
+            for(; q + QStep <= queriesNum; q += QStep) {
+                float tmp[QStep][Step] = {};
+                const float* left = queries + q * dim;
+                for(size_t i = 0; i < dim; i += 1) {
+                    for(size_t qq = 0; qq < QStep; qq += 1) { //unroll by constexpr size
+                        for(size_t ee = 0; ee < Step; ee += 1) { //unroll by constexpr size
+                            tmp[qq][ee] += left[qq * dim + i] * float(rows[ee][i]);
+                        }
+                    }
+                }
+                for(size_t qq = 0; qq < QStep; qq += 1) {
+                    for(size_t ee = 0; ee < Step; ee += 1) {
+                        results[(q + qq) * elemsNum + e + ee] = tmp[qq][ee] * coeff + bb[q + qq];
+                    }
+                }
+            }
+            for(; q < queriesNum; q += 1) {
+                float tmp[Step] = {};
+                const float* left = queries + q * dim;
+                for(size_t i = 0; i < dim; i += 1) {
+                    for(size_t ee = 0; ee < Step; ee += 1) { //unroll by constexpr size
+                        tmp[ee] += left[i] * float(rows[ee][i]);
+                    }
+                }
+                for(size_t ee = 0; ee < Step; ee += 1) {
+                    results[q * elemsNum + e + ee] = tmp[ee] * coeff + bb[q];
+                }
+            }
+        }
+        for(; e < elemsNum; e += 1) {
+            const uint8_t* row = allB + dim * elemsIds[e];
+            for(size_t q = 0; q < queriesNum; q += 1) {
+                float res = 0;
+                for(size_t i = 0; i < dim; i += 1) {
+                    res += queries[q * dim + i] * float(row[i]);
+                }
+                results[q * elemsNum + e] = res * coeff + bb[q];
+            }
+        }
+    }
+};
+
+struct TPackedMultiQueryOpts_SSE42 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+struct TPackedMultiQueryOpts_AVX {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+struct TPackedMultiQueryOpts_AVX2 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+struct TPackedMultiQueryOpts_AVX512 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+// 4 queries x 4 rows, every 16 row bytes are widened to floats once and reused by 4 queries
+struct TPackedMultiQueryAvx512ASM {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    );
+};
+
+struct TPackedProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::PackedMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+};
+
+// lossy: may quantize the query, see TInt8Query
+struct TPackedProductQuantizedDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::QuantizedPackedMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+};
+
+struct TPackedMultiQueryDetectPointer {
+    inline static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::PackedMultiQueryDotProductImpl(
+            queries, queriesNum, allB, dim, elemsIds, elemsNum, bias, coeff, results
+        );
+    }
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// uint8 rows with their own quantization range instead of the one bias/coeff of dotpacked.h.
+// Per row: a float scale and a float offset before the dim bytes, row value is byte * scale + offset
+
+struct TScaledRows {
+    static constexpr size_t HeaderBytes = 2 * sizeof(float);
+    static constexpr float Levels = 255;
+
+    static size_t RowBytes(size_t dim) {
+        return HeaderBytes + dim;
+    }
+
+    static const uint8_t* Row(const uint8_t* allB, size_t dim, uint32_t id) {
+        return allB + RowBytes(dim) * id;
+    }
+
+    static float Scale(const uint8_t* row) {
+        float scale;
+        std::memcpy(&scale, row, sizeof(scale));
+        return scale;
+    }
+
+    static float Offset(const uint8_t* row) {
+        float offset;
+        std::memcpy(&offset, row + sizeof(float), sizeof(offset));
+        return offset;
+    }
+
+    static const uint8_t* Bytes(const uint8_t* row) {
+        return row + HeaderBytes;
+    }
+
+    // min/max of the row to 256 levels with rounding to nearest
+    static void PackRow(const float* row, size_t dim, uint8_t* out) {
+        const auto [minIt, maxIt] = std::minmax_element(row, row + dim);
+        const float offset = dim ? *minIt : 0.f;
+        const float scale = dim ? (*maxIt - *minIt) / Levels : 0.f;
+        std::memcpy(out, &scale, sizeof(scale));
+        std::memcpy(out + sizeof(float), &offset, sizeof(offset));
+        const float inv = scale > 0 ? 1 / scale : 0.f;
+        for(size_t i = 0; i < dim; i += 1) {
+            out[HeaderBytes + i] = uint8_t(std::min<long>(Levels, std::lrint((row[i] - offset) * inv)));
+        }
+    }
+};
+
+inline std::vector<uint8_t> PackScaledRowsMatrix(const float* rows, size_t rowsNum, size_t dim) {
+    const size_t rowBytes = TScaledRows::RowBytes(dim);
+    std::vector<uint8_t> result(rowsNum * rowBytes);
+    for(size_t r = 0; r < rowsNum; r += 1) {
+        TScaledRows::PackRow(rows + r * dim, dim, result.data() + r * rowBytes);
+    }
+    return result;
+}
+
+// allB of PackScaledRowsMatrix: dot(a, row) = scale * dot(a, bytes) + offset * sum(a)
+struct TRowScaledProductNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        float aa = 0;
+        for(size_t i = 0; i < dim; i += 1) {
+            aa += a[i];
+        }
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            const uint8_t* row = TScaledRows::Row(allB, dim, elemsIds[e]);
+            const uint8_t* bytes = TScaledRows::Bytes(row);
+            float sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                sum += a[i] * float(bytes[i]);
+            }
+            results[e] = TScaledRows::Scale(row) * sum + TScaledRows::Offset(row) * aa;
+        }
+    }
+};
+
+// vpmovzxbd + fma, 4 rows x 8 dims per step
+struct TRowScaledProductAvx2 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// layout of TPackedProductAvx512ASM: 4 rows x 16 dims per step, masked tail
+struct TRowScaledProductAvx512ASM {
+    static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TRowScaledProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::RowScaledMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
+
+// Per dim: value of dim i is byte * Scale[i] + Offset[i] for every row, the rows stay plain dim bytes.
+// dot(a, row) = dot(a * Scale, bytes) + dot(a, Offset), so any dotpacked.h kernel runs on the transformed query
+struct TDimScales {
+    std::vector<float> Scale;
+    std::vector<float> Offset;
+
+    // min/max of every dim over the rows
+    static TDimScales Fit(const float* rows, size_t rowsNum, size_t dim) {
+        TDimScales result;
+        result.Scale.assign(dim, 0.f);
+        result.Offset.assign(dim, 0.f);
+        std::vector<float> maxValue(dim, 0.f);
+        for(size_t r = 0; r < rowsNum; r += 1) {
+            const float* row = rows + r * dim;
+            for(size_t i = 0; i < dim; i += 1) {
+                result.Offset[i] = r ? std::min(result.Offset[i], row[i]) : row[i];
+                maxValue[i] = r ? std::max(maxValue[i], row[i]) : row[i];
+            }
+        }
+        for(size_t i = 0; i < dim; i += 1) {
+            result.Scale[i] = (maxValue[i] - result.Offset[i]) / TScaledRows::Levels;
+        }
+        return result;
+    }
+
+    std::vector<uint8_t> Pack(const float* rows, size_t rowsNum) const {
+        const size_t dim = Scale.size();
+        std::vector<float> inv(dim);
+        for(size_t i = 0; i < dim; i += 1) {
+            inv[i] = Scale[i] > 0 ? 1 / Scale[i] : 0.f;
+        }
+        std::vector<uint8_t> result(rowsNum * dim);
+        for(size_t r = 0; r < rowsNum; r += 1) {
+            for(size_t i = 0; i < dim; i += 1) {
+                const long level = std::lrint((rows[r * dim + i] - Offset[i]) * inv[i]);
+                result[r * dim + i] = uint8_t(std::clamp<long>(level, 0, long(TScaledRows::Levels)));
+            }
+        }
+        return result;
+    }
+};
+
+template<class TPackedImpl>
+struct TDimScaledProduct {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const TDimScales& scales,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        static thread_local std::vector<float> query;
+        query.resize(dim);
+        float shift = 0;
+        for(size_t i = 0; i < dim; i += 1) {
+            query[i] = a[i] * scales.Scale[i];
+            shift += a[i] * scales.Offset[i];
+        }
+        TPackedImpl::MultiDotProduct(query.data(), allB, dim, elemsIds, elemsNum, 0.f, 1.f, results);
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            results[e] += shift;
+        }
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <array>
+#include <type_traits>
+#include <utility>
+
+// kernels with dim a template parameter for every dim of FixedDims: the dim loops have constant trip counts,
+// are unrolled whole up to 128 dims and leave no tail. The dim argument is ignored. Bodies are in fixed_dim_impl.h,
+// each isa file instantiates them for FixedDims under its own flags
+
+#define DeclFixedDimKernels(Isa) \
+template<size_t Dim> \
+struct TFixedDimDot_##Isa { \
+    static float DotProduct(const float* a, const float* b, size_t dim); \
+}; \
+template<size_t Dim> \
+struct TFixedDimMultiDot_##Isa { \
+    static void MultiDotProduct( \
+        const float* a, \
+        const float* allB, \
+        size_t dim, \
+        const uint32_t* elemsIds, \
+        size_t elemsNum, \
+        float* results \
+    ); \
+}; \
+template<size_t Dim> \
+struct TFixedDimPacked_##Isa { \
+    static void MultiDotProduct( \
+        const float* a, \
+        const uint8_t* allB, \
+        size_t dim, \
+        const uint32_t* elemsIds, \
+        size_t elemsNum, \
+        float bias, \
+        float coeff, \
+        float* results \
+    ); \
+};
+
+DeclFixedDimKernels(SSE42)
+DeclFixedDimKernels(AVX)
+DeclFixedDimKernels(AVX2)
+DeclFixedDimKernels(AVX512)
+
+#undef DeclFixedDimKernels
+
+// get(std::integral_constant<size_t, Dim>) for every dim, in FixedDims order
+template<class TGet, size_t... Indexes>
+constexpr auto MakeFixedDimTable(TGet get, std::index_sequence<Indexes...>) {
+    return std::array{get(std::integral_constant<size_t, FixedDims[Indexes]>{})...};
+}
+
+// Method of Kernel<Dim> for every dim, in FixedDims order
+#define FixedDimTable(Kernel, Method) MakeFixedDimTable([](auto dim) { \
+    return &Kernel<decltype(dim)::value>::Method; \
+}, std::make_index_sequence<FixedDimsNum>{})
+
+// a switch on dim: the fixed kernel of the host level for FixedDims, the generic one of the level otherwise
+
+struct TFixedDimDetectPointer {
+    inline static float DotProduct(const float* a, const float* b, size_t dim) {
+        const int index = FixedDimIndex(dim);
+        if (index < 0) {
+            return TRuntimeCpuInfoDispatch::DotProductImpl(a, b, dim);
+        }
+        return TRuntimeCpuInfoDispatch::FixedDimDotProductImpls[index](a, b, dim);
+    }
+};
+
+struct TFixedDimMultiDotDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        const int index = FixedDimIndex(dim);
+        const TMultiDotProductFunc func = index < 0
+            ? TRuntimeCpuInfoDispatch::MultiDotProductImpl
+            : TRuntimeCpuInfoDispatch::FixedDimMultiDotProductImpls[index];
+        func(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
+
+struct TFixedDimPackedDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        const int index = FixedDimIndex(dim);
+        const TPackedMultiDotProductFunc func = index < 0
+            ? TRuntimeCpuInfoDispatch::PackedMultiDotProductImpl
+            : TRuntimeCpuInfoDispatch::FixedDimPackedMultiDotProductImpls[index];
+        func(a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+};
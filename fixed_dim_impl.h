@@ -0,0 +1,190 @@
+#pragma once
+
+// bodies of the fixed_dim.h kernels on gcc vector extensions: a TFixedVec of 16 floats is one zmm, two ymm or four
+// xmm depending on the flags of the including isa file. Only isa files include this: the anonymous namespace gives
+// every one of them its own copy, so a body built for avx512 can never be the one the linker keeps for sse4.
+// Vectors are passed by reference only, a vector argument would change the abi between the isa files
+
+#include "fixed_dim.h"
+
+#include <cstring>
+#include <immintrin.h>
+
+namespace {
+    using TFixedVec = float __attribute__((vector_size(64)));
+    // a memcpy of bytes gcc splits into scalar moves, this type loads them unaligned straight from the rows
+    using TFixedBytes = uint8_t __attribute__((vector_size(16), aligned(1), may_alias));
+    using TFixedWords = uint16_t __attribute__((vector_size(32)));
+    using TFixedInts = int32_t __attribute__((vector_size(64)));
+
+    constexpr size_t FixedVecFloats = 16;
+    constexpr size_t FixedRowsStep = 4;
+    // dims up to this are unrolled whole, longer rows loop over blocks of it with a constant trip count:
+    // a whole 1024 dim body of 4 rows would not fit the uop cache
+    constexpr size_t FixedMaxUnroll = 128;
+
+    template<size_t Dim>
+    constexpr size_t FixedBlock() {
+        // two accumulators of the single row product take vectors in turn
+        static_assert(Dim % (2 * FixedVecFloats) == 0, "fixed dims are whole vector pairs");
+        static_assert(Dim <= FixedMaxUnroll || Dim % FixedMaxUnroll == 0, "long fixed dims are whole blocks");
+        return Dim < FixedMaxUnroll ? Dim : FixedMaxUnroll;
+    }
+
+    inline void LoadFixed(TFixedVec& res, const float* data) {
+        std::memcpy(&res, data, sizeof(res));
+    }
+
+    // gcc converts vectors of bytes to floats or ints lane by lane, the isas with wide pmovzx get it by hand
+    inline void LoadFixed(TFixedVec& res, const uint8_t* data) {
+#if defined(__AVX512F__)
+        res = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))));
+#elif defined(__AVX2__)
+        const __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data))));
+        const __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + 8))));
+        std::memcpy(&res, &low, sizeof(low));
+        std::memcpy(reinterpret_cast<char*>(&res) + sizeof(low), &high, sizeof(high));
+#else
+        const TFixedBytes bytes = *reinterpret_cast<const TFixedBytes*>(data);
+        const TFixedWords words = __builtin_convertvector(bytes, TFixedWords);
+        res = __builtin_convertvector(__builtin_convertvector(words, TFixedInts), TFixedVec);
+#endif
+    }
+
+    inline float SumFixed(const TFixedVec& sum) {
+        float res = 0;
+        for(size_t i = 0; i < FixedVecFloats; i += 1) {
+            res += sum[i];
+        }
+        return res;
+    }
+
+    template<size_t Dim, class TElem>
+    inline float FixedDotProduct(const float* a, const TElem* b) {
+        constexpr size_t Block = FixedBlock<Dim>();
+        TFixedVec sums[2] = {};
+        TFixedVec left;
+        TFixedVec right;
+#pragma GCC unroll 1
+        for(size_t begin = 0; begin < Dim; begin += Block) {
+#pragma GCC unroll 8
+            for(size_t i = begin; i < begin + Block; i += FixedVecFloats) {
+                LoadFixed(left, a + i);
+                LoadFixed(right, b + i);
+                sums[i / FixedVecFloats % 2] += left * right;
+            }
+        }
+        return SumFixed(sums[0] + sums[1]);
+    }
+
+    template<size_t Dim, class TElem, class TFinish>
+    inline void FixedMultiDotProduct(
+        const float* a,
+        const TElem* allB,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results,
+        TFinish finish
+    ) {
+        constexpr size_t Block = FixedBlock<Dim>();
+        size_t e = 0;
+        for(; e + FixedRowsStep <= elemsNum; e += FixedRowsStep) {
+            const TElem* r0 = allB + Dim * elemsIds[e + 0];
+            const TElem* r1 = allB + Dim * elemsIds[e + 1];
+            const TElem* r2 = allB + Dim * elemsIds[e + 2];
+            const TElem* r3 = allB + Dim * elemsIds[e + 3];
+            TFixedVec s0 = {};
+            TFixedVec s1 = {};
+            TFixedVec s2 = {};
+            TFixedVec s3 = {};
+            TFixedVec left;
+            TFixedVec right;
+#pragma GCC unroll 1
+            for(size_t begin = 0; begin < Dim; begin += Block) {
+#pragma GCC unroll 8
+                for(size_t i = begin; i < begin + Block; i += FixedVecFloats) {
+                    LoadFixed(left, a + i);
+                    LoadFixed(right, r0 + i);
+                    s0 += left * right;
+                    LoadFixed(right, r1 + i);
+                    s1 += left * right;
+                    LoadFixed(right, r2 + i);
+                    s2 += left * right;
+                    LoadFixed(right, r3 + i);
+                    s3 += left * right;
+                }
+            }
+            results[e + 0] = finish(SumFixed(s0));
+            results[e + 1] = finish(SumFixed(s1));
+            results[e + 2] = finish(SumFixed(s2));
+            results[e + 3] = finish(SumFixed(s3));
+        }
+        for(; e < elemsNum; e += 1) {
+            results[e] = finish(FixedDotProduct<Dim>(a, allB + Dim * elemsIds[e]));
+        }
+    }
+
+    template<size_t Dim>
+    inline void FixedFloatMultiDotProduct(
+        const float* a,
+        const float* allB,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        FixedMultiDotProduct<Dim>(a, allB, elemsIds, elemsNum, results, [](float dot) {
+            return dot;
+        });
+    }
+
+    // the math of TPackedProductInlinedWithMath: coeff * dot + bias * sum(a)
+    template<size_t Dim>
+    inline void FixedPackedMultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        TFixedVec sum = {};
+        TFixedVec left;
+        for(size_t i = 0; i < Dim; i += FixedVecFloats) {
+            LoadFixed(left, a + i);
+            sum += left;
+        }
+        const float bb = SumFixed(sum) * bias;
+        FixedMultiDotProduct<Dim>(a, allB, elemsIds, elemsNum, results, [=](float dot) {
+            return dot * coeff + bb;
+        });
+    }
+}
+
+// the three kernels of Isa for one dim, for the isa files to list FixedDims with
+#define DeclFixedDimByIsa(Isa, Dim) \
+template<> float TFixedDimDot_##Isa<Dim>::DotProduct(const float* a, const float* b, size_t) {\
+    return FixedDotProduct<Dim>(a, b);\
+}\
+template<> void TFixedDimMultiDot_##Isa<Dim>::MultiDotProduct(\
+    const float* a,\
+    const float* allB,\
+    size_t,\
+    const uint32_t* elemsIds,\
+    size_t elemsNum,\
+    float* results\
+) {\
+    FixedFloatMultiDotProduct<Dim>(a, allB, elemsIds, elemsNum, results);\
+}\
+template<> void TFixedDimPacked_##Isa<Dim>::MultiDotProduct(\
+    const float* a,\
+    const uint8_t* allB,\
+    size_t,\
+    const uint32_t* elemsIds,\
+    size_t elemsNum,\
+    float bias,\
+    float coeff,\
+    float* results\
+) {\
+    FixedPackedMultiDotProduct<Dim>(a, allB, elemsIds, elemsNum, bias, coeff, results);\
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "dot_product.h"
+#include "aligned_matrix.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// exhaustive scoring of every row, results[r] = dot(a, row r), no ids to gather by
+
+// rows of dim floats regrouped by ScanBlockRows: block b holds value i of its row j at (b * dim + i) * 16 + j,
+// the last block is padded by zero rows. One vector load is one dim of 16 docs, so a broadcast query value and one
+// fma advance all of them and every sum stays in its own lane, no horizontal reduction per row.
+// Blocks start on a page, a dim is a cache line, as the streaming loads want them
+constexpr size_t ScanBlockRows = 16;
+
+class TInterleavedMatrix {
+public:
+    // rows packed at dim stride as in a plain vector
+    TInterleavedMatrix(const float* rows, size_t rowsNum, size_t dim, EPageBacking backing = EPageBacking::Transparent)
+        : Rows_(rowsNum)
+        , Dim_(dim)
+        , Buffer_(std::max<size_t>(1, Blocks() * dim * ScanBlockRows) * sizeof(float), backing)
+    {
+        float* data = Data();
+        for(size_t b = 0; b < Blocks(); b += 1) {
+            float* block = data + b * dim * ScanBlockRows;
+            for(size_t j = 0; j < ScanBlockRows; j += 1) {
+                const size_t r = b * ScanBlockRows + j;
+                for(size_t i = 0; i < dim; i += 1) {
+                    block[i * ScanBlockRows + j] = r < rowsNum ? rows[r * dim + i] : 0.f;
+                }
+            }
+        }
+    }
+
+    size_t Rows() const {
+        return Rows_;
+    }
+
+    size_t Dim() const {
+        return Dim_;
+    }
+
+    size_t Blocks() const {
+        return (Rows_ + ScanBlockRows - 1) / ScanBlockRows;
+    }
+
+    float* Data() const {
+        return static_cast<float*>(Buffer_.Data());
+    }
+
+    float Value(size_t row, size_t i) const {
+        return Data()[(row / ScanBlockRows * Dim_ + i) * ScanBlockRows + row % ScanBlockRows];
+    }
+
+    EPageBacking Backing() const {
+        return Buffer_.Backing();
+    }
+
+private:
+    size_t Rows_;
+    size_t Dim_;
+    THugePageBuffer Buffer_;
+};
+
+// FullScan over plain rows by a gathering MultiDotProduct, ids of ScanIdsChunk consecutive rows at a time:
+// what a scan costs with the kernels we have
+template<class TMultiImpl>
+struct TFullScanFromMulti {
+    static constexpr size_t ScanIdsChunk = 1024;
+
+    inline static void FullScan(const float* a, const float* allB, size_t dim, size_t rowsNum, float* results) {
+        uint32_t ids[ScanIdsChunk];
+        for(size_t begin = 0; begin < rowsNum; begin += ScanIdsChunk) {
+            const size_t size = std::min(ScanIdsChunk, rowsNum - begin);
+            std::iota(ids, ids + size, uint32_t(begin));
+            TMultiImpl::MultiDotProduct(a, allB, dim, ids, size, results + begin);
+        }
+    }
+};
+
+struct TInterleavedScanNaive {
+    // blocks of TInterleavedMatrix
+    inline static void FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results) {
+        for(size_t row = 0; row < rowsNum; row += ScanBlockRows) {
+            const float* block = blocks + row * dim;
+            float sums[ScanBlockRows] = {};
+            for(size_t i = 0; i < dim; i += 1) {
+                for(size_t j = 0; j < ScanBlockRows; j += 1) {
+                    sums[j] += a[i] * block[i * ScanBlockRows + j];
+                }
+            }
+            std::copy(sums, sums + std::min(ScanBlockRows, rowsNum - row), results + row);
+        }
+    }
+};
+
+// a block is two ymm per dim, 4 dims per step into 8 accumulators
+struct TInterleavedScanAvx2 {
+    static void FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results);
+};
+
+// a block is a zmm per dim, 8 accumulators over dims modulo 8, masked store of the last block
+struct TInterleavedScanAvx512 {
+    static void FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results);
+};
+
+// the same with vmovntdqa loads and prefetchnta Distance blocks ahead, so a scan larger than the llc does not
+// evict what the other threads keep there. vmovntdqa of write back memory is a plain load, the prefetch does the
+// work, and it costs the scan itself up to 2x: not the dispatched one, for hosts where the llc is shared
+struct TInterleavedScanStreamAvx512 {
+    static constexpr size_t Distance = 2;
+
+    static void FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results);
+};
+
+struct TInterleavedScanDetectPointer {
+    inline static void FullScan(const float* a, const float* blocks, size_t dim, size_t rowsNum, float* results) {
+        TRuntimeCpuInfoDispatch::InterleavedScanImpl(a, blocks, dim, rowsNum, results);
+    }
+};
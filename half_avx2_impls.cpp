@@ -0,0 +1,111 @@
+#include "halfdot.h"
+
+#include <immintrin.h>
+
+namespace {
+    struct TWidenHalf {
+        static inline __m256 Load(const uint16_t* p) {
+            return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+        }
+
+        static inline float Scalar(uint16_t x) {
+            return HalfToFloat(x);
+        }
+    };
+
+    struct TWidenBf16 {
+        static inline __m256 Load(const uint16_t* p) {
+            return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)), 16));
+        }
+
+        static inline float Scalar(uint16_t x) {
+            return Bf16ToFloat(x);
+        }
+    };
+
+    inline float ReduceAdd(__m256 v) {
+        __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+        x = _mm_add_ss(x, _mm_movehdup_ps(x));
+        return _mm_cvtss_f32(x);
+    }
+
+    template<class TWiden>
+    inline float TailRest(const float* a, const uint16_t* row, size_t from, size_t to) {
+        float res = 0;
+        for(size_t i = from; i < to; i += 1) {
+            res += a[i] * TWiden::Scalar(row[i]);
+        }
+        return res;
+    }
+
+    // no masked 16 bit loads on avx2, the last dim % 8 values are scalar
+    template<class TWiden>
+    void MultiDotHalfRows(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        size_t e = 0;
+        constexpr size_t Step = 4;
+        constexpr size_t ElemsInVec = (sizeof(__m256) / sizeof(float));
+        const size_t bodyDim = dim - dim % ElemsInVec;
+        for(; e + Step <= elemsNum; e += Step) {
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            __m256 sum2 = _mm256_setzero_ps();
+            __m256 sum3 = _mm256_setzero_ps();
+
+            const uint16_t* e0 = allB + dim * elemsIds[e + 0];
+            const uint16_t* e1 = allB + dim * elemsIds[e + 1];
+            const uint16_t* e2 = allB + dim * elemsIds[e + 2];
+            const uint16_t* e3 = allB + dim * elemsIds[e + 3];
+
+            for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+                __m256 left = _mm256_loadu_ps(a + position);
+                sum0 = _mm256_fmadd_ps(left, TWiden::Load(e0 + position), sum0);
+                sum1 = _mm256_fmadd_ps(left, TWiden::Load(e1 + position), sum1);
+                sum2 = _mm256_fmadd_ps(left, TWiden::Load(e2 + position), sum2);
+                sum3 = _mm256_fmadd_ps(left, TWiden::Load(e3 + position), sum3);
+            }
+
+            results[e + 0] = ReduceAdd(sum0) + TailRest<TWiden>(a, e0, bodyDim, dim);
+            results[e + 1] = ReduceAdd(sum1) + TailRest<TWiden>(a, e1, bodyDim, dim);
+            results[e + 2] = ReduceAdd(sum2) + TailRest<TWiden>(a, e2, bodyDim, dim);
+            results[e + 3] = ReduceAdd(sum3) + TailRest<TWiden>(a, e3, bodyDim, dim);
+        }
+        for(; e < elemsNum; e += 1) {
+            const uint16_t* e0 = allB + dim * elemsIds[e];
+            __m256 sum0 = _mm256_setzero_ps();
+            for(size_t position = 0; position < bodyDim; position += ElemsInVec) {
+                sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + position), TWiden::Load(e0 + position), sum0);
+            }
+            results[e] = ReduceAdd(sum0) + TailRest<TWiden>(a, e0, bodyDim, dim);
+        }
+    }
+}
+
+void THalfProductAvx2F16C::MultiDotProduct(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    MultiDotHalfRows<TWidenHalf>(a, allB, dim, elemsIds, elemsNum, results);
+}
+
+void TBf16ProductAvx2::MultiDotProduct(
+    const float* a,
+    const uint16_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    MultiDotHalfRows<TWidenBf16>(a, allB, dim, elemsIds, elemsNum, results);
+}
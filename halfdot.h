@@ -0,0 +1,203 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <cstring>
+#include <vector>
+
+// half precision rows: IEEE fp16 (1-5-10) or bfloat16 (the upper half of a float), both stored as uint16_t.
+// Same MultiDotProduct signature as multidot.h with allB of uint16_t, the query stays float
+
+inline uint32_t FloatBits(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+inline float FloatFromBits(uint32_t bits) {
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// round to nearest even as vcvtneps2bf16 does, nan stays quiet nan
+inline uint16_t FloatToBf16(float x) {
+    const uint32_t bits = FloatBits(x);
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        return uint16_t((bits >> 16) | 0x40);
+    }
+    return uint16_t((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+inline float Bf16ToFloat(uint16_t x) {
+    return FloatFromBits(uint32_t(x) << 16);
+}
+
+// round to nearest even as vcvtps2ph with _MM_FROUND_TO_NEAREST_INT does
+inline uint16_t FloatToHalf(float x) {
+    const uint32_t bits = FloatBits(x);
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const uint32_t absBits = bits & 0x7fffffffu;
+    if (absBits >= 0x7f800000u) { // inf, nan
+        return sign | 0x7c00 | (absBits > 0x7f800000u ? 0x200 : 0);
+    }
+    if (absBits >= 0x477ff000u) { // rounds above 65504
+        return sign | 0x7c00;
+    }
+    if (absBits < 0x38800000u) { // below the smallest normal half, 2^-14: denormal or zero
+        // adding 0.5 aligns the mantissa so the float rounding does the half denormal rounding
+        const float shifted = FloatFromBits(absBits) + 0.5f;
+        return sign | uint16_t(FloatBits(shifted) - FloatBits(0.5f));
+    }
+    const uint32_t rounded = absBits + 0xfff + ((absBits >> 13) & 1);
+    return sign | uint16_t((rounded - (uint32_t(127 - 15) << 23)) >> 13);
+}
+
+inline float HalfToFloat(uint16_t x) {
+    const uint32_t sign = uint32_t(x & 0x8000) << 16;
+    const uint32_t exponent = (x >> 10) & 0x1f;
+    const uint32_t mantissa = x & 0x3ff;
+    if (exponent == 0) { // zero, denormal: mantissa * 2^-24
+        const float value = float(mantissa) * (1.f / 16777216.f);
+        return FloatFromBits(FloatBits(value) | sign);
+    }
+    if (exponent == 0x1f) {
+        return FloatFromBits(sign | 0x7f800000u | (mantissa << 13));
+    }
+    return FloatFromBits(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+template<class TConvert>
+inline std::vector<uint16_t> ConvertMatrix(const float* matrix, size_t size, TConvert&& convert) {
+    std::vector<uint16_t> result(size);
+    for(size_t i = 0; i < size; i += 1) {
+        result[i] = convert(matrix[i]);
+    }
+    return result;
+}
+
+struct THalfProductNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            const uint16_t* b = allB + dim * elemsIds[e];
+            float sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                sum += a[i] * HalfToFloat(b[i]);
+            }
+            results[e] = sum;
+        }
+    }
+};
+
+struct TBf16ProductNaive {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            const uint16_t* b = allB + dim * elemsIds[e];
+            float sum = 0;
+            for(size_t i = 0; i < dim; i += 1) {
+                sum += a[i] * Bf16ToFloat(b[i]);
+            }
+            results[e] = sum;
+        }
+    }
+};
+
+// vcvtph2ps + fma, 4 rows x 8 dims per step
+struct THalfProductAvx2F16C {
+    static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// bf16 to float is a 16 bit shift, 4 rows x 8 dims per step
+struct TBf16ProductAvx2 {
+    static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// layout of TMultiDotV3_ASM_AVX512: 4 rows x 16 dims per step, masked tail
+struct THalfProductAvx512ASM {
+    static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TBf16ProductAvx512ASM {
+    static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// vdpbf16ps, 4 rows x 32 dims per step. Lossy for the query: it is rounded to bf16 once per call,
+// the TBf16Product* above keep it float
+struct TBf16ProductAvx512Bf16ASM {
+    static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct THalfProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::HalfMultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
+
+struct TBf16ProductDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint16_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::Bf16MultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
@@ -0,0 +1,154 @@
+#include "id_distribution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    std::vector<std::string> Split(const std::string& text) {
+        std::vector<std::string> parts;
+        std::stringstream stream(text);
+        std::string part;
+        while (std::getline(stream, part, ':')) {
+            parts.push_back(part);
+        }
+        return parts;
+    }
+
+    // inverse of the cumulative weights, a binary search per id
+    class TZipfSampler {
+    public:
+        TZipfSampler(size_t rowsNum, double s)
+            : Cdf_(rowsNum)
+        {
+            double sum = 0;
+            for(size_t k = 0; k < rowsNum; k += 1) {
+                sum += std::pow(double(k + 1), -s);
+                Cdf_[k] = sum;
+            }
+            for(double& value : Cdf_) {
+                value /= sum;
+            }
+        }
+
+        template<class TRng>
+        size_t operator()(TRng& rng) const {
+            const double u = std::uniform_real_distribution<double>(0, 1)(rng);
+            const size_t rank = std::lower_bound(Cdf_.begin(), Cdf_.end(), u) - Cdf_.begin();
+            return std::min(rank, Cdf_.size() - 1);
+        }
+
+    private:
+        std::vector<double> Cdf_;
+    };
+}
+
+TIdDistribution TIdDistribution::Parse(const std::string& text) {
+    const std::vector<std::string> parts = Split(text);
+    const std::string kind = parts.empty() ? "" : parts[0];
+    TIdDistribution distribution;
+    bool known = true;
+    // stod and stoul throw std::invalid_argument or std::out_of_range on bad numbers
+    try {
+        if (kind == "uniform" && parts.size() == 1) {
+            distribution.Kind = EIdDistribution::Uniform;
+        } else if (kind == "zipf" && parts.size() <= 2) {
+            distribution.Kind = EIdDistribution::Zipf;
+            if (parts.size() > 1) {
+                distribution.ZipfS = std::stod(parts[1]);
+            }
+        } else if (kind == "clustered" && parts.size() <= 3) {
+            distribution.Kind = EIdDistribution::Clustered;
+            if (parts.size() > 1) {
+                distribution.RunLength = std::stoul(parts[1]);
+            }
+            if (parts.size() > 2) {
+                distribution.ShardRows = std::stoul(parts[2]);
+            }
+        } else if (kind == "sorted" && parts.size() == 1) {
+            distribution.Kind = EIdDistribution::Sorted;
+        } else {
+            known = false;
+        }
+    } catch (const std::logic_error&) {
+        known = false;
+    }
+    if (!known || distribution.ZipfS <= 0 || distribution.RunLength == 0 || distribution.ShardRows == 0) {
+        throw std::invalid_argument("bad id distribution: " + text);
+    }
+    return distribution;
+}
+
+std::string TIdDistribution::ToString() const {
+    switch (Kind) {
+        case EIdDistribution::Uniform: return "uniform";
+        case EIdDistribution::Zipf: {
+            std::stringstream text;
+            text << "zipf:" << ZipfS;
+            return text.str();
+        }
+        case EIdDistribution::Clustered:
+            return "clustered:" + std::to_string(RunLength) + ":" + std::to_string(ShardRows);
+        case EIdDistribution::Sorted: return "sorted";
+    }
+    return "unknown";
+}
+
+std::vector<std::vector<uint32_t>> GenerateIds(
+    const TIdDistribution& distribution,
+    size_t rowsNum,
+    size_t listsNum,
+    size_t idsNum,
+    uint64_t seed
+) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<uint32_t> rows(0, uint32_t(rowsNum - 1));
+    std::vector<std::vector<uint32_t>> lists(listsNum);
+    switch (distribution.Kind) {
+        case EIdDistribution::Uniform:
+        case EIdDistribution::Sorted:
+            for(auto& ids : lists) {
+                ids.resize(idsNum);
+                for(uint32_t& id : ids) {
+                    id = rows(rng);
+                }
+                if (distribution.Kind == EIdDistribution::Sorted) {
+                    std::sort(ids.begin(), ids.end());
+                }
+            }
+            break;
+        case EIdDistribution::Zipf: {
+            const TZipfSampler sampler(rowsNum, distribution.ZipfS);
+            std::vector<uint32_t> rowOfRank(rowsNum);
+            std::iota(rowOfRank.begin(), rowOfRank.end(), 0u);
+            std::shuffle(rowOfRank.begin(), rowOfRank.end(), rng);
+            for(auto& ids : lists) {
+                ids.resize(idsNum);
+                for(uint32_t& id : ids) {
+                    id = rowOfRank[sampler(rng)];
+                }
+            }
+            break;
+        }
+        case EIdDistribution::Clustered: {
+            const size_t shardRows = std::min(distribution.ShardRows, rowsNum);
+            std::uniform_int_distribution<size_t> shards(0, (rowsNum - shardRows) / shardRows);
+            std::uniform_int_distribution<uint32_t> inShard(0, uint32_t(shardRows - 1));
+            for(auto& ids : lists) {
+                ids.resize(idsNum);
+                size_t shardBegin = 0;
+                for(size_t i = 0; i < idsNum; i += 1) {
+                    if (i % distribution.RunLength == 0) {
+                        shardBegin = shards(rng) * shardRows;
+                    }
+                    ids[i] = uint32_t(shardBegin + inShard(rng));
+                }
+            }
+            break;
+        }
+    }
+    return lists;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class EIdDistribution {
+    Uniform,
+    // a few hot docs take most of the requests
+    Zipf,
+    // runs of ids from one shard of consecutive rows, as candidates come from per shard retrieval
+    Clustered,
+    // uniform, every list sorted as some retrieval stages hand them over
+    Sorted,
+};
+
+// how the candidate ids of a query are spread over the matrix rows
+struct TIdDistribution {
+    EIdDistribution Kind = EIdDistribution::Uniform;
+    // Zipf: the rank k doc is drawn with weight 1 / (k + 1)^ZipfS
+    double ZipfS = 1.0;
+    // Clustered: RunLength ids uniform within one shard of ShardRows rows, then the next shard at random
+    size_t RunLength = 64;
+    size_t ShardRows = 4096;
+
+    // "uniform", "zipf[:s]", "clustered[:run[:shard rows]]" or "sorted", throws std::invalid_argument on other text
+    static TIdDistribution Parse(const std::string& text);
+    // the text Parse takes back
+    std::string ToString() const;
+};
+
+// listsNum lists of idsNum ids of [0, rowsNum), the same for the same seed. Zipf ranks land on rows through
+// a fixed shuffle, so the hot docs are spread over the matrix rather than packed into its first pages
+std::vector<std::vector<uint32_t>> GenerateIds(
+    const TIdDistribution& distribution,
+    size_t rowsNum,
+    size_t listsNum,
+    size_t idsNum,
+    uint64_t seed
+);
@@ -0,0 +1,214 @@
+#include "matrix_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t PageSize = 4096;
+
+    [[noreturn]] void ThrowErrno(const std::string& what, const std::string& path) {
+        throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+    }
+
+    size_t RoundUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    size_t ElemSize(EMatrixDType dtype) {
+        return dtype == EMatrixDType::Float32 ? sizeof(float) : sizeof(uint8_t);
+    }
+
+    class TFd {
+    public:
+        TFd(const std::string& path, int flags, mode_t mode = 0)
+            : Fd_(::open(path.c_str(), flags | O_CLOEXEC, mode))
+        {
+            if (Fd_ < 0) {
+                ThrowErrno("can not open", path);
+            }
+        }
+
+        ~TFd() {
+            ::close(Fd_);
+        }
+
+        int Get() const {
+            return Fd_;
+        }
+
+    private:
+        int Fd_;
+    };
+
+    void WriteAll(int fd, const void* data, size_t size, const std::string& path) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            const ssize_t written = ::write(fd, p, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ThrowErrno("can not write", path);
+            }
+            p += written;
+            size -= written;
+        }
+    }
+
+    void WriteMatrix(
+        const std::string& path,
+        const void* rows,
+        size_t rowsNum,
+        size_t dim,
+        EMatrixDType dtype,
+        const TMatrixFileOptions& options
+    ) {
+        if (options.Alignment == 0 || PageSize % options.Alignment != 0) {
+            throw std::runtime_error("matrix file alignment must divide the page size");
+        }
+        const size_t rowBytes = dim * ElemSize(dtype);
+
+        TMatrixFileHeader header = {};
+        std::memcpy(header.Magic, TMatrixFileHeader::MagicValue, sizeof(header.Magic));
+        header.Version = TMatrixFileHeader::CurrentVersion;
+        header.DType = dtype;
+        header.Rows = rowsNum;
+        header.Dim = dim;
+        header.RowStride = RoundUp(rowBytes, options.Alignment);
+        header.DataOffset = PageSize;
+        header.Coeff = options.Coeff;
+        header.Bias = options.Bias;
+        header.Alignment = options.Alignment;
+
+        const std::string tmpPath = path + ".tmp";
+        {
+            TFd fd(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            std::vector<char> buffer(header.DataOffset, 0);
+            std::memcpy(buffer.data(), &header, sizeof(header));
+            WriteAll(fd.Get(), buffer.data(), buffer.size(), tmpPath);
+
+            // rows go out in batches of about 1 MB, each one zero padded to the stride
+            const size_t batchRows = std::max<size_t>(1, (1u << 20) / header.RowStride);
+            buffer.assign(batchRows * header.RowStride, 0);
+            const char* src = static_cast<const char*>(rows);
+            for(size_t r = 0; r < rowsNum; r += batchRows) {
+                const size_t n = std::min(batchRows, rowsNum - r);
+                for(size_t i = 0; i < n; i += 1) {
+                    std::memcpy(buffer.data() + i * header.RowStride, src + (r + i) * rowBytes, rowBytes);
+                }
+                WriteAll(fd.Get(), buffer.data(), n * header.RowStride, tmpPath);
+            }
+            if (::fsync(fd.Get()) != 0) {
+                ThrowErrno("can not sync", tmpPath);
+            }
+        }
+        if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            ThrowErrno("can not rename to", path);
+        }
+    }
+}
+
+void WriteMatrixFile(const std::string& path, const float* rows, size_t rowsNum, size_t dim, const TMatrixFileOptions& options) {
+    WriteMatrix(path, rows, rowsNum, dim, EMatrixDType::Float32, options);
+}
+
+void WriteMatrixFile(const std::string& path, const uint8_t* rows, size_t rowsNum, size_t dim, const TMatrixFileOptions& options) {
+    WriteMatrix(path, rows, rowsNum, dim, EMatrixDType::UInt8, options);
+}
+
+TMappedMatrix::TMappedMatrix(const std::string& path, const TMapOptions& options) {
+    TFd fd(path, O_RDONLY);
+    struct stat st;
+    if (::fstat(fd.Get(), &st) != 0) {
+        ThrowErrno("can not stat", path);
+    }
+    if (size_t(st.st_size) < sizeof(TMatrixFileHeader)) {
+        throw std::runtime_error("matrix file " + path + " is shorter than its header");
+    }
+
+    TMatrixFileHeader header;
+    if (::pread(fd.Get(), &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+        ThrowErrno("can not read header of", path);
+    }
+    if (std::memcmp(header.Magic, TMatrixFileHeader::MagicValue, sizeof(header.Magic)) != 0) {
+        throw std::runtime_error("not a matrix file: " + path);
+    }
+    if (header.Version != TMatrixFileHeader::CurrentVersion) {
+        throw std::runtime_error("unsupported matrix file version " + std::to_string(header.Version) + ": " + path);
+    }
+    if (header.DType != EMatrixDType::Float32 && header.DType != EMatrixDType::UInt8) {
+        throw std::runtime_error("unknown matrix dtype in " + path);
+    }
+    // a stride of whole elements and alignments, so KernelDim() addresses rows exactly where they are
+    const size_t elemSize = ElemSize(header.DType);
+    const bool powerOfTwo = header.Alignment != 0 && (header.Alignment & (header.Alignment - 1)) == 0;
+    uint64_t rowBytes = 0;
+    if (!powerOfTwo
+        || header.DataOffset % PageSize != 0
+        || header.RowStride % elemSize != 0
+        || header.RowStride % header.Alignment != 0
+        || __builtin_mul_overflow(header.Dim, elemSize, &rowBytes)
+        || header.RowStride < rowBytes)
+    {
+        throw std::runtime_error("bad matrix layout in " + path);
+    }
+    uint64_t dataBytes = 0;
+    uint64_t fileBytes = 0;
+    if (__builtin_mul_overflow(header.Rows, header.RowStride, &dataBytes)
+        || __builtin_add_overflow(header.DataOffset, dataBytes, &fileBytes))
+    {
+        throw std::runtime_error("matrix size overflows in " + path);
+    }
+    if (uint64_t(st.st_size) < fileBytes) {
+        throw std::runtime_error("truncated matrix file " + path);
+    }
+
+    Size_ = st.st_size;
+    const int flags = MAP_SHARED | (options.Populate ? MAP_POPULATE : 0);
+    void* mapping = ::mmap(nullptr, Size_, PROT_READ, flags, fd.Get(), 0);
+    if (mapping == MAP_FAILED) {
+        ThrowErrno("can not mmap", path);
+    }
+    Mapping_ = mapping;
+
+    // advices are hints, the mapping works without them
+    if (options.Random) {
+        ::madvise(mapping, Size_, MADV_RANDOM);
+    }
+    if (options.WillNeed) {
+        ::madvise(mapping, Size_, MADV_WILLNEED);
+    }
+    if (options.HugePages) {
+        ::madvise(mapping, Size_, MADV_HUGEPAGE);
+    }
+}
+
+TMappedMatrix::~TMappedMatrix() {
+    ::munmap(const_cast<void*>(Mapping_), Size_);
+}
+
+size_t TMappedMatrix::KernelDim() const {
+    return Header().RowStride / ElemSize(Header().DType);
+}
+
+const float* TMappedMatrix::Floats() const {
+    if (Header().DType != EMatrixDType::Float32) {
+        throw std::runtime_error("matrix file does not hold floats");
+    }
+    return reinterpret_cast<const float*>(static_cast<const char*>(Mapping_) + Header().DataOffset);
+}
+
+const uint8_t* TMappedMatrix::Bytes() const {
+    if (Header().DType != EMatrixDType::UInt8) {
+        throw std::runtime_error("matrix file does not hold uint8 rows");
+    }
+    return static_cast<const uint8_t*>(Mapping_) + Header().DataOffset;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// on-disk embedding matrix: a 64 byte header, then rows from DataOffset (page aligned) with RowStride bytes each,
+// RowStride is a multiple of Alignment so with a page aligned mapping every row starts on a cache line.
+// Padding is zeros, so the kernels can run over KernelDim() with the query zero padded to the same length
+
+enum class EMatrixDType : uint32_t {
+    Float32 = 0,
+    UInt8 = 1,
+};
+
+struct TMatrixFileHeader {
+    static constexpr char MagicValue[8] = {'D', 'O', 'T', 'M', 'A', 'T', 'R', 'X'};
+    static constexpr uint32_t CurrentVersion = 1;
+
+    char Magic[8];
+    uint32_t Version;
+    EMatrixDType DType;
+    uint64_t Rows;
+    uint64_t Dim;
+    uint64_t RowStride;
+    uint64_t DataOffset;
+    // TPackedProduct* arguments for UInt8 rows, row value is x * Coeff + Bias
+    float Coeff;
+    float Bias;
+    uint32_t Alignment;
+    uint32_t Reserved;
+};
+
+static_assert(sizeof(TMatrixFileHeader) == 64, "header is one cache line");
+
+struct TMatrixFileOptions {
+    size_t Alignment = 64;
+    float Coeff = 1.f;
+    float Bias = 0.f;
+};
+
+// writes to path + ".tmp" and renames, so readers never see a half written file; throws std::runtime_error
+void WriteMatrixFile(const std::string& path, const float* rows, size_t rowsNum, size_t dim, const TMatrixFileOptions& options = {});
+void WriteMatrixFile(const std::string& path, const uint8_t* rows, size_t rowsNum, size_t dim, const TMatrixFileOptions& options = {});
+
+struct TMapOptions {
+    // fault all pages in at open, for a matrix that is about to be scanned anyway
+    bool Populate = false;
+    // gathers touch one row per page, readahead only evicts useful pages
+    bool Random = true;
+    bool WillNeed = false;
+    bool HugePages = false;
+};
+
+// read only shared mapping: processes opening the same file share its page cache, open costs no copy
+class TMappedMatrix {
+public:
+    // throws std::runtime_error on io errors and on bad or truncated files
+    explicit TMappedMatrix(const std::string& path, const TMapOptions& options = {});
+    ~TMappedMatrix();
+
+    TMappedMatrix(const TMappedMatrix&) = delete;
+    TMappedMatrix& operator=(const TMappedMatrix&) = delete;
+
+    const TMatrixFileHeader& Header() const {
+        return *static_cast<const TMatrixFileHeader*>(Mapping_);
+    }
+
+    size_t Rows() const {
+        return Header().Rows;
+    }
+
+    size_t Dim() const {
+        return Header().Dim;
+    }
+
+    // stride in elements, the dim to give the kernels as allB is addressed by dim * id
+    size_t KernelDim() const;
+
+    // allB for the float kernels, throws if the file holds another dtype
+    const float* Floats() const;
+    // allB for the packed kernels
+    const uint8_t* Bytes() const;
+
+private:
+    const void* Mapping_ = nullptr;
+    size_t Size_ = 0;
+};
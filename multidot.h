@@ -290,3 +290,197 @@ struct TMultiDotV3_ASM_PREFETCH_AVX512 {
         float* results
     );
 };
+
+// V3 asm with the whole rows of the block Config.Distance blocks ahead prefetched, one line per row
+// in every step of the current block
+struct TMultiDotDeepPrefetchAVX512 {
+    static TPrefetchConfig Config;
+
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        MultiDotProductWith(Config, a, allB, dim, elemsIds, elemsNum, results);
+    }
+
+    static void MultiDotProductWith(
+        const TPrefetchConfig& config,
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+
+// batched: queriesNum queries stored one after another with dim stride, results are queriesNum x elemsNum,
+// results[q * elemsNum + e] is the product of query q and row elemsIds[e]
+
+template<class TMultiDotImpl>
+struct TMultiQueryFromMulti {
+    inline static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        for(size_t q = 0; q < queriesNum; q += 1) {
+            TMultiDotImpl::MultiDotProduct(queries + q * dim, allB, dim, elemsIds, elemsNum, results + q * elemsNum);
+        }
+    }
+};
+
+// tile of QStep queries x Step rows: every gathered row is streamed from memory once per batch,
+// while the tile accumulators stay in registers
+template<size_t QStep, size_t Step>
+struct TMultiQueryCTStep {
+    inline static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        size_t e = 0;
+        for(; e + Step <= elemsNum; e += Step) {
+            const float* rows[Step];
+            for(size_t ee = 0; ee < Step; ee += 1) { //unroll by constexpr size
+                rows[ee] = allB + dim * elemsIds[e + ee];
+            }
+            size_t q = 0;
+            for(; q + QStep <= queriesNum; q += QStep) {
+                float tmp[QStep][Step] = {};
+                const float* left = queries + q * dim;
+                for(size_t i = 0; i < dim; i += 1) {
+                    for(size_t qq = 0; qq < QStep; qq += 1) { //unroll by constexpr size
+                        for(size_t ee = 0; ee < Step; ee += 1) { //unroll by constexpr size
+                            tmp[qq][ee] += left[qq * dim + i] * rows[ee][i];
+                        }
+                    }
+                }
+                for(size_t qq = 0; qq < QStep; qq += 1) {
+                    for(size_t ee = 0; ee < Step; ee += 1) {
+                        results[(q + qq) * elemsNum + e + ee] = tmp[qq][ee];
+                    }
+                }
+            }
+            for(; q < queriesNum; q += 1) {
+                float tmp[Step] = {};
+                const float* left = queries + q * dim;
+                for(size_t i = 0; i < dim; i += 1) {
+                    for(size_t ee = 0; ee < Step; ee += 1) { //unroll by constexpr size
+                        tmp[ee] += left[i] * rows[ee][i];
+                    }
+                }
+                for(size_t ee = 0; ee < Step; ee += 1) {
+                    results[q * elemsNum + e + ee] = tmp[ee];
+                }
+            }
+        }
+        for(; e < elemsNum; e += 1) {
+            const float* row = allB + dim * elemsIds[e];
+            for(size_t q = 0; q < queriesNum; q += 1) {
+                results[q * elemsNum + e] = TNaiveSSE4UnsafeOpt::DotProduct(queries + q * dim, row, dim);
+            }
+        }
+    }
+};
+
+struct TMultiQueryFloatOpts_SSE42 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TMultiQueryFloatOpts_AVX {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TMultiQueryFloatOpts_AVX2 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TMultiQueryFloatOpts_AVX512 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+// 4 queries x 4 rows of zmm accumulators, any dim
+struct TMultiQueryASM_AVX512 {
+    static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+};
+
+struct TMultiDotDetectPointer {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::MultiDotProductImpl(a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
+
+struct TMultiQueryDetectPointer {
+    inline static void MultiQueryDotProduct(
+        const float* queries,
+        size_t queriesNum,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::MultiQueryDotProductImpl(queries, queriesNum, allB, dim, elemsIds, elemsNum, results);
+    }
+};
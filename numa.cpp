@@ -0,0 +1,171 @@
+#include "numa.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// numaif.h comes with libnuma, the syscall itself needs only these
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+namespace {
+    constexpr size_t MaxNodes = 1024;
+    constexpr size_t MaskWordBits = 64;
+
+    // "0-3,8,10-11" as in cpulist and online
+    std::vector<int> ParseList(const std::string& text) {
+        std::vector<int> values;
+        std::stringstream stream(text);
+        std::string range;
+        while (std::getline(stream, range, ',')) {
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+            const size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int value = first; value <= last; value += 1) {
+                values.push_back(value);
+            }
+        }
+        return values;
+    }
+
+    bool ReadLine(const std::string& path, std::string& line) {
+        std::ifstream file(path);
+        return bool(std::getline(file, line));
+    }
+
+    std::vector<int> AffinityCpus() {
+        cpu_set_t set;
+        std::vector<int> cpus;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for(int cpu = 0; cpu < CPU_SETSIZE; cpu += 1) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if (cpus.empty()) {
+            cpus.push_back(0);
+        }
+        return cpus;
+    }
+
+    bool SetPolicy(void* data, size_t size, int mode, const std::vector<int>& nodeIds) {
+        unsigned long mask[MaxNodes / MaskWordBits] = {};
+        for(int node : nodeIds) {
+            if (node < 0 || size_t(node) >= MaxNodes) {
+                return false;
+            }
+            mask[node / MaskWordBits] |= 1ul << (node % MaskWordBits);
+        }
+        return syscall(SYS_mbind, data, size, mode, mask, MaxNodes, 0) == 0;
+    }
+}
+
+TNumaTopology TNumaTopology::Detect() {
+    const std::vector<int> allowed = AffinityCpus();
+    TNumaTopology topology;
+    std::string online;
+    if (ReadLine("/sys/devices/system/node/online", online)) {
+        for(int node : ParseList(online)) {
+            std::string cpuList;
+            if (!ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpuList)) {
+                continue;
+            }
+            std::vector<int> cpus;
+            for(int cpu : ParseList(cpuList)) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                    cpus.push_back(cpu);
+                }
+            }
+            // memory only nodes and nodes outside of the affinity mask have nobody to read them locally
+            if (!cpus.empty()) {
+                topology.NodeCpus.push_back(std::move(cpus));
+                topology.NodeIds.push_back(node);
+            }
+        }
+    }
+    if (topology.NodeCpus.empty()) {
+        topology.NodeCpus.push_back(allowed);
+        topology.NodeIds.assign(1, 0);
+    }
+    return topology;
+}
+
+TNumaTopology TNumaTopology::Simulate(size_t nodesNum) {
+    const std::vector<int> cpus = Detect().Cpus();
+    nodesNum = std::max<size_t>(nodesNum, 1);
+    TNumaTopology topology;
+    topology.NodeCpus.resize(nodesNum);
+    for(size_t node = 0; node < nodesNum; node += 1) {
+        const size_t begin = cpus.size() * node / nodesNum;
+        const size_t end = cpus.size() * (node + 1) / nodesNum;
+        topology.NodeCpus[node].assign(cpus.begin() + begin, cpus.begin() + end);
+        // fewer cpus than nodes: fake nodes share them so every node still has a thread
+        if (begin == end) {
+            topology.NodeCpus[node].push_back(cpus[node % cpus.size()]);
+        }
+    }
+    return topology;
+}
+
+std::vector<int> TNumaTopology::Cpus() const {
+    std::vector<int> cpus;
+    for(const auto& nodeCpus : NodeCpus) {
+        cpus.insert(cpus.end(), nodeCpus.begin(), nodeCpus.end());
+    }
+    return cpus;
+}
+
+size_t TNumaTopology::NodeOfCpu(int cpu) const {
+    for(size_t node = 0; node < NodeCpus.size(); node += 1) {
+        if (std::find(NodeCpus[node].begin(), NodeCpus[node].end(), cpu) != NodeCpus[node].end()) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+TPinnedScope::TPinnedScope(int cpu) {
+    if (pthread_getaffinity_np(pthread_self(), sizeof(Previous_), &Previous_) != 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    Restore_ = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+TPinnedScope::~TPinnedScope() {
+    if (Restore_) {
+        pthread_setaffinity_np(pthread_self(), sizeof(Previous_), &Previous_);
+    }
+}
+
+bool BindToNode(void* data, size_t size, int nodeId) {
+    return SetPolicy(data, size, MPOL_BIND, {nodeId});
+}
+
+bool InterleaveOnNodes(void* data, size_t size, const std::vector<int>& nodeIds) {
+    return SetPolicy(data, size, MPOL_INTERLEAVE, nodeIds);
+}
+
+const char* ToString(ENumaPlacement placement) {
+    switch (placement) {
+        case ENumaPlacement::FirstTouch: return "first-touch";
+        case ENumaPlacement::Interleave: return "interleave";
+        case ENumaPlacement::Replicate: return "replicate";
+        case ENumaPlacement::Shard: return "shard";
+    }
+    return "unknown";
+}
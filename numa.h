@@ -0,0 +1,300 @@
+#pragma once
+
+#include "aligned_matrix.h"
+#include "parallel.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// cpus of every memory node usable by the process, read from /sys without libnuma. A simulated topology
+// splits the cpus into fake nodes: memory is not bound, but row routing and the remote access accounting
+// behave as on a real host with that many nodes
+struct TNumaTopology {
+    std::vector<std::vector<int>> NodeCpus;
+    // node numbers for mbind, empty for a simulated topology
+    std::vector<int> NodeIds;
+
+    // one node of all the affinity cpus if /sys/devices/system/node is not there
+    static TNumaTopology Detect();
+    static TNumaTopology Simulate(size_t nodesNum);
+
+    size_t NodesNum() const {
+        return NodeCpus.size();
+    }
+
+    bool Simulated() const {
+        return NodeIds.empty();
+    }
+
+    // node by node, the order pool threads are pinned in
+    std::vector<int> Cpus() const;
+    // node of the cpu or 0 if it is not in the topology
+    size_t NodeOfCpu(int cpu) const;
+};
+
+// pins the calling thread to a cpu, the previous affinity is restored on exit
+class TPinnedScope {
+public:
+    explicit TPinnedScope(int cpu);
+    ~TPinnedScope();
+
+private:
+    cpu_set_t Previous_;
+    bool Restore_ = false;
+};
+
+// memory policy of a not yet touched range, false if the kernel refused it (no NUMA support, wrong node)
+bool BindToNode(void* data, size_t size, int nodeId);
+bool InterleaveOnNodes(void* data, size_t size, const std::vector<int>& nodeIds);
+
+enum class ENumaPlacement {
+    // one copy wherever the constructing thread runs
+    FirstTouch,
+    // one copy, pages round robin over all nodes
+    Interleave,
+    // a full copy per node, every thread reads its own
+    Replicate,
+    // contiguous row ranges, one per node, ids are routed to the threads of the owning node
+    Shard,
+};
+
+const char* ToString(ENumaPlacement placement);
+
+template<class T>
+class TNumaMatrix {
+public:
+    // granularity of MPOL_INTERLEAVE, the interleaved copy is kept on small pages to get it
+    static constexpr size_t InterleavePage = 4096;
+
+    TNumaMatrix(const T* rows, size_t rowsNum, size_t dim, const TNumaTopology& topology, ENumaPlacement placement)
+        : Dim_(dim)
+        , Placement_(placement)
+        , Nodes_(topology.NodesNum())
+    {
+        const size_t rowBytes = dim * sizeof(T);
+        ShardBegins_.assign(Nodes_ + 1, rowsNum);
+        ShardBegins_[0] = 0;
+        if (placement == ENumaPlacement::Shard) {
+            for(size_t node = 1; node < Nodes_; node += 1) {
+                ShardBegins_[node] = rowsNum * node / Nodes_;
+            }
+        }
+
+        const bool bind = !topology.Simulated();
+        Bound_ = bind;
+        const size_t copies = placement == ENumaPlacement::Replicate || placement == ENumaPlacement::Shard ? Nodes_ : 1;
+        for(size_t copy = 0; copy < copies; copy += 1) {
+            const size_t begin = ShardBegins_[placement == ENumaPlacement::Shard ? copy : 0];
+            const size_t end = placement == ENumaPlacement::Shard ? ShardBegins_[copy + 1] : rowsNum;
+            const size_t size = std::max<size_t>((end - begin) * rowBytes, 1);
+            THugePageBuffer buffer(size, placement == ENumaPlacement::Interleave ? EPageBacking::Small : EPageBacking::Transparent);
+            if (bind && placement == ENumaPlacement::Interleave) {
+                Bound_ &= InterleaveOnNodes(buffer.Data(), size, topology.NodeIds);
+            } else if (bind && placement != ENumaPlacement::FirstTouch) {
+                Bound_ &= BindToNode(buffer.Data(), size, topology.NodeIds[copy]);
+            }
+            // the policy applies at the first write, so it has to be set before the copy
+            std::memcpy(buffer.Data(), rows + begin * dim, (end - begin) * rowBytes);
+            Buffers_.push_back(std::move(buffer));
+        }
+        FirstTouchNode_ = placement == ENumaPlacement::FirstTouch ? topology.NodeOfCpu(sched_getcpu()) : 0;
+    }
+
+    size_t Dim() const {
+        return Dim_;
+    }
+
+    ENumaPlacement Placement() const {
+        return Placement_;
+    }
+
+    size_t NodesNum() const {
+        return Nodes_;
+    }
+
+    // every memory policy was accepted, always false on a simulated topology
+    bool Bound() const {
+        return Bound_ && Placement_ != ENumaPlacement::FirstTouch;
+    }
+
+    // rows a thread of the node reads: its replica, its shard (addressed by id - ShardBegin(node)) or the only copy
+    const T* NodeRows(size_t node) const {
+        const size_t copy = Buffers_.size() == 1 ? 0 : node;
+        return static_cast<const T*>(Buffers_[copy].Data());
+    }
+
+    size_t ShardBegin(size_t node) const {
+        return ShardBegins_[node];
+    }
+
+    size_t ShardEnd(size_t node) const {
+        return ShardBegins_[node + 1];
+    }
+
+    size_t OwnerNode(uint32_t id) const {
+        return std::upper_bound(ShardBegins_.begin() + 1, ShardBegins_.end() - 1, size_t(id)) - ShardBegins_.begin() - 1;
+    }
+
+    // node whose memory holds the row the reader node scores
+    size_t MemoryNode(size_t reader, uint32_t id) const {
+        switch (Placement_) {
+            case ENumaPlacement::FirstTouch: return FirstTouchNode_;
+            // the kernel interleaves anonymous memory by the virtual page number, so the page of the row start
+            // tells the node, wherever the buffer begins
+            case ENumaPlacement::Interleave:
+                return reinterpret_cast<uintptr_t>(NodeRows(0) + size_t(id) * Dim_) / InterleavePage % Nodes_;
+            case ENumaPlacement::Replicate: return reader;
+            case ENumaPlacement::Shard: return OwnerNode(id);
+        }
+        return 0;
+    }
+
+private:
+    size_t Dim_;
+    ENumaPlacement Placement_;
+    size_t Nodes_;
+    size_t FirstTouchNode_ = 0;
+    bool Bound_ = false;
+    std::vector<size_t> ShardBegins_;
+    std::vector<THugePageBuffer> Buffers_;
+};
+
+// a float MultiDotProduct over a TNumaMatrix on a pool pinned node by node. Sharded ids are bucketed by owner,
+// so chunks never cross a shard; the chunks of a shard start on the workers of the owning node and are stolen only
+// among them, whatever the skew of the ids. Remote rows are left to the other placements (and to a call of a single
+// chunk, which runs on the calling thread)
+template<class TMultiDotImpl>
+class TNumaMultiDot {
+public:
+    struct TAccessStats {
+        uint64_t Local = 0;
+        uint64_t Remote = 0;
+
+        double RemoteRatio() const {
+            return Local + Remote ? double(Remote) / double(Local + Remote) : 0.0;
+        }
+    };
+
+    // the caller thread takes worker 0, pin it to topology.Cpus()[0] with TPinnedScope for stable numbers
+    TNumaMultiDot(const TNumaMatrix<float>& matrix, const TNumaTopology& topology)
+        : Matrix_(matrix)
+        , Pool_(topology.Cpus())
+    {
+        for(size_t node = 0; node < topology.NodesNum(); node += 1) {
+            WorkerNode_.insert(WorkerNode_.end(), topology.NodeCpus[node].size(), node);
+            NodeWorkers_.push_back(topology.NodeCpus[node].size());
+        }
+        // a shard is scored by the workers of its node, stealing stays in the node
+        ShardRanges_.Groups = WorkerNode_;
+    }
+
+    void MultiDotProduct(const float* a, const uint32_t* elemsIds, size_t elemsNum, float* results) {
+        const size_t dim = Matrix_.Dim();
+        const size_t chunkRows = ParallelChunkRows(dim * sizeof(float));
+        if (Matrix_.Placement() != ENumaPlacement::Shard) {
+            Pool_.ParallelFor(elemsNum, chunkRows, [&](size_t begin, size_t end) {
+                const size_t node = WorkerNode_[TWorkStealingPool::CurrentWorker()];
+                TMultiDotImpl::MultiDotProduct(a, Matrix_.NodeRows(node), dim, elemsIds + begin, end - begin, results + begin);
+                size_t remote = 0;
+                for(size_t i = begin; i < end; i += 1) {
+                    remote += Matrix_.MemoryNode(node, elemsIds[i]) != node;
+                }
+                Count(end - begin - remote, remote);
+            });
+            return;
+        }
+
+        Route(elemsIds, elemsNum, chunkRows);
+        Scores_.resize(elemsNum);
+        Pool_.ParallelFor(Chunks_.size(), 1, ShardRanges_, [&](size_t chunkBegin, size_t chunkEnd) {
+            const size_t node = WorkerNode_[TWorkStealingPool::CurrentWorker()];
+            for(size_t c = chunkBegin; c < chunkEnd; c += 1) {
+                const TChunk& chunk = Chunks_[c];
+                const size_t n = chunk.End - chunk.Begin;
+                TMultiDotImpl::MultiDotProduct(
+                    a, Matrix_.NodeRows(chunk.Node), dim, LocalIds_.data() + chunk.Begin, n, Scores_.data() + chunk.Begin
+                );
+                for(size_t i = chunk.Begin; i < chunk.End; i += 1) {
+                    results[Positions_[i]] = Scores_[i];
+                }
+                Count(chunk.Node == node ? n : 0, chunk.Node == node ? 0 : n);
+            }
+        });
+    }
+
+    TAccessStats Stats() const {
+        return {Local_.load(std::memory_order_relaxed), Remote_.load(std::memory_order_relaxed)};
+    }
+
+    void ResetStats() {
+        Local_.store(0, std::memory_order_relaxed);
+        Remote_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct TChunk {
+        size_t Begin;
+        size_t End;
+        size_t Node;
+    };
+
+    // counting sort of ids by owner node, remembering where each score goes back to
+    void Route(const uint32_t* elemsIds, size_t elemsNum, size_t chunkRows) {
+        const size_t nodes = Matrix_.NodesNum();
+        std::vector<size_t> offsets(nodes + 1, 0);
+        Owners_.resize(elemsNum);
+        for(size_t i = 0; i < elemsNum; i += 1) {
+            Owners_[i] = Matrix_.OwnerNode(elemsIds[i]);
+            offsets[Owners_[i] + 1] += 1;
+        }
+        for(size_t node = 0; node < nodes; node += 1) {
+            offsets[node + 1] += offsets[node];
+        }
+        Chunks_.clear();
+        ShardRanges_.Starts.assign(1, 0);
+        for(size_t node = 0; node < nodes; node += 1) {
+            const size_t nodeBegin = Chunks_.size();
+            for(size_t begin = offsets[node]; begin < offsets[node + 1]; begin += chunkRows) {
+                Chunks_.push_back({begin, std::min(offsets[node + 1], begin + chunkRows), node});
+            }
+            // the chunks of the node split evenly over its own workers only
+            const size_t workers = NodeWorkers_[node];
+            for(size_t w = 1; w <= workers; w += 1) {
+                ShardRanges_.Starts.push_back(nodeBegin + (Chunks_.size() - nodeBegin) * w / workers);
+            }
+        }
+        LocalIds_.resize(elemsNum);
+        Positions_.resize(elemsNum);
+        for(size_t i = 0; i < elemsNum; i += 1) {
+            const size_t pos = offsets[Owners_[i]]++;
+            LocalIds_[pos] = elemsIds[i] - uint32_t(Matrix_.ShardBegin(Owners_[i]));
+            Positions_[pos] = uint32_t(i);
+        }
+    }
+
+    void Count(uint64_t local, uint64_t remote) {
+        Local_.fetch_add(local, std::memory_order_relaxed);
+        Remote_.fetch_add(remote, std::memory_order_relaxed);
+    }
+
+    const TNumaMatrix<float>& Matrix_;
+    TWorkStealingPool Pool_;
+    std::vector<size_t> WorkerNode_;
+    std::vector<size_t> NodeWorkers_;
+    TWorkStealingPool::TWorkerRanges ShardRanges_;
+
+    std::vector<uint32_t> Owners_;
+    std::vector<uint32_t> LocalIds_;
+    std::vector<uint32_t> Positions_;
+    std::vector<float> Scores_;
+    std::vector<TChunk> Chunks_;
+
+    std::atomic<uint64_t> Local_{0};
+    std::atomic<uint64_t> Remote_{0};
+};
@@ -0,0 +1,236 @@
+#include "parallel.h"
+
+#include <immintrin.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <stdexcept>
+
+namespace {
+    inline uint64_t Pack(uint32_t begin, uint32_t end) {
+        return uint64_t(begin) | (uint64_t(end) << 32);
+    }
+
+    inline uint32_t Begin(uint64_t packed) {
+        return uint32_t(packed);
+    }
+
+    inline uint32_t End(uint64_t packed) {
+        return uint32_t(packed >> 32);
+    }
+
+    // calls are a few ms apart in a serving loop, spinning that long before sleeping
+    // saves the futex wake up on the next call
+    constexpr size_t SpinIterations = 1u << 14;
+
+    thread_local size_t CurrentWorkerId = 0;
+    // the pool whose chunk the thread is running now, nullptr outside of them
+    thread_local const TWorkStealingPool* CurrentPool = nullptr;
+
+    // the thread runs chunks of pool as worker id until the scope ends, then is again whatever it was before:
+    // a chunk of one pool may call into another one
+    class TWorkerScope {
+    public:
+        TWorkerScope(const TWorkStealingPool* pool, size_t id)
+            : PreviousPool_(CurrentPool)
+            , PreviousId_(CurrentWorkerId)
+        {
+            CurrentPool = pool;
+            CurrentWorkerId = id;
+        }
+
+        ~TWorkerScope() {
+            CurrentPool = PreviousPool_;
+            CurrentWorkerId = PreviousId_;
+        }
+
+    private:
+        const TWorkStealingPool* PreviousPool_;
+        size_t PreviousId_;
+    };
+
+    void RunInline(size_t n, size_t chunkSize, TWorkStealingPool::TTaskFunc func, void* ctx) {
+        for(size_t begin = 0; begin < n; begin += chunkSize) {
+            func(ctx, begin, std::min(n, begin + chunkSize));
+        }
+    }
+}
+
+TWorkStealingPool::TWorkStealingPool(size_t threadsNum)
+    : Ranges_(new TRange[std::max<size_t>(threadsNum, 1)])
+{
+    for(size_t id = 1; id < threadsNum; id += 1) {
+        Workers_.emplace_back([this, id] {
+            WorkerLoop(id);
+        });
+    }
+}
+
+TWorkStealingPool::TWorkStealingPool(const std::vector<int>& cpus)
+    : Ranges_(new TRange[std::max<size_t>(cpus.size(), 1)])
+{
+    for(size_t id = 1; id < cpus.size(); id += 1) {
+        Workers_.emplace_back([this, id, cpu = cpus[id]] {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            // best effort: a cpu outside of the affinity mask leaves the thread floating
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            WorkerLoop(id);
+        });
+    }
+}
+
+TWorkStealingPool::~TWorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Stop_ = true;
+        Generation_.fetch_add(1, std::memory_order_release);
+    }
+    WakeUp_.notify_all();
+    for(auto& worker : Workers_) {
+        worker.join();
+    }
+}
+
+TWorkStealingPool& TWorkStealingPool::Default() {
+    static TWorkStealingPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+size_t TWorkStealingPool::CurrentWorker() {
+    return CurrentWorkerId;
+}
+
+void TWorkStealingPool::Run(size_t n, size_t chunkSize, TTaskFunc func, void* ctx, const TWorkerRanges* ranges) {
+    if (n == 0) {
+        return;
+    }
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    const size_t chunks = (n + chunkSize - 1) / chunkSize;
+    const size_t threads = ThreadsNum();
+    // waiting for the call mutex here would be waiting for ourselves
+    if (CurrentPool == this) {
+        RunInline(n, chunkSize, func, ctx);
+        return;
+    }
+    if (threads == 1 || chunks == 1) {
+        const TWorkerScope scope(this, 0);
+        RunInline(n, chunkSize, func, ctx);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call(CallMutex_);
+    // contiguous ranges keep neighbour ids on one core, stealing only fixes the imbalance
+    if (ranges != nullptr && (ranges->Starts.size() != threads + 1 || ranges->Starts.back() != chunks
+        || ranges->Groups.size() != threads))
+    {
+        throw std::invalid_argument("worker ranges do not match the pool and the chunks");
+    }
+    for(size_t id = 0; id < threads; id += 1) {
+        const size_t begin = ranges ? ranges->Starts[id] : chunks * id / threads;
+        const size_t end = ranges ? ranges->Starts[id + 1] : chunks * (id + 1) / threads;
+        Ranges_[id].Packed.store(Pack(begin, end), std::memory_order_relaxed);
+    }
+    Groups_ = ranges ? ranges->Groups.data() : nullptr;
+    Func_ = func;
+    Ctx_ = ctx;
+    N_ = n;
+    ChunkSize_ = chunkSize;
+    Busy_.store(Workers_.size(), std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Generation_.fetch_add(1, std::memory_order_release);
+    }
+    WakeUp_.notify_all();
+
+    Work(0);
+    // the job state must stay untouched until every worker has left it
+    while (Busy_.load(std::memory_order_acquire) != 0) {
+        _mm_pause();
+    }
+}
+
+void TWorkStealingPool::WorkerLoop(size_t id) {
+    uint64_t seen = 0;
+    while (true) {
+        size_t spin = 0;
+        while (Generation_.load(std::memory_order_acquire) == seen && spin < SpinIterations) {
+            _mm_pause();
+            spin += 1;
+        }
+        if (Generation_.load(std::memory_order_acquire) == seen) {
+            std::unique_lock<std::mutex> guard(Mutex_);
+            WakeUp_.wait(guard, [&] {
+                return Generation_.load(std::memory_order_acquire) != seen;
+            });
+        }
+        seen = Generation_.load(std::memory_order_acquire);
+        {
+            std::lock_guard<std::mutex> guard(Mutex_);
+            if (Stop_) {
+                return;
+            }
+        }
+        Work(id);
+        Busy_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void TWorkStealingPool::Work(size_t id) {
+    const TWorkerScope scope(this, id);
+    uint32_t chunk = 0;
+    while (PopOwn(id, chunk) || Steal(id, chunk)) {
+        const size_t begin = size_t(chunk) * ChunkSize_;
+        Func_(Ctx_, begin, std::min(N_, begin + ChunkSize_));
+    }
+}
+
+bool TWorkStealingPool::PopOwn(size_t id, uint32_t& chunk) {
+    std::atomic<uint64_t>& range = Ranges_[id].Packed;
+    uint64_t packed = range.load(std::memory_order_acquire);
+    while (Begin(packed) < End(packed)) {
+        if (range.compare_exchange_weak(packed, Pack(Begin(packed) + 1, End(packed)), std::memory_order_acq_rel)) {
+            chunk = Begin(packed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TWorkStealingPool::Steal(size_t id, uint32_t& chunk) {
+    const size_t threads = ThreadsNum();
+    while (true) {
+        size_t victim = threads;
+        uint32_t victimSize = 0;
+        for(size_t i = 1; i < threads; i += 1) {
+            const size_t other = (id + i) % threads;
+            if (Groups_ != nullptr && Groups_[other] != Groups_[id]) {
+                continue;
+            }
+            const uint64_t packed = Ranges_[other].Packed.load(std::memory_order_acquire);
+            if (Begin(packed) < End(packed) && End(packed) - Begin(packed) > victimSize) {
+                victim = other;
+                victimSize = End(packed) - Begin(packed);
+            }
+        }
+        if (victim == threads) {
+            return false;
+        }
+
+        // the upper half goes away, the owner keeps popping from the front
+        std::atomic<uint64_t>& range = Ranges_[victim].Packed;
+        uint64_t packed = range.load(std::memory_order_acquire);
+        if (Begin(packed) >= End(packed)) {
+            continue;
+        }
+        const uint32_t mid = Begin(packed) + (End(packed) - Begin(packed)) / 2;
+        if (!range.compare_exchange_strong(packed, Pack(Begin(packed), mid), std::memory_order_acq_rel)) {
+            continue;
+        }
+        // own range is empty here, nobody else writes it
+        Ranges_[id].Packed.store(Pack(mid + 1, End(packed)), std::memory_order_release);
+        chunk = mid;
+        return true;
+    }
+}
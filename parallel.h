@@ -0,0 +1,167 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// persistent pool, threads sleep between calls. A call cuts [0, n) into chunks, every thread gets
+// a contiguous range of them and when its own range is over steals half of the biggest remaining one
+class TWorkStealingPool {
+public:
+    using TTaskFunc = void (*)(void* ctx, size_t begin, size_t end);
+
+    // threadsNum includes the calling thread, so 1 means no extra threads
+    explicit TWorkStealingPool(size_t threadsNum);
+
+    // a thread per cpu, worker i > 0 pinned to cpus[i]; cpus[0] is for the calling thread, which the pool
+    // does not pin, see TPinnedScope in numa.h
+    explicit TWorkStealingPool(const std::vector<int>& cpus);
+    ~TWorkStealingPool();
+
+    size_t ThreadsNum() const {
+        return Workers_.size() + 1;
+    }
+
+    // where the chunks of a call start and who may take them over, instead of the even split
+    struct TWorkerRanges {
+        // worker id starts with chunks [Starts[id], Starts[id + 1]), ThreadsNum() + 1 ascending entries from 0 to
+        // the number of chunks
+        std::vector<size_t> Starts;
+        // a worker steals only from the workers of its own group, an entry per worker
+        std::vector<size_t> Groups;
+    };
+
+    // calls func(ctx, begin, end) for every chunk and returns when all of them are done. Concurrent calls
+    // wait for each other, a call made from a chunk of the same pool runs its chunks inline
+    void Run(size_t n, size_t chunkSize, TTaskFunc func, void* ctx, const TWorkerRanges* ranges = nullptr);
+
+    template<class TFunc>
+    void ParallelFor(size_t n, size_t chunkSize, TFunc&& func) {
+        Run(n, chunkSize, Trampoline<TFunc>, &func);
+    }
+
+    // chunks of chunkSize placed by ranges
+    template<class TFunc>
+    void ParallelFor(size_t n, size_t chunkSize, const TWorkerRanges& ranges, TFunc&& func) {
+        Run(n, chunkSize, Trampoline<TFunc>, &func, &ranges);
+    }
+
+    // hardware_concurrency threads, created on first use
+    static TWorkStealingPool& Default();
+
+    // index of the pool thread running the current chunk, 0 for the calling thread
+    static size_t CurrentWorker();
+
+private:
+    template<class TFunc>
+    static void Trampoline(void* ctx, size_t begin, size_t end) {
+        (*static_cast<std::remove_reference_t<TFunc>*>(ctx))(begin, end);
+    }
+
+    // [begin, end) of chunk indexes packed in one word, so the owner and thieves agree by a single CAS
+    struct alignas(64) TRange {
+        std::atomic<uint64_t> Packed{0};
+    };
+
+    void WorkerLoop(size_t id);
+    void Work(size_t id);
+    bool PopOwn(size_t id, uint32_t& chunk);
+    bool Steal(size_t id, uint32_t& chunk);
+
+    std::vector<std::thread> Workers_;
+    std::unique_ptr<TRange[]> Ranges_;
+
+    // held by the running call, the job state below belongs to it
+    std::mutex CallMutex_;
+
+    std::mutex Mutex_;
+    std::condition_variable WakeUp_;
+    std::atomic<uint64_t> Generation_{0};
+    bool Stop_ = false;
+
+    TTaskFunc Func_ = nullptr;
+    void* Ctx_ = nullptr;
+    size_t N_ = 0;
+    size_t ChunkSize_ = 0;
+    // steal groups of the running call, nullptr when anyone steals from anyone
+    const size_t* Groups_ = nullptr;
+    std::atomic<size_t> Busy_{0};
+};
+
+// rows per chunk: a chunk of gathered rows takes about 256 KB (half of a typical L2),
+// rounded to 16 rows so row blocking kernels keep full blocks and result writes do not share cache lines
+inline size_t ParallelChunkRows(size_t rowBytes) {
+    constexpr size_t ChunkBytes = 256 * 1024;
+    constexpr size_t RowsAlign = 16;
+    const size_t rows = ChunkBytes / std::max<size_t>(rowBytes, 1);
+    return std::max(RowsAlign, rows / RowsAlign * RowsAlign);
+}
+
+// any MultiDotProduct from multidot.h as the inner loop over chunks of elemsIds
+template<class TMultiDotImpl>
+struct TParallelMultiDot {
+    static void MultiDotProductOn(
+        TWorkStealingPool& pool,
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        pool.ParallelFor(elemsNum, ParallelChunkRows(dim * sizeof(float)), [&](size_t begin, size_t end) {
+            TMultiDotImpl::MultiDotProduct(a, allB, dim, elemsIds + begin, end - begin, results + begin);
+        });
+    }
+
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        MultiDotProductOn(TWorkStealingPool::Default(), a, allB, dim, elemsIds, elemsNum, results);
+    }
+};
+
+// same for the packed kernels from dotpacked.h
+template<class TPackedImpl>
+struct TParallelPackedProduct {
+    static void MultiDotProductOn(
+        TWorkStealingPool& pool,
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        pool.ParallelFor(elemsNum, ParallelChunkRows(dim * sizeof(uint8_t)), [&](size_t begin, size_t end) {
+            TPackedImpl::MultiDotProduct(a, allB, dim, elemsIds + begin, end - begin, bias, coeff, results + begin);
+        });
+    }
+
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        MultiDotProductOn(TWorkStealingPool::Default(), a, allB, dim, elemsIds, elemsNum, bias, coeff, results);
+    }
+};
@@ -0,0 +1,142 @@
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint64_t CacheMiss(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    int Open(uint32_t type, uint64_t config, int groupFd, bool groupRead) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        // the members follow the leader
+        attr.disabled = groupFd < 0;
+        // threads started after the open count into these events, as the pools of the parallel benches
+        attr.inherit = 1;
+        // what perf_event_paranoid 2 still lets an unprivileged process count
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING
+            | (groupRead ? PERF_FORMAT_GROUP : 0);
+        return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+    }
+
+    int OpenEvent(EPerfEvent event, int groupFd, bool groupRead) {
+        switch (event) {
+            case EPerfEvent::Cycles: return Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, groupFd, groupRead);
+            case EPerfEvent::Instructions: return Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, groupFd, groupRead);
+            case EPerfEvent::LlcMisses: {
+                // not every pmu has the generic ll cache event, cache-misses is the llc on x86 as well
+                const int fd = Open(PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_LL), groupFd, groupRead);
+                return fd >= 0 ? fd : Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, groupFd, groupRead);
+            }
+            case EPerfEvent::DtlbMisses: return Open(PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_DTLB), groupFd, groupRead);
+        }
+        return -1;
+    }
+}
+
+const char* ToString(EPerfEvent event) {
+    switch (event) {
+        case EPerfEvent::Cycles: return "cycles";
+        case EPerfEvent::Instructions: return "instructions";
+        case EPerfEvent::LlcMisses: return "llc-misses";
+        case EPerfEvent::DtlbMisses: return "dtlb-misses";
+    }
+    return "unknown";
+}
+
+TPerfCounters::TPerfCounters() {
+    Fds_.fill(-1);
+    Positions_.fill(0);
+    // kernels before 4.13 refuse PERF_FORMAT_GROUP on an inherited event, then every member is read by itself
+    for(bool groupRead : {true, false}) {
+        GroupRead_ = groupRead;
+        size_t position = 0;
+        for(size_t i = 0; i < PerfEventsNum; i += 1) {
+            Fds_[i] = OpenEvent(EPerfEvent(i), Leader(), groupRead);
+            if (Fds_[i] >= 0) {
+                Positions_[i] = position;
+                position += 1;
+            } else if (Leader() < 0 && errno == EINVAL && groupRead) {
+                break;
+            }
+        }
+        if (!groupRead || Leader() >= 0) {
+            break;
+        }
+    }
+}
+
+TPerfCounters::~TPerfCounters() {
+    // members before the leader
+    for(size_t i = PerfEventsNum; i > 0; i -= 1) {
+        if (Fds_[i - 1] >= 0) {
+            close(Fds_[i - 1]);
+        }
+    }
+}
+
+int TPerfCounters::Leader() const {
+    for(int fd : Fds_) {
+        if (fd >= 0) {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+bool TPerfCounters::AnyAvailable() const {
+    return Leader() >= 0;
+}
+
+void TPerfCounters::Start() {
+    if (Leader() >= 0) {
+        ioctl(Leader(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(Leader(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void TPerfCounters::Stop() {
+    if (Leader() >= 0) {
+        ioctl(Leader(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void TPerfCounters::Resume() {
+    if (Leader() >= 0) {
+        ioctl(Leader(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+double TPerfCounters::Value(EPerfEvent event) const {
+    const int fd = Fds_[size_t(event)];
+    if (fd < 0) {
+        return 0;
+    }
+    if (GroupRead_) {
+        // members number, time enabled, time running, then the values in the order of opening
+        uint64_t data[3 + PerfEventsNum] = {};
+        const ssize_t got = read(Leader(), data, sizeof(data));
+        if (got < ssize_t(3 * sizeof(uint64_t)) || Positions_[size_t(event)] >= data[0] || data[2] == 0) {
+            return 0;
+        }
+        return double(data[3 + Positions_[size_t(event)]]) * data[1] / data[2];
+    }
+    // value, time enabled, time running
+    uint64_t data[3] = {};
+    if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+        return 0;
+    }
+    return double(data[0]) * data[1] / data[2];
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class EPerfEvent {
+    Cycles,
+    Instructions,
+    LlcMisses,
+    DtlbMisses,
+};
+
+constexpr size_t PerfEventsNum = 4;
+
+const char* ToString(EPerfEvent event);
+
+// hardware counters of the calling thread and of the threads it starts later, in user space, opened with the bare
+// perf_event_open syscall. The events are one group led by the first that opened (cycles as a rule), so they are
+// scheduled together and share the multiplexing scale. An event the kernel refuses (no pmu in a vm,
+// perf_event_paranoid, an unknown cache event) stays closed and is not Available, the others count anyway
+class TPerfCounters {
+public:
+    TPerfCounters();
+    ~TPerfCounters();
+
+    TPerfCounters(const TPerfCounters&) = delete;
+    TPerfCounters& operator=(const TPerfCounters&) = delete;
+
+    bool Available(EPerfEvent event) const {
+        return Fds_[size_t(event)] >= 0;
+    }
+
+    bool AnyAvailable() const;
+
+    // zeroes and enables the open events
+    void Start();
+    void Stop();
+    // enables them again after a Stop, counting on from where they were
+    void Resume();
+
+    // the count between Start and Stop, scaled by enabled / running time when the kernel had to multiplex
+    // the events onto fewer counters; 0 for an unavailable event
+    double Value(EPerfEvent event) const;
+
+private:
+    int Leader() const;
+
+    std::array<int, PerfEventsNum> Fds_;
+    // index of the value of an event in a read of the group
+    std::array<size_t, PerfEventsNum> Positions_;
+    // one read of the leader gives all values, false when the kernel does not allow it for inherited events
+    bool GroupRead_ = true;
+};
@@ -0,0 +1,153 @@
+#include "pq.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace {
+    float SquaredDistance(const float* a, const float* b, size_t dim) {
+        float res = 0;
+        for(size_t i = 0; i < dim; i += 1) {
+            const float d = a[i] - b[i];
+            res += d * d;
+        }
+        return res;
+    }
+
+    size_t Nearest(const float* x, const float* centroids, size_t subDim) {
+        size_t best = 0;
+        float bestDistance = std::numeric_limits<float>::max();
+        for(size_t c = 0; c < TPqCodebook::Centroids; c += 1) {
+            const float distance = SquaredDistance(x, centroids + c * subDim, subDim);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = c;
+            }
+        }
+        return best;
+    }
+}
+
+TPqCodebook TPqCodebook::Train(const float* rows, size_t rowsNum, size_t dim, size_t subspaces, const TTrainOptions& options) {
+    if (subspaces == 0 || subspaces % 8 != 0 || dim % subspaces != 0) {
+        throw std::invalid_argument("pq subspaces must be a multiple of 8 dividing dim");
+    }
+    if (subspaces > MaxSubspaces) {
+        throw std::invalid_argument("pq subspaces above MaxSubspaces overflow the uint16 sums of the full scan");
+    }
+    if (rowsNum == 0) {
+        throw std::invalid_argument("pq codebook needs rows to train on");
+    }
+    TPqCodebook result;
+    result.Dim_ = dim;
+    result.Subspaces_ = subspaces;
+    const size_t subDim = result.SubDim();
+    result.Centroids_.assign(subspaces * Centroids * subDim, 0.f);
+
+    const size_t samplesNum = std::min(rowsNum, std::max(options.SampleRows, Centroids));
+    std::vector<const float*> samples(samplesNum);
+    for(size_t s = 0; s < samplesNum; s += 1) {
+        samples[s] = rows + s * rowsNum / samplesNum * dim;
+    }
+
+    std::mt19937_64 rng(options.Seed);
+    std::vector<uint8_t> assigned(samplesNum);
+    std::vector<float> sums(Centroids * subDim);
+    std::vector<size_t> counts(Centroids);
+    for(size_t m = 0; m < subspaces; m += 1) {
+        float* centroids = result.Centroids_.data() + m * Centroids * subDim;
+        const size_t offset = m * subDim;
+        // distinct samples while there are enough of them
+        for(size_t c = 0; c < Centroids; c += 1) {
+            const size_t s = samplesNum >= Centroids ? c * samplesNum / Centroids + rng() % (samplesNum / Centroids) : rng() % samplesNum;
+            std::copy(samples[s] + offset, samples[s] + offset + subDim, centroids + c * subDim);
+        }
+        for(size_t iteration = 0; iteration < options.Iterations; iteration += 1) {
+            std::fill(sums.begin(), sums.end(), 0.f);
+            std::fill(counts.begin(), counts.end(), 0);
+            for(size_t s = 0; s < samplesNum; s += 1) {
+                const size_t c = Nearest(samples[s] + offset, centroids, subDim);
+                assigned[s] = c;
+                counts[c] += 1;
+                for(size_t i = 0; i < subDim; i += 1) {
+                    sums[c * subDim + i] += samples[s][offset + i];
+                }
+            }
+            for(size_t c = 0; c < Centroids; c += 1) {
+                if (counts[c] == 0) {
+                    // an empty cluster restarts from a random sample
+                    const size_t s = rng() % samplesNum;
+                    std::copy(samples[s] + offset, samples[s] + offset + subDim, centroids + c * subDim);
+                    continue;
+                }
+                for(size_t i = 0; i < subDim; i += 1) {
+                    centroids[c * subDim + i] = sums[c * subDim + i] / counts[c];
+                }
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<uint8_t> TPqCodebook::Encode(const float* rows, size_t rowsNum) const {
+    const size_t subDim = SubDim();
+    std::vector<uint8_t> codes(rowsNum * CodeBytes(), 0);
+    for(size_t r = 0; r < rowsNum; r += 1) {
+        uint8_t* rowCodes = codes.data() + r * CodeBytes();
+        for(size_t m = 0; m < Subspaces_; m += 1) {
+            const uint8_t code = Nearest(rows + r * Dim_ + m * subDim, Centroid(m, 0), subDim);
+            rowCodes[m / 2] |= m % 2 ? code << 4 : code;
+        }
+    }
+    return codes;
+}
+
+TPqLookup::TPqLookup(const TPqCodebook& codebook, const float* a)
+    : Subspaces(codebook.Subspaces())
+    , CodeBytes(codebook.CodeBytes())
+    , Table(Subspaces * TPqCodebook::Centroids)
+    , Quantized(Subspaces * TPqCodebook::Centroids)
+{
+    const size_t subDim = codebook.SubDim();
+    std::vector<float> minValues(Subspaces);
+    float maxRange = 0;
+    for(size_t m = 0; m < Subspaces; m += 1) {
+        float* table = Table.data() + m * TPqCodebook::Centroids;
+        for(size_t c = 0; c < TPqCodebook::Centroids; c += 1) {
+            const float* centroid = codebook.Centroid(m, c);
+            float res = 0;
+            for(size_t i = 0; i < subDim; i += 1) {
+                res += a[m * subDim + i] * centroid[i];
+            }
+            table[c] = res;
+        }
+        const auto [minIt, maxIt] = std::minmax_element(table, table + TPqCodebook::Centroids);
+        minValues[m] = *minIt;
+        Bias += *minIt;
+        maxRange = std::max(maxRange, *maxIt - *minIt);
+    }
+    Delta = maxRange / 255;
+    const float inv = Delta > 0 ? 1 / Delta : 0.f;
+    for(size_t m = 0; m < Subspaces; m += 1) {
+        for(size_t c = 0; c < TPqCodebook::Centroids; c += 1) {
+            const size_t i = m * TPqCodebook::Centroids + c;
+            Quantized[i] = uint8_t(std::min<long>(255, std::lrint((Table[i] - minValues[m]) * inv)));
+        }
+    }
+}
+
+std::vector<uint8_t> PqFastScanLayout(const uint8_t* codes, size_t rowsNum, size_t subspaces) {
+    const size_t codeBytes = subspaces / 2;
+    const size_t blocksNum = (rowsNum + PqBlockRows - 1) / PqBlockRows;
+    std::vector<uint8_t> blocks(blocksNum * subspaces * 16, 0);
+    for(size_t r = 0; r < rowsNum; r += 1) {
+        const size_t j = r % PqBlockRows;
+        for(size_t m = 0; m < subspaces; m += 1) {
+            const uint8_t code = TPqLookup::Code(codes + r * codeBytes, m);
+            blocks[(r / PqBlockRows * subspaces + m) * 16 + j % 16] |= j < 16 ? code : code << 4;
+        }
+    }
+    return blocks;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// product quantization with 16 centroids per subspace: dim is cut into Subspaces() runs of SubDim() dims,
+// a row is the nearest centroid of every run, 4 bits each.
+// Codes of a row are CodeBytes() bytes, byte k has subspace 2k in the low nibble and 2k + 1 in the high one.
+// Subspaces must be a multiple of 8 (a row is whole dwords for the gathering kernels), divide dim and be at most
+// MaxSubspaces
+class TPqCodebook {
+public:
+    static constexpr size_t Centroids = 16;
+    // 255 * MaxSubspaces fits the uint16 sums of the full scan kernels
+    static constexpr size_t MaxSubspaces = 256;
+
+    struct TTrainOptions {
+        size_t Iterations = 16;
+        // rows the k-means runs on, taken evenly over the matrix
+        size_t SampleRows = 64 * 1024;
+        uint64_t Seed = 42;
+    };
+
+    TPqCodebook() = default;
+
+    // k-means per subspace, throws std::invalid_argument on a bad subspaces number
+    static TPqCodebook Train(const float* rows, size_t rowsNum, size_t dim, size_t subspaces, const TTrainOptions& options);
+
+    static TPqCodebook Train(const float* rows, size_t rowsNum, size_t dim, size_t subspaces) {
+        return Train(rows, rowsNum, dim, subspaces, TTrainOptions());
+    }
+
+    // rowsNum * CodeBytes() bytes
+    std::vector<uint8_t> Encode(const float* rows, size_t rowsNum) const;
+
+    size_t Dim() const {
+        return Dim_;
+    }
+
+    size_t Subspaces() const {
+        return Subspaces_;
+    }
+
+    size_t SubDim() const {
+        return Dim_ / Subspaces_;
+    }
+
+    size_t CodeBytes() const {
+        return Subspaces_ / 2;
+    }
+
+    const float* Centroid(size_t subspace, size_t code) const {
+        return Centroids_.data() + (subspace * Centroids + code) * SubDim();
+    }
+
+private:
+    size_t Dim_ = 0;
+    size_t Subspaces_ = 0;
+    std::vector<float> Centroids_; // [subspace][code][SubDim()]
+};
+
+// per query tables: Table[m][c] = dot(a over subspace m, centroid c of m), and the same in uint8 for the shuffle
+// kernels, Quantized[m][c] = round((Table[m][c] - min of m) / Delta) with one Delta for all subspaces,
+// so a score is Delta * sum of the bytes + Bias
+struct TPqLookup {
+    size_t Subspaces = 0;
+    size_t CodeBytes = 0;
+    std::vector<float> Table;
+    std::vector<uint8_t> Quantized;
+    float Delta = 0;
+    float Bias = 0;
+
+    TPqLookup(const TPqCodebook& codebook, const float* a);
+
+    static uint8_t Code(const uint8_t* codes, size_t subspace) {
+        const uint8_t byte = codes[subspace / 2];
+        return subspace % 2 ? byte >> 4 : byte & 0x0f;
+    }
+
+    // the asymmetric distance with the float table, the reference
+    float Score(const uint8_t* codes) const {
+        float res = 0;
+        for(size_t m = 0; m < Subspaces; m += 1) {
+            res += Table[m * TPqCodebook::Centroids + Code(codes, m)];
+        }
+        return res;
+    }
+
+    // what the shuffle kernels compute
+    float QuantizedScore(const uint8_t* codes) const {
+        uint32_t sum = 0;
+        for(size_t m = 0; m < Subspaces; m += 1) {
+            sum += Quantized[m * TPqCodebook::Centroids + Code(codes, m)];
+        }
+        return Delta * sum + Bias;
+    }
+};
+
+// codes of PqBlockRows rows regrouped for a full scan: per subspace 16 bytes, byte j has the code of row j in
+// the low nibble and of row 16 + j in the high one. One vpshufb of the subspace table then scores 16 rows,
+// the last block is padded by zero codes
+constexpr size_t PqBlockRows = 32;
+
+std::vector<uint8_t> PqFastScanLayout(const uint8_t* codes, size_t rowsNum, size_t subspaces);
+
+inline uint8_t PqBlockCode(const uint8_t* blocks, size_t subspaces, size_t row, size_t subspace) {
+    const size_t j = row % PqBlockRows;
+    const uint8_t byte = blocks[(row / PqBlockRows * subspaces + subspace) * 16 + j % 16];
+    return j < 16 ? byte & 0x0f : byte >> 4;
+}
+
+struct TPqProductNaive {
+    inline static void MultiDotProduct(
+        const TPqLookup& lookup,
+        const uint8_t* codes,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            results[e] = lookup.Score(codes + lookup.CodeBytes * elemsIds[e]);
+        }
+    }
+
+    inline static void FullScan(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results) {
+        for(size_t r = 0; r < rowsNum; r += 1) {
+            float res = 0;
+            for(size_t m = 0; m < lookup.Subspaces; m += 1) {
+                res += lookup.Table[m * TPqCodebook::Centroids + PqBlockCode(blocks, lookup.Subspaces, r, m)];
+            }
+            results[r] = res;
+        }
+    }
+};
+
+// MultiDotProduct gathers a dword of codes (8 subspaces) per row, 8 rows per step, and looks the nibbles up
+// by vpshufb with the subspace table broadcast to every lane. FullScan runs over PqFastScanLayout
+struct TPqProductAvx2 {
+    static void MultiDotProduct(
+        const TPqLookup& lookup,
+        const uint8_t* codes,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+
+    static void FullScan(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results);
+};
+
+// the same with 16 rows per gathering step and 4 subspace tables per full scan shuffle
+struct TPqProductAvx512 {
+    static void MultiDotProduct(
+        const TPqLookup& lookup,
+        const uint8_t* codes,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    );
+
+    static void FullScan(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results);
+};
+
+struct TPqProductDetectPointer {
+    inline static void MultiDotProduct(
+        const TPqLookup& lookup,
+        const uint8_t* codes,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        TRuntimeCpuInfoDispatch::PqMultiDotProductImpl(lookup, codes, elemsIds, elemsNum, results);
+    }
+
+    // blocks of PqFastScanLayout
+    inline static void FullScan(const TPqLookup& lookup, const uint8_t* blocks, size_t rowsNum, float* results) {
+        TRuntimeCpuInfoDispatch::PqFullScanImpl(lookup, blocks, rowsNum, results);
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <algorithm>
+#include <vector>
+
+// candidate ids in memory order: radix sorted by row with the position in the caller's order kept
+// next to every id, duplicates merged so every row is read once. Maximal runs of adjacent rows are found on the way:
+// in this order a run is already one ascending stream of addresses to the kernel
+class TLocalityOrder {
+public:
+    void Build(const uint32_t* elemsIds, size_t elemsNum) {
+        Keys_.resize(elemsNum);
+        uint32_t maxId = 0;
+        for(size_t e = 0; e < elemsNum; e += 1) {
+            Keys_[e] = (uint64_t(elemsIds[e]) << 32) | e;
+            maxId = std::max(maxId, elemsIds[e]);
+        }
+        RadixSort(maxId);
+
+        Ids_.clear();
+        RunsNum_ = 0;
+        for(size_t k = 0; k < Keys_.size(); k += 1) {
+            const uint32_t id = Keys_[k] >> 32;
+            if (!Ids_.empty() && Ids_.back() == id) {
+                continue;
+            }
+            RunsNum_ += Ids_.empty() || Ids_.back() + 1 != id;
+            Ids_.push_back(id);
+        }
+    }
+
+    const uint32_t* Ids() const {
+        return Ids_.data();
+    }
+
+    // distinct rows
+    size_t Size() const {
+        return Ids_.size();
+    }
+
+    // maximal groups of adjacent rows, Size() / RunsNum() is the mean length of a stream
+    size_t RunsNum() const {
+        return RunsNum_;
+    }
+
+    // sorted[i] is the result for Ids()[i], writes it to every position the row had in the caller's order
+    void Scatter(const float* sorted, float* results) const {
+        size_t unique = 0;
+        for(size_t k = 0; k < Keys_.size(); k += 1) {
+            unique += k > 0 && (Keys_[k] >> 32) != (Keys_[k - 1] >> 32);
+            results[uint32_t(Keys_[k])] = sorted[unique];
+        }
+    }
+
+private:
+    // lsd by 11 bits of the id, only as many passes as the largest id needs
+    void RadixSort(uint32_t maxId) {
+        constexpr size_t Bits = 11;
+        constexpr size_t Buckets = 1u << Bits;
+        Tmp_.resize(Keys_.size());
+        for(size_t shift = 32; shift < 64 && (maxId >> (shift - 32)) != 0; shift += Bits) {
+            size_t offsets[Buckets] = {};
+            for(uint64_t key : Keys_) {
+                offsets[(key >> shift) & (Buckets - 1)] += 1;
+            }
+            size_t sum = 0;
+            for(size_t b = 0; b < Buckets; b += 1) {
+                std::swap(sum, offsets[b]);
+                sum += offsets[b];
+            }
+            for(uint64_t key : Keys_) {
+                Tmp_[offsets[(key >> shift) & (Buckets - 1)]++] = key;
+            }
+            Keys_.swap(Tmp_);
+        }
+    }
+
+    std::vector<uint64_t> Keys_;
+    std::vector<uint64_t> Tmp_;
+    std::vector<uint32_t> Ids_;
+    size_t RunsNum_ = 0;
+};
+
+// opt-in: pays the sort and the scatter to walk the matrix in address order, so the gathers hit open
+// dram pages and the tlb. A run of adjacent rows is streamed contiguously by the sorted order itself: the kernel
+// reads it at ascending addresses with no gap, which is what the hardware prefetcher follows, so a separate
+// contiguous kernel per run would read the same lines in the same order
+template<class TMultiDotImpl>
+struct TReorderedMultiDot {
+    inline static void MultiDotProduct(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float* results
+    ) {
+        static thread_local TLocalityOrder order;
+        static thread_local std::vector<float> sorted;
+        order.Build(elemsIds, elemsNum);
+        sorted.resize(order.Size());
+        TMultiDotImpl::MultiDotProduct(a, allB, dim, order.Ids(), order.Size(), sorted.data());
+        order.Scatter(sorted.data(), results);
+    }
+};
+
+template<class TPackedImpl>
+struct TReorderedPackedProduct {
+    inline static void MultiDotProduct(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        float* results
+    ) {
+        static thread_local TLocalityOrder order;
+        static thread_local std::vector<float> sorted;
+        order.Build(elemsIds, elemsNum);
+        sorted.resize(order.Size());
+        TPackedImpl::MultiDotProduct(a, allB, dim, order.Ids(), order.Size(), bias, coeff, sorted.data());
+        order.Scatter(sorted.data(), results);
+    }
+};
@@ -0,0 +1,107 @@
+#include "roofline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <vector>
+
+namespace {
+    // far above the llc of the hosts we run on, small enough next to the benchmark matrix
+    constexpr size_t ReadBytes = 256u << 20;
+    constexpr size_t ReadStreams = 8;
+    constexpr size_t TriadFloats = 16u << 20;
+    constexpr size_t FmaIterations = 1u << 22;
+    constexpr size_t Passes = 5;
+
+    template<class TFunc>
+    double BestSeconds(TFunc func) {
+        double best = std::numeric_limits<double>::max();
+        // pass 0 touches the pages and warms the code up
+        for(size_t pass = 0; pass < Passes + 1; pass += 1) {
+            const auto start = std::chrono::steady_clock::now();
+            func();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (pass > 0) {
+                best = std::min(best, elapsed.count());
+            }
+        }
+        return best;
+    }
+
+    double MeasureReadGBs() {
+        // xor needs no fast math to vectorize, a float sum would be one dependent add a value.
+        // A single stream is held back by the prefetcher, the kernels gather rows of several at once
+        std::vector<uint64_t> data(ReadBytes / sizeof(uint64_t), 1);
+        const size_t streamWords = data.size() / ReadStreams;
+        volatile uint64_t sink = 0;
+        const double seconds = BestSeconds([&] {
+            uint64_t acc[ReadStreams] = {};
+            for(size_t i = 0; i < streamWords; i += 1) {
+                for(size_t s = 0; s < ReadStreams; s += 1) {
+                    acc[s] ^= data[s * streamWords + i];
+                }
+            }
+            for(size_t s = 0; s < ReadStreams; s += 1) {
+                sink = sink + acc[s];
+            }
+        });
+        return ReadBytes / seconds * 1e-9;
+    }
+
+    double MeasureTriadGBs() {
+        std::vector<float> a(TriadFloats, 0.f);
+        std::vector<float> b(TriadFloats, 1.f);
+        std::vector<float> c(TriadFloats, 2.f);
+        const float scalar = 3.f;
+        const double seconds = BestSeconds([&] {
+            for(size_t i = 0; i < TriadFloats; i += 1) {
+                a[i] = b[i] + scalar * c[i];
+            }
+        });
+        volatile float sink = a[TriadFloats / 2];
+        (void)sink;
+        // as STREAM counts it: two reads and a write, the write allocate reads are not in
+        return 3 * TriadFloats * sizeof(float) / seconds * 1e-9;
+    }
+
+    template<class TFmaPeak>
+    double MeasureGFlops() {
+        float sink[16] = {};
+        uint64_t flops = 0;
+        const double seconds = BestSeconds([&] {
+            flops = TFmaPeak::Run(FmaIterations, sink);
+        });
+        volatile float keep = sink[0];
+        (void)keep;
+        return flops / seconds * 1e-9;
+    }
+}
+
+TRooflinePeaks TRooflinePeaks::Measure(const TCpuFeatures& features) {
+    TRooflinePeaks peaks;
+    peaks.ReadGBs = MeasureReadGBs();
+    peaks.TriadGBs = MeasureTriadGBs();
+    if (features.UsableAvx512()) {
+        peaks.GFlops = MeasureGFlops<TFmaPeakAvx512>();
+        peaks.FlopsIsa = "avx512";
+    } else if (features.UsableAvx2()) {
+        peaks.GFlops = MeasureGFlops<TFmaPeakAvx2>();
+        peaks.FlopsIsa = "avx2";
+    } else {
+        peaks.GFlops = MeasureGFlops<TFmaPeakSse42>();
+    }
+    return peaks;
+}
+
+const TRooflinePeaks& TRooflinePeaks::Host() {
+    static const TRooflinePeaks peaks = Measure(TRuntimeCpuInfoDispatch::Features);
+    return peaks;
+}
+
+double TRooflinePoint::Attainable(const TRooflinePeaks& peaks) const {
+    return std::min(peaks.GFlops, Intensity() * peaks.ReadGBs);
+}
+
+double TRooflinePoint::Efficiency(const TRooflinePeaks& peaks) const {
+    return GFlops() / Attainable(peaks);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "dot_product.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// independent multiply-add chains over registers, enough of them to keep every fma port busy,
+// returns the flops done. Sse has no fma, its chains are a mul and an add
+struct TFmaPeakSse42 {
+    static uint64_t Run(size_t iterations, float* sink);
+};
+
+struct TFmaPeakAvx2 {
+    static uint64_t Run(size_t iterations, float* sink);
+};
+
+struct TFmaPeakAvx512 {
+    static uint64_t Run(size_t iterations, float* sink);
+};
+
+// single thread peaks of the host, as the benchmarks run on one thread
+struct TRooflinePeaks {
+    // read-only sweep over a buffer far above the llc, the ceiling of the gathering kernels
+    double ReadGBs = 0;
+    // STREAM triad a = b + s * c, for reference
+    double TriadGBs = 0;
+    double GFlops = 0;
+    const char* FlopsIsa = "sse4.2";
+
+    // flops per byte where the kernels stop being memory bound
+    double Ridge() const {
+        return GFlops / ReadGBs;
+    }
+
+    // the best of a few passes, about a second
+    static TRooflinePeaks Measure(const TCpuFeatures& features);
+    // runtime features, measured on first use
+    static const TRooflinePeaks& Host();
+};
+
+// a kernel run of known traffic and time against the peaks
+struct TRooflinePoint {
+    double Bytes = 0;
+    double Flops = 0;
+    double Seconds = 0;
+
+    double Intensity() const {
+        return Flops / Bytes;
+    }
+
+    double GBs() const {
+        return Bytes / Seconds * 1e-9;
+    }
+
+    double GFlops() const {
+        return Flops / Seconds * 1e-9;
+    }
+
+    // GFLOP/s the host allows at this intensity
+    double Attainable(const TRooflinePeaks& peaks) const;
+    // the share of it reached, 1 is on the roof
+    double Efficiency(const TRooflinePeaks& peaks) const;
+    bool MemoryBound(const TRooflinePeaks& peaks) const {
+        return Intensity() < peaks.Ridge();
+    }
+};
@@ -1,5 +1,17 @@
 #include "dot_product.h"
 #include "multidot.h"
+#include "dotpacked.h"
+#include "halfdot.h"
+#include "dotnibble.h"
+#include "dotscaled.h"
+#include "pq.h"
+#include "dotbinary.h"
+#include "fixed_dim.h"
+#include "dotdistance.h"
+#include "fullscan.h"
+
+#include <cpuid.h>
+#include <nmmintrin.h>
 
 float TNaiveOutlined::DotProduct(const float* a, const float* b, size_t dim) {
     return TNaive::DotProduct(a, b, dim);
@@ -51,6 +63,316 @@ float TVirtualJump::DotProduct(const float* a, const float* b, size_t dim) {
     return TRuntimeCpuInfoDispatch::Fabric->VDotProduct(a, b, dim);
 }
 
+static uint64_t ReadXcr0() {
+    uint32_t eax = 0;
+    uint32_t edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+}
+
+TCpuFeatures TCpuFeatures::Detect() {
+    TCpuFeatures res;
+    uint32_t eax = 0;
+    uint32_t ebx = 0;
+    uint32_t ecx = 0;
+    uint32_t edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return res;
+    }
+    res.Sse42 = ecx & bit_SSE4_2;
+    res.Popcnt = ecx & bit_POPCNT;
+    res.Avx = ecx & bit_AVX;
+    res.Fma = ecx & bit_FMA;
+    res.F16c = ecx & bit_F16C;
+    if (ecx & bit_OSXSAVE) {
+        const uint64_t xcr0 = ReadXcr0();
+        res.OsYmm = (xcr0 & 0x06) == 0x06; // sse + avx
+        res.OsZmm = (xcr0 & 0xe6) == 0xe6; // sse + avx + opmask + zmm_hi256 + hi16_zmm
+    }
+
+    uint32_t maxSubLeaf = 0;
+    if (!__get_cpuid_count(7, 0, &maxSubLeaf, &ebx, &ecx, &edx)) {
+        return res;
+    }
+    res.Avx2 = ebx & bit_AVX2;
+    res.Avx512F = ebx & bit_AVX512F;
+    res.Avx512Dq = ebx & bit_AVX512DQ;
+    res.Avx512Cd = ebx & bit_AVX512CD;
+    res.Avx512Bw = ebx & bit_AVX512BW;
+    res.Avx512Vl = ebx & bit_AVX512VL;
+    res.Avx512Vnni = ecx & bit_AVX512VNNI;
+    res.Avx512Vpopcntdq = ecx & bit_AVX512VPOPCNTDQ;
+    if (maxSubLeaf >= 1 && __get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx)) {
+        res.Avx512Bf16 = eax & bit_AVX512BF16;
+    }
+    return res;
+}
+
+std::unique_ptr<const IDotProduct> TRuntimeCpuInfoDispatch::MakeFabric(uint32_t level) {
+    switch (level) {
+        case 0: return std::unique_ptr<const IDotProduct>(new IDotProductMaker<TBy4SSE4UnsafeOpt>{});
+        case 1: return std::unique_ptr<const IDotProduct>(new IDotProductMaker<TNaiveAvxAuto>{});
+        case 2: return std::unique_ptr<const IDotProduct>(new IDotProductMaker<TNaiveAvx2Auto>{});
+        case 3: return std::unique_ptr<const IDotProduct>(new IDotProductMaker<TNaiveAvx512Auto>{});
+        default: __builtin_unreachable();
+    }
+}
+
+TDotProductFunc TRuntimeCpuInfoDispatch::SelectDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TBy4SSE4UnsafeOpt::DotProduct;
+        case 1: return &TNaiveAvxAuto::DotProduct;
+        case 2: return &TNaiveAvx2Auto::DotProduct;
+        case 3: return &TNaiveAvx512ASM::DotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+// steps are the winners by res.txt
+TMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TMultiDotCTStepV2FloatOpts_SSE42<4>::MultiDotProduct;
+        case 1: return &TMultiDotCTStepV2FloatOpts_AVX<3>::MultiDotProduct;
+        case 2: return &TMultiDotCTStepV2FloatOpts_AVX2<5>::MultiDotProduct;
+        case 3: return &TMultiDotV3_ASM_PREFETCH_AVX512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPackedMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectPackedMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1:
+        case 2: return &TPackedProductInlinedWithMath::MultiDotProduct;
+        case 3: return &TPackedProductAvx512ASM::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPackedMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectQuantizedPackedMultiDotProduct(
+    const TCpuFeatures& features, uint32_t level
+) {
+    if (features.UsableAvx512Vnni()) {
+        return &TPackedProductAvx512VnniASM::MultiDotProduct;
+    }
+    if (level == 2) {
+        return &TPackedProductAvx2Int8ASM::MultiDotProduct;
+    }
+    return SelectPackedMultiDotProduct(level);
+}
+
+TMultiQueryDotProductFunc TRuntimeCpuInfoDispatch::SelectMultiQueryDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TMultiQueryFloatOpts_SSE42::MultiQueryDotProduct;
+        case 1: return &TMultiQueryFloatOpts_AVX::MultiQueryDotProduct;
+        case 2: return &TMultiQueryFloatOpts_AVX2::MultiQueryDotProduct;
+        case 3: return &TMultiQueryASM_AVX512::MultiQueryDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPackedMultiQueryDotProductFunc TRuntimeCpuInfoDispatch::SelectPackedMultiQueryDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TPackedMultiQueryOpts_SSE42::MultiQueryDotProduct;
+        case 1: return &TPackedMultiQueryOpts_AVX::MultiQueryDotProduct;
+        case 2: return &TPackedMultiQueryOpts_AVX2::MultiQueryDotProduct;
+        case 3: return &TPackedMultiQueryAvx512ASM::MultiQueryDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+// vcvtph2ps comes with f16c, which every avx2 cpu has but cpuid reports separately
+THalfMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectHalfMultiDotProduct(const TCpuFeatures& features, uint32_t level) {
+    if (level == 3) {
+        return &THalfProductAvx512ASM::MultiDotProduct;
+    }
+    if (level == 2 && features.F16c) {
+        return &THalfProductAvx2F16C::MultiDotProduct;
+    }
+    return &THalfProductNaive::MultiDotProduct;
+}
+
+// vdpbf16ps rounds the query to bf16, the dispatch keeps it float and widens the rows instead:
+// the same row traffic, and the kernels are memory bound on gathered rows anyway
+THalfMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectBf16MultiDotProduct(const TCpuFeatures&, uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1: return &TBf16ProductNaive::MultiDotProduct;
+        case 2: return &TBf16ProductAvx2::MultiDotProduct;
+        case 3: return &TBf16ProductAvx512ASM::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+// every nibble kernel quantizes the query, so there is no float kernel to prefer on any level
+TPackedMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectNibbleMultiDotProduct(const TCpuFeatures& features, uint32_t level) {
+    if (features.UsableAvx512Vnni()) {
+        return &TNibbleProductAvx512Vnni::MultiDotProduct;
+    }
+    switch (level) {
+        case 0:
+        case 1: return &TNibbleProductNaive::MultiDotProduct;
+        case 2: return &TNibbleProductAvx2::MultiDotProduct;
+        case 3: return &TNibbleProductAvx512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TScaledMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectRowScaledMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1: return &TRowScaledProductNaive::MultiDotProduct;
+        case 2: return &TRowScaledProductAvx2::MultiDotProduct;
+        case 3: return &TRowScaledProductAvx512ASM::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPqMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectPqMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1: return &TPqProductNaive::MultiDotProduct;
+        case 2: return &TPqProductAvx2::MultiDotProduct;
+        case 3: return &TPqProductAvx512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPqFullScanFunc TRuntimeCpuInfoDispatch::SelectPqFullScan(uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1: return &TPqProductNaive::FullScan;
+        case 2: return &TPqProductAvx2::FullScan;
+        case 3: return &TPqProductAvx512::FullScan;
+        default: __builtin_unreachable();
+    }
+}
+
+TBinaryMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectBinaryMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1: return &TBinaryProductNaive::MultiDotProduct;
+        case 2: return &TBinaryProductAvx2::MultiDotProduct;
+        case 3: return &TBinaryProductAvx512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+// without vpopcntq an avx512 host is better off with the avx2 shuffles than with a popcnt per word
+TBinaryMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectHammingMultiDotProduct(const TCpuFeatures& features, uint32_t level) {
+    if (features.UsableAvx512Vpopcntdq()) {
+        return &THammingProductAvx512Vpopcnt::MultiDotProduct;
+    }
+    if (level >= 2) {
+        return &THammingProductAvx2::MultiDotProduct;
+    }
+    if (features.Popcnt) {
+        return &THammingProductPopcnt::MultiDotProduct;
+    }
+    return &THammingProductNaive::MultiDotProduct;
+}
+
+void THammingProductPopcnt::MultiDotProduct(
+    const float* a,
+    const uint64_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    const size_t rowWords = TBinaryRows::RowWords(dim);
+    std::vector<uint64_t> query(rowWords);
+    TBinaryRows::PackRow(a, dim, query.data());
+    for(size_t e = 0; e < elemsNum; e += 1) {
+        const uint64_t* row = allB + rowWords * elemsIds[e];
+        uint64_t distance = 0;
+        for(size_t w = 0; w < rowWords; w += 1) {
+            distance += _mm_popcnt_u64(row[w] ^ query[w]);
+        }
+        results[e] = float(dim) - 2.f * distance;
+    }
+}
+
+TDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectL2MultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TL2MultiDot_SSE42::MultiDotProduct;
+        case 1: return &TL2MultiDot_AVX::MultiDotProduct;
+        case 2: return &TL2MultiDot_AVX2::MultiDotProduct;
+        case 3: return &TL2MultiDot_AVX512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectCosineMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TCosineMultiDot_SSE42::MultiDotProduct;
+        case 1: return &TCosineMultiDot_AVX::MultiDotProduct;
+        case 2: return &TCosineMultiDot_AVX2::MultiDotProduct;
+        case 3: return &TCosineMultiDot_AVX512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPackedDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectPackedL2MultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TL2Packed_SSE42::MultiDotProduct;
+        case 1: return &TL2Packed_AVX::MultiDotProduct;
+        case 2: return &TL2Packed_AVX2::MultiDotProduct;
+        case 3: return &TL2Packed_AVX512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TPackedDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::SelectPackedCosineMultiDotProduct(uint32_t level) {
+    switch (level) {
+        case 0: return &TCosinePacked_SSE42::MultiDotProduct;
+        case 1: return &TCosinePacked_AVX::MultiDotProduct;
+        case 2: return &TCosinePacked_AVX2::MultiDotProduct;
+        case 3: return &TCosinePacked_AVX512::MultiDotProduct;
+        default: __builtin_unreachable();
+    }
+}
+
+TFullScanFunc TRuntimeCpuInfoDispatch::SelectInterleavedScan(uint32_t level) {
+    switch (level) {
+        case 0:
+        case 1: return &TInterleavedScanNaive::FullScan;
+        case 2: return &TInterleavedScanAvx2::FullScan;
+        case 3: return &TInterleavedScanAvx512::FullScan;
+        default: __builtin_unreachable();
+    }
+}
+
+std::array<TDotProductFunc, FixedDimsNum> TRuntimeCpuInfoDispatch::SelectFixedDimDotProducts(uint32_t level) {
+    switch (level) {
+        case 0: return FixedDimTable(TFixedDimDot_SSE42, DotProduct);
+        case 1: return FixedDimTable(TFixedDimDot_AVX, DotProduct);
+        case 2: return FixedDimTable(TFixedDimDot_AVX2, DotProduct);
+        case 3: return FixedDimTable(TFixedDimDot_AVX512, DotProduct);
+        default: __builtin_unreachable();
+    }
+}
+
+std::array<TMultiDotProductFunc, FixedDimsNum> TRuntimeCpuInfoDispatch::SelectFixedDimMultiDotProducts(uint32_t level) {
+    switch (level) {
+        case 0: return FixedDimTable(TFixedDimMultiDot_SSE42, MultiDotProduct);
+        case 1: return FixedDimTable(TFixedDimMultiDot_AVX, MultiDotProduct);
+        case 2: return FixedDimTable(TFixedDimMultiDot_AVX2, MultiDotProduct);
+        case 3: return FixedDimTable(TFixedDimMultiDot_AVX512, MultiDotProduct);
+        default: __builtin_unreachable();
+    }
+}
+
+std::array<TPackedMultiDotProductFunc, FixedDimsNum> TRuntimeCpuInfoDispatch::SelectFixedDimPackedMultiDotProducts(uint32_t level) {
+    switch (level) {
+        case 0: return FixedDimTable(TFixedDimPacked_SSE42, MultiDotProduct);
+        case 1: return FixedDimTable(TFixedDimPacked_AVX, MultiDotProduct);
+        case 2: return FixedDimTable(TFixedDimPacked_AVX2, MultiDotProduct);
+        case 3: return FixedDimTable(TFixedDimPacked_AVX512, MultiDotProduct);
+        default: __builtin_unreachable();
+    }
+}
+
 #define DeclByStep(Step) \
 template<> void TMultiDotCTStepOutlined<Step>::MultiDotProduct(\
     const float* a,\
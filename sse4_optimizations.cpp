@@ -1,5 +1,11 @@
 #include "dot_product.h"
 #include "multidot.h"
+#include "dotpacked.h"
+#include "roofline.h"
+#include "fixed_dim_impl.h"
+#include "distance_impl.h"
+
+#include <immintrin.h>
 
 float TNaiveSSE4UnsafeOpt::DotProduct(const float* a, const float* b, size_t dim) {
     return TNaive::DotProduct(a, b, dim);
@@ -37,6 +43,12 @@ DeclByStep(14)
 DeclByStep(15)
 DeclByStep(16)
 
+#define DeclFixedDim(Dim) DeclFixedDimByIsa(SSE42, Dim)
+
+ForEachFixedDim(DeclFixedDim)
+
+DeclDistanceByIsa(SSE42)
+
 void TMultiDotCTStepV3FloatOpts_SSE42::MultiDotProduct(
     const float* a,
     const float* allB,
@@ -47,3 +59,54 @@ void TMultiDotCTStepV3FloatOpts_SSE42::MultiDotProduct(
 ) {
     TMultiDotCTStepV3::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, results);
 }
+
+void TMultiQueryFloatOpts_SSE42::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const float* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float* results
+) {
+    TMultiQueryCTStep<4, 2>::MultiQueryDotProduct(queries, queriesNum, allB, dim, elemsIds, elemsNum, results);
+}
+
+void TPackedMultiQueryOpts_SSE42::MultiQueryDotProduct(
+    const float* queries,
+    size_t queriesNum,
+    const uint8_t* allB,
+    size_t dim,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    float bias,
+    float coeff,
+    float* results
+) {
+    TPackedMultiQueryCTStep<4, 2>::MultiQueryDotProduct(
+        queries, queriesNum, allB, dim, elemsIds, elemsNum, bias, coeff, results
+    );
+}
+
+
+uint64_t TFmaPeakSse42::Run(size_t iterations, float* sink) {
+    // a mul and a dependent add per chain, the ports of both stay busy with 12 chains
+    constexpr size_t Chains = 12;
+    __m128 acc[Chains];
+    for(size_t i = 0; i < Chains; i += 1) {
+        acc[i] = _mm_set1_ps(float(i));
+    }
+    const __m128 mul = _mm_set1_ps(0.999f);
+    const __m128 add = _mm_set1_ps(0.001f);
+    for(size_t it = 0; it < iterations; it += 1) {
+#pragma GCC unroll 12
+        for(size_t i = 0; i < Chains; i += 1) {
+            acc[i] = _mm_add_ps(_mm_mul_ps(acc[i], mul), add);
+        }
+    }
+    for(size_t i = 1; i < Chains; i += 1) {
+        acc[0] = _mm_add_ps(acc[0], acc[i]);
+    }
+    _mm_storeu_ps(sink, acc[0]);
+    return uint64_t(iterations) * Chains * 4 * 2;
+}
@@ -1,12 +1,41 @@
 #include "dot_product.h"
 #include "multidot.h"
 #include "dotpacked.h"
+#include "topk.h"
+#include "parallel.h"
+#include "reorder.h"
+#include "matrix_file.h"
+#include "aligned_matrix.h"
+#include "halfdot.h"
+#include "dotnibble.h"
+#include "dotscaled.h"
+#include "pq.h"
+#include "dotbinary.h"
+#include "numa.h"
+#include "autotune.h"
+#include "fixed_dim.h"
+#include "roofline.h"
+#include "perf_counters.h"
+#include "id_distribution.h"
+#include "dotdistance.h"
+#include "fullscan.h"
 
 #include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
 #include <vector>
 #include <util/random/fast.h>
 #include <util/generic/xrange.h>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#include <immintrin.h>
+#include <unistd.h>
 
 using TRandomGen = TFastRng64;
 
@@ -16,23 +45,59 @@ constexpr size_t MatrixSize = MaxDim * MaxRowNumber;
 constexpr size_t CasesNumPerTask = 10 * 1024u;
 constexpr size_t TasksNum = 100u;
 
-const bool TRuntimeCpuInfoDispatch::HaveAvx = true;
-const bool TRuntimeCpuInfoDispatch::HaveAvx2 = true;
-const bool TRuntimeCpuInfoDispatch::HaveAvx512 = true;
+const TCpuFeatures TRuntimeCpuInfoDispatch::Features = TCpuFeatures::Detect();
+
+const bool TRuntimeCpuInfoDispatch::HaveAvx = Features.UsableAvx();
+const bool TRuntimeCpuInfoDispatch::HaveAvx2 = Features.UsableAvx2();
+const bool TRuntimeCpuInfoDispatch::HaveAvx512 = Features.UsableAvx512();
 
-const bool TRuntimeCpuInfoDispatch::HaveSse4Only = false;
-const bool TRuntimeCpuInfoDispatch::HaveAvxOnly = false;
-const bool TRuntimeCpuInfoDispatch::HaveAvx2Only = false;
+const bool TRuntimeCpuInfoDispatch::HaveSse4Only = !HaveAvx;
+const bool TRuntimeCpuInfoDispatch::HaveAvxOnly = HaveAvx && !HaveAvx2;
+const bool TRuntimeCpuInfoDispatch::HaveAvx2Only = HaveAvx2 && !HaveAvx512;
 
-const uint32_t TRuntimeCpuInfoDispatch::LevelJump = 3;
+const uint32_t TRuntimeCpuInfoDispatch::LevelJump = HaveAvx + HaveAvx2 + HaveAvx512;
 
-const std::unique_ptr<const IDotProduct> TRuntimeCpuInfoDispatch::Fabric = std::unique_ptr<const IDotProduct>(
-    new IDotProductMaker<TNaiveAvx512Auto>{}
-);
+const std::unique_ptr<const IDotProduct> TRuntimeCpuInfoDispatch::Fabric = MakeFabric(LevelJump);
+
+const TDotProductFunc TRuntimeCpuInfoDispatch::DotProductImpl = SelectDotProduct(LevelJump);
+const TMultiDotProductFunc TRuntimeCpuInfoDispatch::MultiDotProductImpl = SelectMultiDotProduct(LevelJump);
+const TPackedMultiDotProductFunc TRuntimeCpuInfoDispatch::PackedMultiDotProductImpl = SelectPackedMultiDotProduct(LevelJump);
+const TPackedMultiDotProductFunc TRuntimeCpuInfoDispatch::QuantizedPackedMultiDotProductImpl =
+    SelectQuantizedPackedMultiDotProduct(Features, LevelJump);
+const TMultiQueryDotProductFunc TRuntimeCpuInfoDispatch::MultiQueryDotProductImpl = SelectMultiQueryDotProduct(LevelJump);
+const TPackedMultiQueryDotProductFunc TRuntimeCpuInfoDispatch::PackedMultiQueryDotProductImpl =
+    SelectPackedMultiQueryDotProduct(LevelJump);
+const THalfMultiDotProductFunc TRuntimeCpuInfoDispatch::HalfMultiDotProductImpl = SelectHalfMultiDotProduct(Features, LevelJump);
+const THalfMultiDotProductFunc TRuntimeCpuInfoDispatch::Bf16MultiDotProductImpl = SelectBf16MultiDotProduct(Features, LevelJump);
+const TPackedMultiDotProductFunc TRuntimeCpuInfoDispatch::NibbleMultiDotProductImpl = SelectNibbleMultiDotProduct(Features, LevelJump);
+const TScaledMultiDotProductFunc TRuntimeCpuInfoDispatch::RowScaledMultiDotProductImpl = SelectRowScaledMultiDotProduct(LevelJump);
+const TPqMultiDotProductFunc TRuntimeCpuInfoDispatch::PqMultiDotProductImpl = SelectPqMultiDotProduct(LevelJump);
+const TPqFullScanFunc TRuntimeCpuInfoDispatch::PqFullScanImpl = SelectPqFullScan(LevelJump);
+const TBinaryMultiDotProductFunc TRuntimeCpuInfoDispatch::BinaryMultiDotProductImpl = SelectBinaryMultiDotProduct(LevelJump);
+const TBinaryMultiDotProductFunc TRuntimeCpuInfoDispatch::HammingMultiDotProductImpl = SelectHammingMultiDotProduct(Features, LevelJump);
+const TDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::L2MultiDotProductImpl = SelectL2MultiDotProduct(LevelJump);
+const TDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::CosineMultiDotProductImpl = SelectCosineMultiDotProduct(LevelJump);
+const TPackedDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::PackedL2MultiDotProductImpl = SelectPackedL2MultiDotProduct(LevelJump);
+const TPackedDistanceMultiDotProductFunc TRuntimeCpuInfoDispatch::PackedCosineMultiDotProductImpl =
+    SelectPackedCosineMultiDotProduct(LevelJump);
+const TFullScanFunc TRuntimeCpuInfoDispatch::InterleavedScanImpl = SelectInterleavedScan(LevelJump);
+const std::array<TDotProductFunc, FixedDimsNum> TRuntimeCpuInfoDispatch::FixedDimDotProductImpls =
+    SelectFixedDimDotProducts(LevelJump);
+const std::array<TMultiDotProductFunc, FixedDimsNum> TRuntimeCpuInfoDispatch::FixedDimMultiDotProductImpls =
+    SelectFixedDimMultiDotProducts(LevelJump);
+const std::array<TPackedMultiDotProductFunc, FixedDimsNum> TRuntimeCpuInfoDispatch::FixedDimPackedMultiDotProductImpls =
+    SelectFixedDimPackedMultiDotProducts(LevelJump);
 
 // #define B_RANGES Arg(64)
 #define B_RANGES Arg(64)->Arg(128)->Arg(1024)
 // #define B_RANGES DenseRange(64, 1024, 64)
+// dims that are not a multiple of the vector width, for kernels with masked tails
+#define B_RANGES_TAIL Arg(96)->Arg(200)->Arg(300)
+
+using TTopKAsmAvx512FilterAvx2 = TMultiDotTopK<TMultiDotV3_ASM_AVX512, TTopKFilterAvx2>;
+using TTopKAsmAvx512FilterAvx512 = TMultiDotTopK<TMultiDotV3_ASM_AVX512, TTopKFilterAvx512>;
+using TTopKAvx2Step5FilterAvx2 = TMultiDotTopK<TMultiDotCTStepV2FloatOpts_AVX2<5>, TTopKFilterAvx2>;
+using TPackedTopKAvx512ASMFilterAvx512 = TPackedProductTopK<TPackedProductAvx512ASM, TTopKFilterAvx512>;
 
 struct TCalcTask {
     std::vector<float> Query;
@@ -54,43 +119,142 @@ struct TCalcTask {
     }
 };
 
-struct TBaseHolder {
-    std::vector<float> Matrix;
-    std::vector<uint8_t> Matrix8;
-    std::vector<TCalcTask> Tasks;
+constexpr uint64_t BaseSeed = 29;
+// values per generation chunk, each chunk draws from its own generator seeded by the chunk index,
+// so the matrices come out the same for any number of threads and either of them can be made alone
+constexpr size_t GenerationChunk = 1u << 20;
+// bumped when the generation changes, snapshots of other versions are not read
+constexpr uint32_t GenerationVersion = 2;
 
-    void Generate(TRandomGen& g) {
-        Matrix.reserve(MatrixSize);
-        Matrix8.reserve(MatrixSize);
-        for(size_t i = 0; i < MatrixSize; ++i) {
-            float x = g.GenRandReal1();
-            Matrix.push_back(x - 0.5f);
-            Matrix8.push_back(uint8_t(1) + uint8_t(x * 254));
-        }
-        for(unsigned char* b = (unsigned char*)Matrix.begin(); b != (unsigned char*)Matrix.end(); b += 1) {
-            *b |= 1;
+inline uint64_t ChunkSeed(size_t chunk) {
+    // splitmix64 finalizer, neighbouring chunks get unrelated streams
+    uint64_t z = BaseSeed + (chunk + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// MatrixSize values of convert(x) for x uniform in [0, 1), chunks in parallel
+template<class T, class TConvert>
+std::vector<T> GenerateValues(TConvert convert) {
+    std::vector<T> values(MatrixSize);
+    TWorkStealingPool::Default().ParallelFor((MatrixSize + GenerationChunk - 1) / GenerationChunk, 1, [&](size_t begin, size_t end) {
+        for(size_t chunk = begin; chunk < end; chunk += 1) {
+            TRandomGen g(ChunkSeed(chunk));
+            const size_t last = std::min(MatrixSize, (chunk + 1) * GenerationChunk);
+            for(size_t i = chunk * GenerationChunk; i < last; ++i) {
+                values[i] = convert(g.GenRandReal1());
+            }
         }
+    });
+    return values;
+}
+
+// $DOT_PRODUCT_SNAPSHOT_DIR/name of this shape and generation, empty without the variable
+std::string SnapshotPath(const std::string& name) {
+    const char* dir = std::getenv("DOT_PRODUCT_SNAPSHOT_DIR");
+    return dir == nullptr ? "" : std::string(dir) + "/dot_stand_" + name + "_" + std::to_string(MaxRowNumber)
+        + "x" + std::to_string(MaxDim) + "_v" + std::to_string(GenerationVersion) + ".bin";
+}
 
-        Tasks.resize(TasksNum);
-        for(size_t i = 0; i < TasksNum; ++i) {
-            Tasks[i].Generate(g);
+// $DOT_PRODUCT_SNAPSHOT_DIR/name as a matrix file, written after the first generation and read instead of it later
+template<class T, class TGenerate>
+std::vector<T> GenerateOrLoad(const char* name, TGenerate generate) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::string path = SnapshotPath(name);
+    std::vector<T> values;
+    const char* how = "generated";
+    if (!path.empty() && access(path.c_str(), R_OK) == 0) {
+        const TMappedMatrix snapshot(path);
+        if (snapshot.Rows() != MaxRowNumber || snapshot.Dim() != MaxDim || snapshot.KernelDim() != MaxDim) {
+            throw std::runtime_error("snapshot of another shape: " + path);
         }
+        const T* data = nullptr;
+        if constexpr (std::is_same_v<T, float>) {
+            data = snapshot.Floats();
+        } else {
+            data = snapshot.Bytes();
+        }
+        values.resize(MatrixSize);
+        TWorkStealingPool::Default().ParallelFor(MatrixSize, GenerationChunk, [&](size_t begin, size_t end) {
+            std::copy(data + begin, data + end, values.data() + begin);
+        });
+        how = "loaded";
+    } else {
+        values = generate();
+        if (!path.empty()) {
+            WriteMatrixFile(path, values.data(), MaxRowNumber, MaxDim);
+            how = "generated and saved";
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << " " << how << " in " << elapsed.count() << " s" << (path.empty() ? "" : ", " + path) << std::endl;
+    return values;
+}
+
+// the data of the benchmarks, every part made on first use: a filtered run pays only for what its kernels read
+struct TBaseHolder {
+    const std::vector<float>& Matrix() {
+        static const std::vector<float> matrix = GenerateOrLoad<float>("matrix", [] {
+            return GenerateValues<float>([](float x) {
+                float value = x - 0.5f;
+                // as the queries: no byte of a value is zero
+                for(unsigned char* b = (unsigned char*)&value; b != (unsigned char*)(&value + 1); b += 1) {
+                    *b |= 1;
+                }
+                return value;
+            });
+        });
+        return matrix;
+    }
+
+    // the same x as Matrix() at every index
+    const std::vector<uint8_t>& Matrix8() {
+        static const std::vector<uint8_t> matrix = GenerateOrLoad<uint8_t>("matrix8", [] {
+            return GenerateValues<uint8_t>([](float x) {
+                return uint8_t(uint8_t(1) + uint8_t(x * 254));
+            });
+        });
+        return matrix;
     }
 
-    TBaseHolder() {
-        std::cout << "Start init" << std::endl;
-        TRandomGen gen(29);
-        Generate(gen);
-        std::cout << "Done init" << std::endl;
+    // milliseconds to make, so never snapshotted
+    const std::vector<TCalcTask>& Tasks() {
+        static const std::vector<TCalcTask> tasks = [] {
+            std::vector<TCalcTask> generated(TasksNum);
+            TRandomGen g(BaseSeed);
+            for(size_t i = 0; i < TasksNum; ++i) {
+                generated[i].Generate(g);
+            }
+            // $DOT_PRODUCT_IDS, e.g. zipf:1.1, redraws the ids of every benchmark from TIdDistribution::Parse
+            if (const char* ids = std::getenv("DOT_PRODUCT_IDS")) {
+                const auto lists = GenerateIds(TIdDistribution::Parse(ids), MaxRowNumber, TasksNum, CasesNumPerTask, BaseSeed);
+                for(size_t i = 0; i < TasksNum; ++i) {
+                    generated[i].DocIds = lists[i];
+                }
+            }
+            return generated;
+        }();
+        return tasks;
+    }
+
+    // value prints of every kernel to compare by eye, the Checks benchmark runs them
+    void PrintChecks() {
+        std::cout << "ids " << (std::getenv("DOT_PRODUCT_IDS") ? std::getenv("DOT_PRODUCT_IDS") : "uniform") << std::endl;
+        std::cout << "Cpu level " << TRuntimeCpuInfoDispatch::LevelJump
+            << "\tvnni " << TRuntimeCpuInfoDispatch::Features.UsableAvx512Vnni()
+            << "\tbf16 " << TRuntimeCpuInfoDispatch::Features.UsableAvx512Bf16()
+            << "\tvpopcntdq " << TRuntimeCpuInfoDispatch::Features.UsableAvx512Vpopcntdq()
+            << "\tf16c " << TRuntimeCpuInfoDispatch::Features.F16c << std::endl;
 
         #define Check(name) std::cout << \
-            name::DotProduct(Tasks[0].Query.cbegin(), Matrix.cbegin(), 64) \
+            name::DotProduct(Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64) \
         << "\t" << #name << std::endl;
 
         #define CheckD(name) std::cout << \
-            name::DotProductDouble(Tasks[0].Query.cbegin(), Matrix.cbegin(), Matrix.cbegin() + 64, 64).first \
+            name::DotProductDouble(Tasks()[0].Query.cbegin(), Matrix().cbegin(), Matrix().cbegin() + 64, 64).first \
             << "\t" << \
-            name::DotProductDouble(Tasks[0].Query.cbegin(), Matrix.cbegin(), Matrix.cbegin() + 64, 64).second \
+            name::DotProductDouble(Tasks()[0].Query.cbegin(), Matrix().cbegin(), Matrix().cbegin() + 64, 64).second \
         << "\t" << #name << std::endl;
 
 
@@ -111,12 +275,18 @@ struct TBaseHolder {
         Check(TDetectPessimistic)
         Check(TDetectJump)
         Check(TVirtualJump)
+        Check(TDetectPointer)
+        Check(TFixedDimDot_SSE42<64>)
+        Check(TFixedDimDot_AVX<64>)
+        Check(TFixedDimDot_AVX2<64>)
+        Check(TFixedDimDot_AVX512<64>)
+        Check(TFixedDimDetectPointer)
         CheckD(TNaive);
 
         #define CheckMD(name) {\
             float res[16];\
             uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
-            name::MultiDotProduct(Tasks[0].Query.cbegin(), Matrix.cbegin(), 64, elems, 16, res);\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, elems, 16, res);\
             std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
         }
 
@@ -132,11 +302,43 @@ struct TBaseHolder {
         CheckMD(TMultiDotCTStepV2FloatOpts_AVX2<2>);
         CheckMD(TMultiDotCTStepV2FloatOpts_AVX512<2>);
         CheckMD(TMultiDotV3_ASM_AVX512);
+        CheckMD(TMultiDotDeepPrefetchAVX512);
+        CheckMD(TMultiDotDetectPointer);
+        CheckMD(TParallelMultiDot<TMultiDotDetectPointer>);
+        CheckMD(TReorderedMultiDot<TMultiDotDetectPointer>);
+        CheckMD(TFixedDimMultiDot_SSE42<64>);
+        CheckMD(TFixedDimMultiDot_AVX<64>);
+        CheckMD(TFixedDimMultiDot_AVX2<64>);
+        CheckMD(TFixedDimMultiDot_AVX512<64>);
+        CheckMD(TFixedDimMultiDotDetectPointer);
+
+        // two threads on the default pool at once, each against its own serial result
+        {
+            const std::vector<ui32>& docs = Tasks()[0].DocIds;
+            std::vector<float> serial(docs.size());
+            TMultiDotDetectPointer::MultiDotProduct(
+                Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, docs.cbegin(), docs.size(), serial.begin()
+            );
+            std::vector<float> concurrent[2] = {std::vector<float>(docs.size()), std::vector<float>(docs.size())};
+            auto run = [&](size_t i) {
+                for(size_t repeat = 0; repeat < 16; repeat += 1) {
+                    TParallelMultiDot<TMultiDotDetectPointer>::MultiDotProduct(
+                        Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, docs.cbegin(), docs.size(), concurrent[i].begin()
+                    );
+                }
+            };
+            std::thread other(run, 1);
+            run(0);
+            other.join();
+            std::cout << concurrent[0][0] << "\t" << concurrent[1][0] << "\t"
+                << (concurrent[0] == serial && concurrent[1] == serial ? "same" : "DIFFERENT")
+                << "\tTParallelMultiDot concurrent calls" << std::endl;
+        }
 
         #define CheckPacked(name) {\
             float res[16];\
             uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
-            name::MultiDotProduct(Tasks[0].Query.cbegin(), Matrix8.cbegin(), 64, elems, 16, 0.7, 0.5, res);\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix8().cbegin(), 64, elems, 16, 0.7, 0.5, res);\
             std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
         }
 
@@ -148,19 +350,633 @@ struct TBaseHolder {
         CheckPacked(TPackedProductInlinedWithMathAvx512Auto);
         CheckPacked(TPackedProductAvx512ASM);
         CheckPacked(TPackedProductV2Avx512ASM);
+        CheckPacked(TPackedProductDeepPrefetchAvx512ASM);
+        CheckPacked(TPackedProductDetectPointer);
+        CheckPacked(TParallelPackedProduct<TPackedProductDetectPointer>);
+        CheckPacked(TReorderedPackedProduct<TPackedProductDetectPointer>);
+        CheckPacked(TFixedDimPacked_SSE42<64>);
+        CheckPacked(TFixedDimPacked_AVX<64>);
+        CheckPacked(TFixedDimPacked_AVX2<64>);
+        CheckPacked(TFixedDimPacked_AVX512<64>);
+        CheckPacked(TFixedDimPackedDetectPointer);
+        CheckPacked(TPackedProductQuantizedDetectPointer);
+        if (TRuntimeCpuInfoDispatch::Features.UsableAvx512Vnni()) {
+            CheckPacked(TPackedProductAvx512VnniASM);
+        }
+        CheckPacked(TPackedProductAvx2Int8ASM);
+
+        // dim 96 rows at the 128 stride of a TAlignedMatrix with the padded query against the same rows packed at 96
+        {
+            constexpr size_t dim = 96;
+            TAlignedMatrix<uint8_t> aligned(16, dim);
+            aligned.CopyRows(Matrix8().data());
+            std::vector<float> query(aligned.KernelDim(), 0.f);
+            std::copy(Tasks()[0].Query.cbegin(), Tasks()[0].Query.cbegin() + dim, query.begin());
+            float res[16];
+            float ref[16];
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+            TPackedProductDetectPointer::MultiDotProduct(
+                query.data(), aligned.Data(), aligned.KernelDim(), elems, 16, 0.7, 0.5, res
+            );
+            TPackedProductInlinedWithMath::MultiDotProduct(
+                Tasks()[0].Query.cbegin(), Matrix8().cbegin(), dim, elems, 16, 0.7, 0.5, ref
+            );
+            bool same = true;
+            for(size_t e = 0; e < 16; e += 1) {
+                same &= std::abs(res[e] - ref[e]) <= 1e-4f * std::max(1.f, std::abs(ref[e]));
+            }
+            std::cout << res[0] << "\t" << ref[0] << "\t" << (same ? "same" : "DIFFERENT")
+                << "\tTPackedProductDetectPointer over TAlignedMatrix dim 96" << std::endl;
+        }
+
+        // 5 queries x 16 rows, prints query 0 row 0, query 0 row 1 and query 4 row 15
+        std::vector<float> checkQueries;
+        for(size_t q = 0; q < 5; ++q) {
+            checkQueries.insert(checkQueries.end(), Tasks()[q].Query.cbegin(), Tasks()[q].Query.cbegin() + 64);
+        }
+
+        #define CheckMQ(name) {\
+            float res[5 * 16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            name::MultiQueryDotProduct(checkQueries.cbegin(), 5, Matrix().cbegin(), 64, elems, 16, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << res[4 * 16 + 15] << "\t" << #name << std::endl;\
+        }
+
+        #define CheckPackedMQ(name) {\
+            float res[5 * 16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            name::MultiQueryDotProduct(checkQueries.cbegin(), 5, Matrix8().cbegin(), 64, elems, 16, 0.7, 0.5, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << res[4 * 16 + 15] << "\t" << #name << std::endl;\
+        }
+
+        CheckMQ(TMultiQueryFromMulti<TMultiDotFromSingle<TNaive>>);
+        CheckMQ(TMultiQueryFloatOpts_SSE42);
+        CheckMQ(TMultiQueryFloatOpts_AVX);
+        CheckMQ(TMultiQueryFloatOpts_AVX2);
+        CheckMQ(TMultiQueryFloatOpts_AVX512);
+        CheckMQ(TMultiQueryASM_AVX512);
+        CheckMQ(TMultiQueryDetectPointer);
+        CheckPackedMQ(TPackedMultiQueryFromMulti<TPackedProductInlinedWithMath>);
+        CheckPackedMQ(TPackedMultiQueryOpts_SSE42);
+        CheckPackedMQ(TPackedMultiQueryOpts_AVX);
+        CheckPackedMQ(TPackedMultiQueryOpts_AVX2);
+        CheckPackedMQ(TPackedMultiQueryOpts_AVX512);
+        CheckPackedMQ(TPackedMultiQueryAvx512ASM);
+        CheckPackedMQ(TPackedMultiQueryDetectPointer);
+
+        // top 100 of the first task, the fused kernels against the full results + nth_element
+        #define CheckTopK(name, reference) {\
+            const std::vector<ui32>& docs = Tasks()[0].DocIds;\
+            std::vector<uint32_t> ids(100);\
+            std::vector<float> scores(100);\
+            std::vector<uint32_t> refIds(100);\
+            std::vector<float> refScores(100);\
+            size_t found = name::MultiDotProductTopK(\
+                Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, docs.cbegin(), docs.size(), 100, ids.begin(), scores.begin()\
+            );\
+            reference::MultiDotProductTopK(\
+                Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, docs.cbegin(), docs.size(), 100, refIds.begin(), refScores.begin()\
+            );\
+            std::cout << scores[0] << "\t" << scores[found - 1] << "\t" << (ids == refIds ? "same" : "DIFFERENT")\
+                << "\t" << #name << std::endl;\
+        }
+
+        #define CheckPackedTopK(name, reference) {\
+            const std::vector<ui32>& docs = Tasks()[0].DocIds;\
+            std::vector<uint32_t> ids(100);\
+            std::vector<float> scores(100);\
+            std::vector<uint32_t> refIds(100);\
+            std::vector<float> refScores(100);\
+            size_t found = name::MultiDotProductTopK(\
+                Tasks()[0].Query.cbegin(), Matrix8().cbegin(), 64, docs.cbegin(), docs.size(), 0.7, 0.5, 100, ids.begin(), scores.begin()\
+            );\
+            reference::MultiDotProductTopK(\
+                Tasks()[0].Query.cbegin(), Matrix8().cbegin(), 64, docs.cbegin(), docs.size(), 0.7, 0.5, 100, refIds.begin(), refScores.begin()\
+            );\
+            std::cout << scores[0] << "\t" << scores[found - 1] << "\t" << (ids == refIds ? "same" : "DIFFERENT")\
+                << "\t" << #name << std::endl;\
+        }
+
+        CheckTopK(TMultiDotTopK<TMultiDotV3_ASM_AVX512>, TMultiDotThenSelect<TMultiDotV3_ASM_AVX512>);
+        CheckTopK(TTopKAsmAvx512FilterAvx2, TMultiDotThenSelect<TMultiDotV3_ASM_AVX512>);
+        CheckTopK(TTopKAsmAvx512FilterAvx512, TMultiDotThenSelect<TMultiDotV3_ASM_AVX512>);
+        CheckTopK(TMultiDotTopK<TMultiDotDetectPointer>, TMultiDotThenSelect<TMultiDotDetectPointer>);
+        CheckPackedTopK(TPackedTopKAvx512ASMFilterAvx512, TPackedProductThenSelect<TPackedProductAvx512ASM>);
+        CheckPackedTopK(TPackedProductTopK<TPackedProductDetectPointer>, TPackedProductThenSelect<TPackedProductDetectPointer>);
+
+        // k = 0 and k above the candidates on the first 40 docs: none and all of them, as the reference finds
+        #define CheckTopKSize(name, reference, k) {\
+            const std::vector<ui32>& docs = Tasks()[0].DocIds;\
+            std::vector<uint32_t> ids(40);\
+            std::vector<float> scores(40);\
+            std::vector<uint32_t> refIds(40);\
+            std::vector<float> refScores(40);\
+            size_t found = name::MultiDotProductTopK(\
+                Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, docs.cbegin(), 40, k, ids.begin(), scores.begin()\
+            );\
+            size_t refFound = reference::MultiDotProductTopK(\
+                Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, docs.cbegin(), 40, k, refIds.begin(), refScores.begin()\
+            );\
+            std::cout << found << "\t" << refFound << "\t" << (ids == refIds ? "same" : "DIFFERENT")\
+                << "\t" << #name << "/k=" << k << std::endl;\
+        }
+
+        CheckTopKSize(TMultiDotTopK<TMultiDotDetectPointer>, TMultiDotThenSelect<TMultiDotDetectPointer>, 0);
+        CheckTopKSize(TMultiDotTopK<TMultiDotDetectPointer>, TMultiDotThenSelect<TMultiDotDetectPointer>, 50);
+
+        // quantized kernels against the exact float math on the whole first task
+        #define CheckPackedAccuracy(name, dim) {\
+            const std::vector<ui32>& ids = Tasks()[0].DocIds;\
+            std::vector<float> exact(ids.size());\
+            std::vector<float> res(ids.size());\
+            TPackedProductInlinedWithMath::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix8().cbegin(), dim, ids.cbegin(), ids.size(), 0.7, 0.4, exact.begin());\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix8().cbegin(), dim, ids.cbegin(), ids.size(), 0.7, 0.4, res.begin());\
+            double maxAbs = 0;\
+            double sumAbs = 0;\
+            double sumExactAbs = 0;\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                maxAbs = std::max(maxAbs, double(std::fabs(res[i] - exact[i])));\
+                sumAbs += std::fabs(res[i] - exact[i]);\
+                sumExactAbs += std::fabs(exact[i]);\
+            }\
+            std::cout << "max abs err " << maxAbs << "\tmean abs err " << sumAbs / ids.size()\
+                << "\tmean rel err " << sumAbs / sumExactAbs << "\t" << #name << "/" << dim << std::endl;\
+        }
+
+        if (TRuntimeCpuInfoDispatch::Features.UsableAvx512Vnni()) {
+            CheckPackedAccuracy(TPackedProductAvx512VnniASM, 64);
+            CheckPackedAccuracy(TPackedProductAvx512VnniASM, 1024);
+        }
+        CheckPackedAccuracy(TPackedProductAvx2Int8ASM, 64);
+        CheckPackedAccuracy(TPackedProductAvx2Int8ASM, 1024);
+
+        #define CheckHalf(name, convert) {\
+            float res[16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            const std::vector<uint16_t> rows = ConvertMatrix(Matrix().cbegin(), 16 * 64, convert);\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), 64, elems, 16, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
+        }
+
+        CheckHalf(THalfProductNaive, FloatToHalf);
+        CheckHalf(THalfProductAvx2F16C, FloatToHalf);
+        CheckHalf(THalfProductAvx512ASM, FloatToHalf);
+        CheckHalf(THalfProductDetectPointer, FloatToHalf);
+        CheckHalf(TBf16ProductNaive, FloatToBf16);
+        CheckHalf(TBf16ProductAvx2, FloatToBf16);
+        CheckHalf(TBf16ProductAvx512ASM, FloatToBf16);
+        if (TRuntimeCpuInfoDispatch::Features.UsableAvx512Bf16()) {
+            CheckHalf(TBf16ProductAvx512Bf16ASM, FloatToBf16);
+        }
+        CheckHalf(TBf16ProductDetectPointer, FloatToBf16);
+
+        // half rows against the float ones, the rows of the first task are copied to a compact matrix
+        #define CheckHalfAccuracy(name, convert, dim) {\
+            const std::vector<ui32>& ids = Tasks()[0].DocIds;\
+            std::vector<float> rows(ids.size() * dim);\
+            std::vector<uint32_t> compactIds(ids.size());\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                std::copy(Matrix().cbegin() + ids[i] * dim, Matrix().cbegin() + (ids[i] + 1) * dim, rows.begin() + i * dim);\
+                compactIds[i] = i;\
+            }\
+            const std::vector<uint16_t> half = ConvertMatrix(rows.data(), rows.size(), convert);\
+            std::vector<float> exact(ids.size());\
+            std::vector<float> res(ids.size());\
+            TMultiDotFromSingle<TNaive>::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), dim, compactIds.data(), ids.size(), exact.data());\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), half.data(), dim, compactIds.data(), ids.size(), res.data());\
+            double maxAbs = 0;\
+            double sumAbs = 0;\
+            double sumExactAbs = 0;\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                maxAbs = std::max(maxAbs, double(std::fabs(res[i] - exact[i])));\
+                sumAbs += std::fabs(res[i] - exact[i]);\
+                sumExactAbs += std::fabs(exact[i]);\
+            }\
+            std::cout << "max abs err " << maxAbs << "\tmean abs err " << sumAbs / ids.size()\
+                << "\tmean rel err " << sumAbs / sumExactAbs << "\t" << #name << "/" << dim << std::endl;\
+        }
+
+        CheckHalfAccuracy(THalfProductDetectPointer, FloatToHalf, 1024);
+        CheckHalfAccuracy(TBf16ProductDetectPointer, FloatToBf16, 1024);
+        if (TRuntimeCpuInfoDispatch::Features.UsableAvx512Bf16()) {
+            CheckHalfAccuracy(TBf16ProductAvx512Bf16ASM, FloatToBf16, 1024);
+        }
+
+        #define CheckNibble(name) {\
+            float res[16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            const std::vector<uint8_t> rows = PackNibbleMatrix(Matrix().cbegin(), 16, 64);\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), 64, elems, 16, 0.7, 0.4, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
+        }
+
+        CheckNibble(TNibbleProductNaive);
+        CheckNibble(TNibbleProductAvx2);
+        CheckNibble(TNibbleProductAvx512);
+        if (TRuntimeCpuInfoDispatch::Features.UsableAvx512Vnni()) {
+            CheckNibble(TNibbleProductAvx512Vnni);
+        }
+        CheckNibble(TNibbleProductDetectPointer);
+
+        // 4 bit rows against the float ones, the naive kernel shows the error of the rows alone
+        #define CheckNibbleAccuracy(name, dim) {\
+            const std::vector<ui32>& ids = Tasks()[0].DocIds;\
+            std::vector<float> rows(ids.size() * dim);\
+            std::vector<uint32_t> compactIds(ids.size());\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                std::copy(Matrix().cbegin() + ids[i] * dim, Matrix().cbegin() + (ids[i] + 1) * dim, rows.begin() + i * dim);\
+                compactIds[i] = i;\
+            }\
+            const std::vector<uint8_t> nibbles = PackNibbleMatrix(rows.data(), ids.size(), dim);\
+            std::vector<float> exact(ids.size());\
+            std::vector<float> res(ids.size());\
+            TMultiDotFromSingle<TNaive>::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), dim, compactIds.data(), ids.size(), exact.data());\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), nibbles.data(), dim, compactIds.data(), ids.size(), 0, 1, res.data());\
+            double maxAbs = 0;\
+            double sumAbs = 0;\
+            double sumExactAbs = 0;\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                maxAbs = std::max(maxAbs, double(std::fabs(res[i] - exact[i])));\
+                sumAbs += std::fabs(res[i] - exact[i]);\
+                sumExactAbs += std::fabs(exact[i]);\
+            }\
+            std::cout << "max abs err " << maxAbs << "\tmean abs err " << sumAbs / ids.size()\
+                << "\tmean rel err " << sumAbs / sumExactAbs << "\t" << #name << "/" << dim << std::endl;\
+        }
+
+        CheckNibbleAccuracy(TNibbleProductNaive, 1024);
+        CheckNibbleAccuracy(TNibbleProductDetectPointer, 300);
+        CheckNibbleAccuracy(TNibbleProductDetectPointer, 1024);
+
+        #define CheckRowScaled(name) {\
+            float res[16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            const std::vector<uint8_t> rows = PackScaledRowsMatrix(Matrix().cbegin(), 16, 64);\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), 64, elems, 16, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
+        }
+
+        CheckRowScaled(TRowScaledProductNaive);
+        CheckRowScaled(TRowScaledProductAvx2);
+        CheckRowScaled(TRowScaledProductAvx512ASM);
+        CheckRowScaled(TRowScaledProductDetectPointer);
+
+        // l2 and cosine of the query to rows 0 and 1 at dim 100, by the definitions first, then by the kernels over
+        // the norms of the first 16 rows; packed values are 0.5 * byte + 0.7 as in CheckPacked
+        const TRowNorms checkNorms = TRowNorms::Compute(Matrix().cbegin(), 16, 100);
+        const TRowNorms checkNorms8 = TRowNorms::Compute(Matrix8().cbegin(), 16, 100, 0.7, 0.5);
+        for(size_t r = 0; r < 2; ++r) {
+            double l2 = 0, dot = 0, aa = 0, bb = 0, l2Packed = 0, dotPacked = 0, bbPacked = 0;
+            for(size_t i = 0; i < 100; ++i) {
+                const double a = Tasks()[0].Query[i];
+                const double b = Matrix()[r * 100 + i];
+                const double packed = 0.5 * Matrix8()[r * 100 + i] + 0.7;
+                l2 += (a - b) * (a - b);
+                dot += a * b;
+                aa += a * a;
+                bb += b * b;
+                l2Packed += (a - packed) * (a - packed);
+                dotPacked += a * packed;
+                bbPacked += packed * packed;
+            }
+            std::cout << l2 << "\t" << dot / std::sqrt(aa * bb) << "\t" << l2Packed << "\t"
+                << dotPacked / std::sqrt(aa * bbPacked) << "\tdistances of row " << r << std::endl;
+        }
+
+        #define CheckDistance(name, norms) {\
+            float res[16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix().cbegin(), 100, norms.data(), elems, 16, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
+        }
+
+        #define CheckPackedDistance(name, norms) {\
+            float res[16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix8().cbegin(), 100, norms.data(), elems, 16, 0.7, 0.5, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
+        }
+
+        CheckDistance(TL2MultiDotNaive, checkNorms.Squared);
+        CheckDistance(TL2MultiDot_SSE42, checkNorms.Squared);
+        CheckDistance(TL2MultiDot_AVX, checkNorms.Squared);
+        CheckDistance(TL2MultiDot_AVX2, checkNorms.Squared);
+        CheckDistance(TL2MultiDot_AVX512, checkNorms.Squared);
+        CheckDistance(TL2MultiDotDetectPointer, checkNorms.Squared);
+        CheckDistance(TCosineMultiDotNaive, checkNorms.Inverse);
+        CheckDistance(TCosineMultiDot_SSE42, checkNorms.Inverse);
+        CheckDistance(TCosineMultiDot_AVX, checkNorms.Inverse);
+        CheckDistance(TCosineMultiDot_AVX2, checkNorms.Inverse);
+        CheckDistance(TCosineMultiDot_AVX512, checkNorms.Inverse);
+        CheckDistance(TCosineMultiDotDetectPointer, checkNorms.Inverse);
+        CheckPackedDistance(TL2PackedNaive, checkNorms8.Squared);
+        CheckPackedDistance(TL2Packed_SSE42, checkNorms8.Squared);
+        CheckPackedDistance(TL2Packed_AVX, checkNorms8.Squared);
+        CheckPackedDistance(TL2Packed_AVX2, checkNorms8.Squared);
+        CheckPackedDistance(TL2Packed_AVX512, checkNorms8.Squared);
+        CheckPackedDistance(TL2PackedDetectPointer, checkNorms8.Squared);
+        CheckPackedDistance(TCosinePackedNaive, checkNorms8.Inverse);
+        CheckPackedDistance(TCosinePacked_SSE42, checkNorms8.Inverse);
+        CheckPackedDistance(TCosinePacked_AVX, checkNorms8.Inverse);
+        CheckPackedDistance(TCosinePacked_AVX2, checkNorms8.Inverse);
+        CheckPackedDistance(TCosinePacked_AVX512, checkNorms8.Inverse);
+        CheckPackedDistance(TCosinePackedDetectPointer, checkNorms8.Inverse);
+
+        // 37 rows of dim 100 scanned whole, the last block partial; max abs err against the gathering naive
+        #define CheckScan(name, blocks) {\
+            std::vector<uint32_t> ids(37);\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                ids[i] = i;\
+            }\
+            std::vector<float> exact(ids.size());\
+            std::vector<float> res(ids.size());\
+            TMultiDotFromSingle<TNaive>::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix().cbegin(), 100, ids.data(), ids.size(), exact.data());\
+            name::FullScan(Tasks()[0].Query.cbegin(), blocks, 100, ids.size(), res.data());\
+            double maxAbs = 0;\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                maxAbs = std::max(maxAbs, double(std::fabs(res[i] - exact[i])));\
+            }\
+            std::cout << res[0] << "\t" << res[36] << "\tmax abs err " << maxAbs << "\t" << #name << std::endl;\
+        }
+
+        const TInterleavedMatrix checkInterleaved(Matrix().cbegin(), 37, 100);
+        CheckScan(TFullScanFromMulti<TMultiDotDetectPointer>, Matrix().cbegin());
+        CheckScan(TInterleavedScanNaive, checkInterleaved.Data());
+        CheckScan(TInterleavedScanAvx2, checkInterleaved.Data());
+        CheckScan(TInterleavedScanAvx512, checkInterleaved.Data());
+        CheckScan(TInterleavedScanStreamAvx512, checkInterleaved.Data());
+        CheckScan(TInterleavedScanDetectPointer, checkInterleaved.Data());
+
+        // the same rows quantized by one range for the whole matrix, by a range per row and by a range per dim
+        #define CheckScaledAccuracy(dim) {\
+            const std::vector<ui32>& ids = Tasks()[0].DocIds;\
+            std::vector<float> rows(ids.size() * dim);\
+            std::vector<uint32_t> compactIds(ids.size());\
+            for(size_t i = 0; i < ids.size(); ++i) {\
+                std::copy(Matrix().cbegin() + ids[i] * dim, Matrix().cbegin() + (ids[i] + 1) * dim, rows.begin() + i * dim);\
+                compactIds[i] = i;\
+            }\
+            std::vector<float> exact(ids.size());\
+            TMultiDotFromSingle<TNaive>::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), dim, compactIds.data(), ids.size(), exact.data());\
+            const auto [minIt, maxIt] = std::minmax_element(rows.data(), rows.data() + rows.size());\
+            const float coeff = (*maxIt - *minIt) / TScaledRows::Levels;\
+            std::vector<uint8_t> global(rows.size());\
+            for(size_t i = 0; i < rows.size(); ++i) {\
+                global[i] = uint8_t(std::lrint((rows[i] - *minIt) / coeff));\
+            }\
+            const std::vector<uint8_t> perRow = PackScaledRowsMatrix(rows.data(), ids.size(), dim);\
+            const TDimScales scales = TDimScales::Fit(rows.data(), ids.size(), dim);\
+            const std::vector<uint8_t> perDim = scales.Pack(rows.data(), ids.size());\
+            std::vector<float> res(ids.size());\
+            for(size_t kind = 0; kind < 3; ++kind) {\
+                if (kind == 0) {\
+                    TPackedProductDetectPointer::MultiDotProduct(Tasks()[0].Query.cbegin(), global.data(), dim, compactIds.data(), ids.size(), *minIt, coeff, res.data());\
+                } else if (kind == 1) {\
+                    TRowScaledProductDetectPointer::MultiDotProduct(Tasks()[0].Query.cbegin(), perRow.data(), dim, compactIds.data(), ids.size(), res.data());\
+                } else {\
+                    TDimScaledProduct<TPackedProductDetectPointer>::MultiDotProduct(Tasks()[0].Query.cbegin(), perDim.data(), dim, scales, compactIds.data(), ids.size(), res.data());\
+                }\
+                double maxAbs = 0;\
+                double sumAbs = 0;\
+                double sumExactAbs = 0;\
+                for(size_t i = 0; i < ids.size(); ++i) {\
+                    maxAbs = std::max(maxAbs, double(std::fabs(res[i] - exact[i])));\
+                    sumAbs += std::fabs(res[i] - exact[i]);\
+                    sumExactAbs += std::fabs(exact[i]);\
+                }\
+                std::cout << "max abs err " << maxAbs << "\tmean abs err " << sumAbs / ids.size()\
+                    << "\tmean rel err " << sumAbs / sumExactAbs << "\t" << (kind == 0 ? "global" : kind == 1 ? "per row" : "per dim")\
+                    << "/" << dim << std::endl;\
+            }\
+        }
+
+        CheckScaledAccuracy(64);
+        CheckScaledAccuracy(1024);
+
+        // pq over the first 4096 rows of dim 64, the ids of the first task folded into them
+        const TPqCodebook pqCodebook = TPqCodebook::Train(Matrix().cbegin(), 4096, 64, 16);
+        const std::vector<uint8_t> pqCodes = pqCodebook.Encode(Matrix().cbegin(), 4096);
+        const std::vector<uint8_t> pqBlocks = PqFastScanLayout(pqCodes.data(), 4096, 16);
+        const TPqLookup pqLookup(pqCodebook, Tasks()[0].Query.cbegin());
+        std::vector<uint32_t> pqIds(40);
+        for(size_t i = 0; i < pqIds.size(); ++i) {
+            pqIds[i] = Tasks()[0].DocIds[i] % 4096;
+        }
+
+        #define CheckPq(name) {\
+            std::vector<float> res(pqIds.size());\
+            std::vector<float> scan(4096);\
+            name::MultiDotProduct(pqLookup, pqCodes.data(), pqIds.data(), pqIds.size(), res.data());\
+            name::FullScan(pqLookup, pqBlocks.data(), 4096 - 5, scan.data());\
+            std::cout << res[0] << "\t" << res[39] << "\t" << scan[pqIds[39]] << "\t" << #name << std::endl;\
+        }
+
+        CheckPq(TPqProductNaive);
+        CheckPq(TPqProductAvx2);
+        CheckPq(TPqProductAvx512);
+        CheckPq(TPqProductDetectPointer);
+
+        // pq scores against the float rows
+        #define CheckPqAccuracy(subspaces) {\
+            const TPqCodebook codebook = TPqCodebook::Train(Matrix().cbegin(), 4096, 64, subspaces);\
+            const std::vector<uint8_t> codes = codebook.Encode(Matrix().cbegin(), 4096);\
+            const TPqLookup lookup(codebook, Tasks()[0].Query.cbegin());\
+            std::vector<float> exact(pqIds.size());\
+            std::vector<float> res(pqIds.size());\
+            TMultiDotFromSingle<TNaive>::MultiDotProduct(Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, pqIds.data(), pqIds.size(), exact.data());\
+            TPqProductDetectPointer::MultiDotProduct(lookup, codes.data(), pqIds.data(), pqIds.size(), res.data());\
+            double sumAbs = 0;\
+            double sumExactAbs = 0;\
+            for(size_t i = 0; i < pqIds.size(); ++i) {\
+                sumAbs += std::fabs(res[i] - exact[i]);\
+                sumExactAbs += std::fabs(exact[i]);\
+            }\
+            std::cout << "mean abs err " << sumAbs / pqIds.size() << "\tmean rel err " << sumAbs / sumExactAbs\
+                << "\tpq " << subspaces << " x 4 bit/64" << std::endl;\
+        }
+
+        CheckPqAccuracy(8);
+        CheckPqAccuracy(16);
+        CheckPqAccuracy(32);
+
+        #define CheckBinary(name) {\
+            float res[16];\
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};\
+            const std::vector<uint64_t> rows = PackSignMatrix(Matrix().cbegin(), 16, 100);\
+            name::MultiDotProduct(Tasks()[0].Query.cbegin(), rows.data(), 100, elems, 16, res);\
+            std::cout << res[0] << "\t" << res[1] << "\t" << #name << std::endl;\
+        }
+
+        CheckBinary(TBinaryProductNaive);
+        CheckBinary(TBinaryProductAvx2);
+        CheckBinary(TBinaryProductAvx512);
+        CheckBinary(TBinaryProductDetectPointer);
+        CheckBinary(THammingProductNaive);
+        CheckBinary(THammingProductPopcnt);
+        CheckBinary(THammingProductAvx2);
+        if (TRuntimeCpuInfoDispatch::Features.UsableAvx512Vpopcntdq()) {
+            CheckBinary(THammingProductAvx512Vpopcnt);
+        }
+        CheckBinary(THammingProductDetectPointer);
+
+        // ids from both halves of the matrix, so a 2 node shard routes them to both nodes
+        #define CheckNuma(placement) {\
+            float res[16];\
+            uint32_t elems[16] = {4095, 0, 2048, 1, 2047, 3, 4000, 5, 6, 2049, 8, 9, 3000, 11, 12, 13};\
+            const TNumaTopology topology = TNumaTopology::Simulate(2);\
+            const TNumaMatrix<float> numaMatrix(Matrix().cbegin(), 4096, 64, topology, placement);\
+            TNumaMultiDot<TMultiDotDetectPointer> numaDot(numaMatrix, topology);\
+            numaDot.MultiDotProduct(Tasks()[0].Query.cbegin(), elems, 16, res);\
+            std::cout << res[1] << "\t" << res[3] << "\t" << res[0] << "\tnuma " << ToString(placement)\
+                << " remote " << numaDot.Stats().RemoteRatio() << std::endl;\
+        }
+
+        CheckNuma(ENumaPlacement::FirstTouch);
+        CheckNuma(ENumaPlacement::Interleave);
+        CheckNuma(ENumaPlacement::Replicate);
+        CheckNuma(ENumaPlacement::Shard);
+
+        // a small trial matrix and no cache file keep the startup short, the benchmark tunes on real sizes
+        {
+            float res[16];
+            uint32_t elems[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+            TMultiDotAutotuner tuner(TRuntimeCpuInfoDispatch::Features, {"", 4u << 20, 1024, 2});
+            tuner.Select(64)(Tasks()[0].Query.cbegin(), Matrix().cbegin(), 64, elems, 16, res);
+            std::cout << res[0] << "\t" << res[1] << "\tTMultiDotAutotuner " << tuner.SelectedName(64)
+                << " of " << tuner.Candidates().size() << " on " << CpuModel() << std::endl;
+        }
+
+        // the peaks the roof counters of the benchmarks are taken against
+        const TRooflinePeaks& peaks = TRooflinePeaks::Host();
+        std::cout << "roofline: read " << peaks.ReadGBs << " GB/s, triad " << peaks.TriadGBs << " GB/s, "
+            << peaks.FlopsIsa << " " << peaks.GFlops << " GFLOP/s, ridge " << peaks.Ridge() << " flop/byte" << std::endl;
+
+        // an event the host does not count is left out of the benchmark counters
+        const TPerfCounters perf;
+        std::cout << "perf counters:";
+        for(size_t i = 0; i < PerfEventsNum; i += 1) {
+            std::cout << " " << ToString(EPerfEvent(i)) << (perf.Available(EPerfEvent(i)) ? "" : " (unavailable)");
+        }
+        std::cout << std::endl;
     }
 } Base;
 
+// first, so an unfiltered run opens with the check prints as before; a filtered run skips them with their data
+static void Checks(benchmark::State& state) {
+    for (auto _ : state) {
+        Base.PrintChecks();
+    }
+}
+BENCHMARK(Checks)->Iterations(1);
+
+// traffic and work of an iteration that scores docs rows of dim values of valueBytes each (a fraction for sub-byte
+// codes) against queries queries: the rows, their ids of idBytes (0 for a full scan) and the queries read, the results
+// written. Rows count as their bytes, not as the cache lines they span.
+// The rate counters are per second, timePerDoc is their inverse;
+// roof is the share of the roofline the kernel reaches at its intensity, 1 is the memory or the fma limit. The peaks
+// are single thread ones, so roof is left out for a run on threads > 1 threads: the memory peak does not scale with
+// them and a scaled one would be a guess
+inline void SetRooflineCounters(
+    benchmark::State& state,
+    size_t docs,
+    size_t dim,
+    double valueBytes,
+    double seconds,
+    size_t idBytes = sizeof(uint32_t),
+    size_t queries = 1,
+    size_t threads = 1
+) {
+    const double bytes = docs * (dim * valueBytes + idBytes + queries * sizeof(float)) + queries * dim * sizeof(float);
+    const double flops = 2.0 * docs * dim * queries;
+    const TRooflinePoint point{bytes * state.iterations(), flops * state.iterations(), seconds};
+    state.counters["bytes"] = bytes;
+    state.counters["bytesPerSec"] = benchmark::Counter(bytes, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["flopsPerSec"] = benchmark::Counter(flops, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["docsPerSec"] = benchmark::Counter(docs, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["timePerDoc"] = benchmark::Counter(
+        docs, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert
+    );
+    state.counters["intensity"] = point.Intensity();
+    if (threads == 1) {
+        state.counters["roof"] = point.Efficiency(TRooflinePeaks::Host());
+    }
+}
+
+// the hardware counters that opened, per doc; ipc when both cycles and instructions did
+inline void SetPerfCounters(benchmark::State& state, const TPerfCounters& perf, size_t docs) {
+    static const std::pair<EPerfEvent, const char*> perDoc[] = {
+        {EPerfEvent::Cycles, "cyclesPerDoc"},
+        {EPerfEvent::Instructions, "instrPerDoc"},
+        {EPerfEvent::LlcMisses, "llcMissPerDoc"},
+        {EPerfEvent::DtlbMisses, "dtlbMissPerDoc"},
+    };
+    for(const auto& [event, name] : perDoc) {
+        if (perf.Available(event)) {
+            state.counters[name] = benchmark::Counter(perf.Value(event) / docs, benchmark::Counter::kAvgIterations);
+        }
+    }
+    if (perf.Available(EPerfEvent::Cycles) && perf.Available(EPerfEvent::Instructions)) {
+        state.counters["ipc"] = perf.Value(EPerfEvent::Instructions) / perf.Value(EPerfEvent::Cycles);
+    }
+}
+
+// wall time and hardware counters of a benchmark loop, from the construction to Report; threads the loop runs on
+class TBenchMeter {
+public:
+    explicit TBenchMeter(size_t threads = 1)
+        : Threads_(threads)
+    {
+        Perf_.Start();
+        Start_ = std::chrono::steady_clock::now();
+    }
+
+    // around the untimed parts of an iteration, with state.PauseTiming and ResumeTiming
+    void Pause() {
+        Perf_.Stop();
+        Paused_ = std::chrono::steady_clock::now();
+    }
+
+    void Resume() {
+        Skipped_ += std::chrono::steady_clock::now() - Paused_;
+        Perf_.Resume();
+    }
+
+    void Report(
+        benchmark::State& state,
+        size_t docs,
+        size_t dim,
+        double valueBytes,
+        size_t idBytes = sizeof(uint32_t),
+        size_t queries = 1
+    ) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - Start_ - Skipped_;
+        Perf_.Stop();
+        SetRooflineCounters(state, docs, dim, valueBytes, elapsed.count(), idBytes, queries, Threads_);
+        SetPerfCounters(state, Perf_, docs);
+    }
+
+private:
+    size_t Threads_;
+    TPerfCounters Perf_;
+    std::chrono::steady_clock::time_point Start_;
+    std::chrono::steady_clock::time_point Paused_;
+    std::chrono::steady_clock::duration Skipped_{};
+};
+
 template<class TProductImpl>
 inline void DotProductBench(benchmark::State& state) {
     size_t taskId = 0;
     size_t dim = state.range(0);
+    // made before the timed loop on the first run
+    const std::vector<float>& matrix = Base.Matrix();
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
     for (auto _ : state) {
         for(size_t c = 0; c < CasesNumPerTask; c += 1) {
-            size_t rowId = Base.Tasks[taskId].DocIds[c];
+            size_t rowId = tasks[taskId].DocIds[c];
             float caseRes = TProductImpl::DotProduct(
-                Base.Tasks[taskId].Query.cbegin(),
-                Base.Matrix.cbegin() + rowId * dim,
+                tasks[taskId].Query.cbegin(),
+                matrix.cbegin() + rowId * dim,
                 dim
             );
             benchmark::DoNotOptimize(caseRes);
@@ -168,6 +984,7 @@ inline void DotProductBench(benchmark::State& state) {
         taskId += 1;
         taskId = taskId % TasksNum;
     }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(float));
 }
 
 #define DeclareBenchN(CL, name) \
@@ -180,14 +997,18 @@ template<class TProductImpl>
 inline void DotProductBenchDouble(benchmark::State& state) {
     size_t taskId = 0;
     size_t dim = state.range(0);
+    // made before the timed loop on the first run
+    const std::vector<float>& matrix = Base.Matrix();
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
     for (auto _ : state) {
         for(size_t c = 0; c < CasesNumPerTask; c += 2) {
-            size_t rowId1 = Base.Tasks[taskId].DocIds[c];
-            size_t rowId2 = Base.Tasks[taskId].DocIds[c+1];
+            size_t rowId1 = tasks[taskId].DocIds[c];
+            size_t rowId2 = tasks[taskId].DocIds[c+1];
             std::pair<float, float> caseRes = TProductImpl::DotProductDouble(
-                Base.Tasks[taskId].Query.cbegin(),
-                Base.Matrix.cbegin() + rowId1 * dim,
-                Base.Matrix.cbegin() + rowId2 * dim,
+                tasks[taskId].Query.cbegin(),
+                matrix.cbegin() + rowId1 * dim,
+                matrix.cbegin() + rowId2 * dim,
                 dim
             );
             benchmark::DoNotOptimize(caseRes);
@@ -195,6 +1016,7 @@ inline void DotProductBenchDouble(benchmark::State& state) {
         taskId += 1;
         taskId = taskId % TasksNum;
     }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(float));
 }
 
 
@@ -209,19 +1031,24 @@ inline void DotProductBenchMulti(benchmark::State& state) {
     size_t taskId = 0;
     size_t dim = state.range(0);
     std::vector<float> results(CasesNumPerTask, 0.f);
+    // made before the timed loop on the first run
+    const std::vector<float>& matrix = Base.Matrix();
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
     for (auto _ : state) {
         TProductImpl::MultiDotProduct(
-            Base.Tasks[taskId].Query.cbegin(),
-            Base.Matrix.cbegin(),
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
             dim,
-            Base.Tasks[taskId].DocIds.cbegin(),
-            Base.Tasks[taskId].DocIds.size(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
             results.begin()
         );
         benchmark::DoNotOptimize(results);
         taskId += 1;
         taskId = taskId % TasksNum;
     }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(float));
 }
 
 #define DeclareBenchMultiN(CL, name) \
@@ -268,7 +1095,8 @@ DeclareBench(TNaiveAvx2Auto)
 DeclareBench(TNaiveAvx512Auto)
     ->B_RANGES;
 DeclareBench(TNaiveAvx512ASM)
-    ->B_RANGES;
+    ->B_RANGES
+    ->B_RANGES_TAIL;
 
 DeclareBench(TDetectOptimistic)
     ->B_RANGES;
@@ -278,6 +1106,12 @@ DeclareBench(TDetectJump)
     ->B_RANGES;
 DeclareBench(TVirtualJump)
     ->B_RANGES;
+DeclareBench(TDetectPointer)
+    ->B_RANGES;
+// 96 is a fixed dim, 200 and 300 fall back to the generic kernels
+DeclareBench(TFixedDimDetectPointer)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
 
 DeclareBenchMulti(TMultiDotAll)
     ->B_RANGES;
@@ -300,9 +1134,29 @@ DeclareBenchMulti(TMultiDotCTStepV3FloatOpts_AVX2)
 DeclareBenchMulti(TMultiDotCTStepV3FloatOpts_AVX512)
     ->B_RANGES;
 DeclareBenchMulti(TMultiDotV3_ASM_PREFETCH_AVX512)
-    ->B_RANGES;
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMulti(TMultiDotDeepPrefetchAVX512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
 DeclareBenchMulti(TMultiDotV3_ASM_AVX512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMulti(TMultiDotDetectPointer)
     ->B_RANGES;
+DeclareBenchMulti(TFixedDimMultiDotDetectPointer)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+
+// tuned before the timed loop, the label is the kernel the default tuner picked for the dim
+static void DotPrMulti_TMultiDotAutotuned(benchmark::State& state) {
+    TMultiDotAutotuner::Default().Tune({size_t(state.range(0))});
+    state.SetLabel(TMultiDotAutotuner::Default().SelectedName(state.range(0)));
+    DotProductBenchMulti<TMultiDotAutotuned>(state);
+}
+BENCHMARK(DotPrMulti_TMultiDotAutotuned)->Unit(benchmark::kMillisecond)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
 
 #define DeclareMultiDotVariantsByStep(Step)\
 DeclareBenchMultiN(TMultiDotCTStep<Step>, TMultiDotCTStep_##Step)\
@@ -337,50 +1191,1298 @@ DeclareMultiDotVariantsByStep(6)
 // DeclareMultiDotVariantsByStep(16)
 
 
-template<class TProductImpl>
-inline void PackedDotProductBenchMulti(benchmark::State& state) {
+// queries of range(1) consecutive tasks are packed with dim stride, every iteration scores all of them
+template<class TProductImpl, class TMatrix, class... TArgs>
+inline void DotProductBenchMultiQuery(benchmark::State& state, const TMatrix& matrix, TArgs... args) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    size_t queriesNum = state.range(1);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    std::vector<std::vector<float>> queries(TasksNum);
+    for(size_t t = 0; t < TasksNum; ++t) {
+        for(size_t q = 0; q < queriesNum; ++q) {
+            const std::vector<float>& query = tasks[(t + q) % TasksNum].Query;
+            queries[t].insert(queries[t].end(), query.cbegin(), query.cbegin() + dim);
+        }
+    }
+    std::vector<float> results(queriesNum * CasesNumPerTask, 0.f);
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiQueryDotProduct(
+            queries[taskId].cbegin(),
+            queriesNum,
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            args...,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(matrix[0]), sizeof(uint32_t), queriesNum);
+    state.counters["queries"] = benchmark::Counter(queriesNum, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+#define B_RANGES_QUERIES ArgsProduct({{64, 128, 1024}, {1, 4, 8, 32}})
+
+#define DeclareBenchMultiQueryN(CL, name) \
+static void DotPrMultiQuery_##name(benchmark::State& state) {DotProductBenchMultiQuery<CL>(state, Base.Matrix());} \
+BENCHMARK(DotPrMultiQuery_##name)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchMultiQuery(CL) DeclareBenchMultiQueryN(CL, CL)
+
+#define DeclareBenchPackedMultiQueryN(CL, name) \
+static void DotPrPackedMultiQuery_##name(benchmark::State& state) {\
+    DotProductBenchMultiQuery<CL>(state, Base.Matrix8(), 0.7f, 0.4f);\
+} \
+BENCHMARK(DotPrPackedMultiQuery_##name)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchPackedMultiQuery(CL) DeclareBenchPackedMultiQueryN(CL, CL)
+
+DeclareBenchMultiQueryN(TMultiQueryFromMulti<TMultiDotV3_ASM_AVX512>, TMultiQueryFromMulti_ASM_AVX512)
+    ->B_RANGES_QUERIES;
+DeclareBenchMultiQuery(TMultiQueryFloatOpts_SSE42)
+    ->B_RANGES_QUERIES;
+DeclareBenchMultiQuery(TMultiQueryFloatOpts_AVX)
+    ->B_RANGES_QUERIES;
+DeclareBenchMultiQuery(TMultiQueryFloatOpts_AVX2)
+    ->B_RANGES_QUERIES;
+DeclareBenchMultiQuery(TMultiQueryFloatOpts_AVX512)
+    ->B_RANGES_QUERIES;
+DeclareBenchMultiQuery(TMultiQueryASM_AVX512)
+    ->B_RANGES_QUERIES;
+DeclareBenchMultiQuery(TMultiQueryDetectPointer)
+    ->B_RANGES_QUERIES;
+
+DeclareBenchPackedMultiQueryN(TPackedMultiQueryFromMulti<TPackedProductAvx512ASM>, TPackedMultiQueryFromMulti_Avx512ASM)
+    ->B_RANGES_QUERIES;
+DeclareBenchPackedMultiQuery(TPackedMultiQueryOpts_AVX2)
+    ->B_RANGES_QUERIES;
+DeclareBenchPackedMultiQuery(TPackedMultiQueryOpts_AVX512)
+    ->B_RANGES_QUERIES;
+DeclareBenchPackedMultiQuery(TPackedMultiQueryAvx512ASM)
+    ->B_RANGES_QUERIES;
+DeclareBenchPackedMultiQuery(TPackedMultiQueryDetectPointer)
+    ->B_RANGES_QUERIES;
+
+// scoring fused with selection of range(1) best, against MultiDotProduct + nth_element in TMultiDotThenSelect
+template<class TTopKImpl, class TMatrix, class... TArgs>
+inline void DotProductBenchTopK(benchmark::State& state, const TMatrix& matrix, TArgs... args) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    size_t topK = state.range(1);
+    std::vector<uint32_t> topIds(topK);
+    std::vector<float> topScores(topK);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        size_t found = TTopKImpl::MultiDotProductTopK(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            args...,
+            topK,
+            topIds.begin(),
+            topScores.begin()
+        );
+        benchmark::DoNotOptimize(found);
+        benchmark::DoNotOptimize(topScores);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(matrix[0]));
+}
+
+#define B_RANGES_TOPK ArgsProduct({{64, 128, 1024}, {10, 100}})
+
+#define DeclareBenchTopKN(CL, name) \
+static void DotPrTopK_##name(benchmark::State& state) {DotProductBenchTopK<CL>(state, Base.Matrix());} \
+BENCHMARK(DotPrTopK_##name)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchPackedTopKN(CL, name) \
+static void DotPrPackedTopK_##name(benchmark::State& state) {DotProductBenchTopK<CL>(state, Base.Matrix8(), 0.7f, 0.4f);} \
+BENCHMARK(DotPrPackedTopK_##name)->Unit(benchmark::kMillisecond)
+
+DeclareBenchTopKN(TMultiDotThenSelect<TMultiDotV3_ASM_AVX512>, ThenSelect_ASM_AVX512)
+    ->B_RANGES_TOPK;
+DeclareBenchTopKN(TMultiDotTopK<TMultiDotV3_ASM_AVX512>, TopK_ASM_AVX512_Scalar)
+    ->B_RANGES_TOPK;
+DeclareBenchTopKN(TTopKAsmAvx512FilterAvx512, TopK_ASM_AVX512_Avx512)
+    ->B_RANGES_TOPK;
+DeclareBenchTopKN(TTopKAvx2Step5FilterAvx2, TopK_AVX2_5_Avx2)
+    ->B_RANGES_TOPK;
+DeclareBenchTopKN(TMultiDotTopK<TMultiDotDetectPointer>, TopK_DetectPointer)
+    ->B_RANGES_TOPK;
+
+DeclareBenchPackedTopKN(TPackedProductThenSelect<TPackedProductAvx512ASM>, ThenSelect_Avx512ASM)
+    ->B_RANGES_TOPK;
+DeclareBenchPackedTopKN(TPackedTopKAvx512ASMFilterAvx512, TopK_Avx512ASM_Avx512)
+    ->B_RANGES_TOPK;
+DeclareBenchPackedTopKN(TPackedProductTopK<TPackedProductDetectPointer>, TopK_DetectPointer)
+    ->B_RANGES_TOPK;
+
+// range(1) threads including the caller, the pool is built outside of the timed loop. It starts after the meter,
+// so its threads inherit the hardware counters, and its start is not timed
+template<class TParallelImpl, class TMatrix, class... TArgs>
+inline void DotProductBenchParallel(benchmark::State& state, const TMatrix& matrix, TArgs... args) {
     size_t taskId = 0;
     size_t dim = state.range(0);
     std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter(state.range(1));
+    meter.Pause();
+    TWorkStealingPool pool(state.range(1));
+    meter.Resume();
+    for (auto _ : state) {
+        TParallelImpl::MultiDotProductOn(
+            pool,
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            args...,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(matrix[0]));
+    state.counters["rows"] = benchmark::Counter(CasesNumPerTask, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// 1, 2, 4 ... threads up to the number of cores
+static void ParallelRanges(benchmark::internal::Benchmark* b) {
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int dim : {128, 1024}) {
+        for (int threads = 1; threads < cores; threads *= 2) {
+            b->Args({dim, threads});
+        }
+        b->Args({dim, cores});
+    }
+}
+
+#define DeclareBenchParallelN(CL, name) \
+static void DotPrParallel_##name(benchmark::State& state) {DotProductBenchParallel<CL>(state, Base.Matrix());} \
+BENCHMARK(DotPrParallel_##name)->Unit(benchmark::kMillisecond)->UseRealTime()
+
+#define DeclareBenchPackedParallelN(CL, name) \
+static void DotPrPackedParallel_##name(benchmark::State& state) {\
+    DotProductBenchParallel<CL>(state, Base.Matrix8(), 0.7f, 0.4f);\
+} \
+BENCHMARK(DotPrPackedParallel_##name)->Unit(benchmark::kMillisecond)->UseRealTime()
+
+DeclareBenchParallelN(TParallelMultiDot<TMultiDotV3_ASM_PREFETCH_AVX512>, ASM_PREFETCH_AVX512)
+    ->Apply(ParallelRanges);
+DeclareBenchParallelN(TParallelMultiDot<TMultiDotDetectPointer>, DetectPointer)
+    ->Apply(ParallelRanges);
+
+DeclareBenchPackedParallelN(TParallelPackedProduct<TPackedProductAvx512ASM>, Avx512ASM)
+    ->Apply(ParallelRanges);
+DeclareBenchPackedParallelN(TParallelPackedProduct<TPackedProductDetectPointer>, DetectPointer)
+    ->Apply(ParallelRanges);
+
+// range(1) candidates from the tasks concatenated, range(2) rows of the matrix they fall into,
+// so the reordered kernels can be compared with the plain ones over candidate count and matrix size
+template<class TProductImpl, class TMatrix, class... TArgs>
+inline void DotProductBenchLocality(benchmark::State& state, const TMatrix& matrix, TArgs... args) {
+    size_t dim = state.range(0);
+    size_t candidates = state.range(1);
+    size_t rows = std::min<size_t>(state.range(2), MaxRowNumber);
+    if (candidates > rows) {
+        state.SkipWithError("more candidates than rows");
+        return;
+    }
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    // distinct ids, so the reordered kernels have nothing to merge and both variants score the same rows. One pass
+    // over the ids of all tasks at most: a skewed DOT_PRODUCT_IDS may have fewer distinct rows than candidates
+    std::vector<std::vector<uint32_t>> ids(TasksNum);
+    std::vector<bool> taken(rows);
+    for(size_t t = 0; t < TasksNum; t += 1) {
+        ids[t].reserve(candidates);
+        for(size_t k = 0; ids[t].size() < candidates && k < TasksNum * CasesNumPerTask; k += 1) {
+            const uint32_t id = tasks[(t + k / CasesNumPerTask) % TasksNum].DocIds[k % CasesNumPerTask] % rows;
+            if (!taken[id]) {
+                taken[id] = true;
+                ids[t].push_back(id);
+            }
+        }
+        for(uint32_t id : ids[t]) {
+            taken[id] = false;
+        }
+        if (ids[t].size() < candidates) {
+            state.SkipWithError("fewer distinct task ids than candidates");
+            return;
+        }
+    }
+    size_t taskId = 0;
+    std::vector<float> results(candidates, 0.f);
+    TBenchMeter meter;
     for (auto _ : state) {
         TProductImpl::MultiDotProduct(
-            Base.Tasks[taskId].Query.cbegin(),
-            Base.Matrix8.cbegin(),
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
             dim,
-            Base.Tasks[taskId].DocIds.cbegin(),
-            Base.Tasks[taskId].DocIds.size(),
-            0.7,
-            0.4,
+            ids[taskId].cbegin(),
+            candidates,
+            args...,
             results.begin()
         );
         benchmark::DoNotOptimize(results);
         taskId += 1;
         taskId = taskId % TasksNum;
     }
+    meter.Report(state, candidates, dim, sizeof(matrix[0]));
+    state.counters["rows"] = benchmark::Counter(candidates, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["matrixMB"] = rows * dim * sizeof(matrix[0]) >> 20;
+    // mean length of the runs of adjacent rows the reordered kernels stream
+    TLocalityOrder order;
+    size_t runs = 0;
+    for(size_t t = 0; t < TasksNum; t += 1) {
+        order.Build(ids[t].data(), candidates);
+        runs += order.RunsNum();
+    }
+    state.counters["meanRun"] = double(TasksNum * candidates) / std::max<size_t>(runs, 1);
 }
 
-#define DeclareBenchMultiPackedN(CL, name) \
-static void DotPrMultiPacked_##name(benchmark::State& state) {PackedDotProductBenchMulti<CL>(state);} \
-BENCHMARK(DotPrMultiPacked_##name)->Unit(benchmark::kMillisecond)
+#define B_RANGES_LOCALITY ArgsProduct({{128, 1024}, {1024, 10 * 1024, 100 * 1024}, {16 * 1024, 1024 * 1024}})
 
-#define DeclareBenchMultiPacked(CL) DeclareBenchMultiPackedN(CL, CL)
+#define DeclareBenchLocalityN(CL, name) \
+static void DotPrLocality_##name(benchmark::State& state) {DotProductBenchLocality<CL>(state, Base.Matrix());} \
+BENCHMARK(DotPrLocality_##name)->Unit(benchmark::kMillisecond)
 
-DeclareBenchMultiPackedN(TPackedProductUnpack<TNaive>, Packed_Naive)
-    ->B_RANGES;
+#define DeclareBenchPackedLocalityN(CL, name) \
+static void DotPrPackedLocality_##name(benchmark::State& state) {\
+    DotProductBenchLocality<CL>(state, Base.Matrix8(), 0.7f, 0.4f);\
+} \
+BENCHMARK(DotPrPackedLocality_##name)->Unit(benchmark::kMillisecond)
 
-DeclareBenchMultiPackedN(TPackedProductUnpack<TVirtualJump>, Packed_Virtual)
-    ->B_RANGES;
+DeclareBenchLocalityN(TMultiDotV3_ASM_PREFETCH_AVX512, ASM_PREFETCH_AVX512)
+    ->B_RANGES_LOCALITY;
+DeclareBenchLocalityN(TReorderedMultiDot<TMultiDotV3_ASM_PREFETCH_AVX512>, Reordered_ASM_PREFETCH_AVX512)
+    ->B_RANGES_LOCALITY;
+DeclareBenchLocalityN(TMultiDotDetectPointer, DetectPointer)
+    ->B_RANGES_LOCALITY;
+DeclareBenchLocalityN(TReorderedMultiDot<TMultiDotDetectPointer>, Reordered_DetectPointer)
+    ->B_RANGES_LOCALITY;
 
-DeclareBenchMultiPacked(TPackedProductInlined)
-    ->B_RANGES;
-DeclareBenchMultiPacked(TPackedProductInlinedAvx512Auto)
-    ->B_RANGES;
+DeclareBenchPackedLocalityN(TPackedProductAvx512ASM, Avx512ASM)
+    ->B_RANGES_LOCALITY;
+DeclareBenchPackedLocalityN(TReorderedPackedProduct<TPackedProductAvx512ASM>, Reordered_Avx512ASM)
+    ->B_RANGES_LOCALITY;
 
-DeclareBenchMultiPacked(TPackedProductInlinedWithMath)
-    ->B_RANGES;
-DeclareBenchMultiPacked(TPackedProductInlinedWithMathAvx512Auto)
-    ->B_RANGES;
-DeclareBenchMultiPacked(TPackedProductAvx512ASM)
-    ->B_RANGES;
-DeclareBenchMultiPacked(TPackedProductV2Avx512ASM)
-    ->B_RANGES;
+// range(1) prefetch distance in blocks of 4 rows, range(2) hint: 0 - T0, 1 - T1, 2 - NTA
+template<class TProductImpl, class TMatrix, class... TArgs>
+inline void DotProductBenchPrefetch(benchmark::State& state, const TMatrix& matrix, TArgs... args) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    TPrefetchConfig config;
+    config.Distance = state.range(1);
+    config.Hint = EPrefetchHint(state.range(2));
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProductWith(
+            config,
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            args...,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(matrix[0]));
+}
+
+#define B_RANGES_PREFETCH ArgsProduct({{128, 1024}, {0, 1, 2, 4, 8, 16}, {0, 1, 2}})
+
+static void DotPrPrefetch_DeepPrefetchAVX512(benchmark::State& state) {
+    DotProductBenchPrefetch<TMultiDotDeepPrefetchAVX512>(state, Base.Matrix());
+}
+BENCHMARK(DotPrPrefetch_DeepPrefetchAVX512)->Unit(benchmark::kMillisecond)->B_RANGES_PREFETCH;
+
+static void DotPrPackedPrefetch_DeepPrefetchAvx512ASM(benchmark::State& state) {
+    DotProductBenchPrefetch<TPackedProductDeepPrefetchAvx512ASM>(state, Base.Matrix8(), 0.7f, 0.4f);
+}
+BENCHMARK(DotPrPackedPrefetch_DeepPrefetchAvx512ASM)->Unit(benchmark::kMillisecond)->B_RANGES_PREFETCH;
+
+// the candidate id patterns of DotPrAccess, range(1) is an index here
+static const TIdDistribution AccessPatterns[] = {
+    TIdDistribution::Parse("uniform"),
+    TIdDistribution::Parse("zipf:0.8"),
+    TIdDistribution::Parse("zipf:1.1"),
+    TIdDistribution::Parse("clustered:64:4096"),
+    TIdDistribution::Parse("sorted"),
+};
+
+// the ids of a pattern for every task, drawn on first use
+static const std::vector<std::vector<uint32_t>>& AccessIds(size_t pattern) {
+    static std::map<size_t, std::vector<std::vector<uint32_t>>> ids;
+    auto& lists = ids[pattern];
+    if (lists.empty()) {
+        lists = GenerateIds(AccessPatterns[pattern], MaxRowNumber, TasksNum, CasesNumPerTask, 29);
+    }
+    return lists;
+}
+
+// what the rows of an iteration find in the caches
+enum class ECacheMode {
+    // the tasks in turn as in the other benchmarks: hot rows stay cached between tasks, the rest miss
+    Mixed,
+    // the rows of the task flushed from every cache level before the iteration, untimed
+    Cold,
+    // one task over and over after an untimed pass, its rows stay cached as far as they fit
+    Warm,
+};
+
+static const char* ToString(ECacheMode mode) {
+    switch (mode) {
+        case ECacheMode::Mixed: return "mixed";
+        case ECacheMode::Cold: return "cold";
+        case ECacheMode::Warm: return "warm";
+    }
+    return "unknown";
+}
+
+// clflush reaches every level and every core, unlike a sweep over a buffer sized by a guess of the llc
+template<class T>
+static void FlushRows(const T* matrix, size_t dim, const std::vector<uint32_t>& ids) {
+    constexpr size_t LineBytes = 64;
+    for(uint32_t id : ids) {
+        const char* row = reinterpret_cast<const char*>(matrix + id * dim);
+        for(size_t offset = 0; offset < dim * sizeof(T); offset += LineBytes) {
+            _mm_clflush(row + offset);
+        }
+        _mm_clflush(row + dim * sizeof(T) - 1);
+    }
+    _mm_mfence();
+}
+
+// range(0) dim, range(1) AccessPatterns index, range(2) ECacheMode
+template<class TProductImpl, class TMatrix, class... TArgs>
+inline void DotProductBenchAccess(benchmark::State& state, const TMatrix& matrix, TArgs... args) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    const auto& ids = AccessIds(state.range(1));
+    const ECacheMode mode = ECacheMode(state.range(2));
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    const auto run = [&] {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            ids[taskId].cbegin(),
+            CasesNumPerTask,
+            args...,
+            results.begin()
+        );
+    };
+    if (mode == ECacheMode::Warm) {
+        run();
+    }
+    TBenchMeter meter;
+    for (auto _ : state) {
+        if (mode == ECacheMode::Cold) {
+            state.PauseTiming();
+            meter.Pause();
+            FlushRows(matrix.data(), dim, ids[taskId]);
+            meter.Resume();
+            state.ResumeTiming();
+        }
+        run();
+        benchmark::DoNotOptimize(results);
+        if (mode != ECacheMode::Warm) {
+            taskId += 1;
+            taskId = taskId % TasksNum;
+        }
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(matrix[0]));
+    state.SetLabel(AccessPatterns[state.range(1)].ToString() + " " + ToString(mode));
+}
+
+#define B_RANGES_ACCESS ArgsProduct({{128, 1024}, {0, 1, 2, 3, 4}, {0, 1, 2}})
+
+#define DeclareBenchAccessN(CL, name) \
+static void DotPrAccess_##name(benchmark::State& state) {DotProductBenchAccess<CL>(state, Base.Matrix());} \
+BENCHMARK(DotPrAccess_##name)->Unit(benchmark::kMillisecond)->B_RANGES_ACCESS
+
+#define DeclareBenchPackedAccessN(CL, name) \
+static void DotPrPackedAccess_##name(benchmark::State& state) {\
+    DotProductBenchAccess<CL>(state, Base.Matrix8(), 0.7f, 0.4f);\
+} \
+BENCHMARK(DotPrPackedAccess_##name)->Unit(benchmark::kMillisecond)->B_RANGES_ACCESS
+
+DeclareBenchAccessN(TMultiDotDetectPointer, DetectPointer);
+DeclareBenchAccessN(TMultiDotV3_ASM_PREFETCH_AVX512, ASM_PREFETCH_AVX512);
+DeclareBenchAccessN(TReorderedMultiDot<TMultiDotDetectPointer>, Reordered_DetectPointer);
+DeclareBenchPackedAccessN(TPackedProductDetectPointer, DetectPointer);
+
+// bias and coeff of the mapped benches, in the header of the file
+constexpr float MappedBias = 0.7f;
+constexpr float MappedCoeff = 0.4f;
+
+// a matrix file of the stand: a snapshot kept for the next runs or a temporary one removed at exit
+struct TStandFile {
+    std::string Path;
+    bool Temporary = false;
+
+    ~TStandFile() {
+        if (Temporary) {
+            std::remove(Path.c_str());
+        }
+    }
+};
+
+// Matrix8 rows as a file of range(0) dim, written once per dim to $DOT_PRODUCT_SNAPSHOT_DIR and reused by later runs,
+// or to $TMPDIR for this run only
+static const std::string& PackedMatrixFile(size_t dim) {
+    static std::map<size_t, TStandFile> files;
+    TStandFile& file = files[dim];
+    if (file.Path.empty()) {
+        file.Path = SnapshotPath("matrix8_" + std::to_string(dim));
+        if (!file.Path.empty() && access(file.Path.c_str(), R_OK) == 0) {
+            return file.Path;
+        }
+        if (file.Path.empty()) {
+            const char* tmp = std::getenv("TMPDIR");
+            file.Path = std::string(tmp ? tmp : "/tmp") + "/dot_stand_matrix8_" + std::to_string(dim) + "_"
+                + std::to_string(getpid()) + ".bin";
+            file.Temporary = true;
+        }
+        TMatrixFileOptions options;
+        options.Bias = MappedBias;
+        options.Coeff = MappedCoeff;
+        WriteMatrixFile(file.Path, Base.Matrix8().data(), MatrixSize / dim, dim, options);
+    }
+    return file.Path;
+}
+
+// range(1) - MAP_POPULATE, the file is in the page cache after the first iteration
+static void DotPrMappedOpen(benchmark::State& state) {
+    const std::string& path = PackedMatrixFile(state.range(0));
+    TMapOptions options;
+    options.Populate = state.range(1);
+    for (auto _ : state) {
+        TMappedMatrix matrix(path, options);
+        benchmark::DoNotOptimize(matrix.Bytes());
+    }
+}
+BENCHMARK(DotPrMappedOpen)->Unit(benchmark::kMillisecond)->ArgsProduct({{128}, {0, 1}});
+
+template<class TProductImpl>
+inline void PackedDotProductBenchMapped(benchmark::State& state) {
+    TMappedMatrix matrix(PackedMatrixFile(state.range(0)));
+    size_t taskId = 0;
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.Bytes(),
+            matrix.KernelDim(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            matrix.Header().Bias,
+            matrix.Header().Coeff,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, matrix.KernelDim(), sizeof(uint8_t));
+}
+
+#define DeclareBenchMappedPacked(CL) \
+static void DotPrMappedPacked_##CL(benchmark::State& state) {PackedDotProductBenchMapped<CL>(state);} \
+BENCHMARK(DotPrMappedPacked_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchMappedPacked(TPackedProductAvx512ASM)
+    ->Arg(64)->Arg(128);
+DeclareBenchMappedPacked(TPackedProductDetectPointer)
+    ->Arg(64)->Arg(128);
+
+// the first dim values of the task queries zero padded to kernelDim, as the kernels over a TAlignedMatrix want them
+static std::vector<std::vector<float>> PaddedQueries(size_t dim, size_t kernelDim) {
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    std::vector<std::vector<float>> queries(TasksNum, std::vector<float>(kernelDim, 0.f));
+    for(size_t t = 0; t < TasksNum; t += 1) {
+        std::copy(tasks[t].Query.cbegin(), tasks[t].Query.cbegin() + dim, queries[t].begin());
+    }
+    return queries;
+}
+
+// copy of the range(0) dim rows to a TAlignedMatrix backed by EPageBacking(range(1)), the got backing is
+// in the label as hugetlb falls back to smaller pages when no pages are reserved
+template<class TProductImpl, class T, class... TArgs>
+inline void DotProductBenchPages(benchmark::State& state, const std::vector<T>& source, TArgs... args) {
+    size_t dim = state.range(0);
+    TAlignedMatrix<T> matrix(MaxRowNumber, dim, EPageBacking(state.range(1)));
+    matrix.CopyRows(source.data());
+    state.SetLabel(ToString(matrix.Backing()));
+    size_t taskId = 0;
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    const std::vector<std::vector<float>> queries = PaddedQueries(dim, matrix.KernelDim());
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            queries[taskId].data(),
+            matrix.Data(),
+            matrix.KernelDim(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            args...,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, matrix.KernelDim(), sizeof(T));
+}
+
+// the float copies are kept below 1 GB
+#define B_RANGES_PAGES ArgsProduct({{64, 96, 128}, {0, 1, 2, 3}})
+#define B_RANGES_PAGES_PACKED ArgsProduct({{64, 96, 128, 1024}, {0, 1, 2, 3}})
+
+#define DeclareBenchPages(CL) \
+static void DotPrPages_##CL(benchmark::State& state) {DotProductBenchPages<CL>(state, Base.Matrix());} \
+BENCHMARK(DotPrPages_##CL)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchPagesPacked(CL) \
+static void DotPrPagesPacked_##CL(benchmark::State& state) {DotProductBenchPages<CL>(state, Base.Matrix8(), 0.7f, 0.4f);} \
+BENCHMARK(DotPrPagesPacked_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchPages(TMultiDotV3_ASM_AVX512)
+    ->B_RANGES_PAGES;
+DeclareBenchPages(TMultiDotDetectPointer)
+    ->B_RANGES_PAGES;
+DeclareBenchPagesPacked(TPackedProductAvx512ASM)
+    ->B_RANGES_PAGES_PACKED;
+DeclareBenchPagesPacked(TPackedProductDetectPointer)
+    ->B_RANGES_PAGES_PACKED;
+
+// Matrix converted on first use, 2 bytes a value
+static const std::vector<uint16_t>& HalfMatrix() {
+    static const std::vector<uint16_t> matrix = ConvertMatrix(Base.Matrix().data(), MatrixSize, FloatToHalf);
+    return matrix;
+}
+
+static const std::vector<uint16_t>& Bf16Matrix() {
+    static const std::vector<uint16_t> matrix = ConvertMatrix(Base.Matrix().data(), MatrixSize, FloatToBf16);
+    return matrix;
+}
+
+template<class TProductImpl>
+inline void HalfDotProductBenchMulti(benchmark::State& state, const std::vector<uint16_t>& matrix) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(uint16_t));
+}
+
+#define DeclareBenchHalf(CL) \
+static void DotPrHalf_##CL(benchmark::State& state) {HalfDotProductBenchMulti<CL>(state, HalfMatrix());} \
+BENCHMARK(DotPrHalf_##CL)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchBf16(CL) \
+static void DotPrBf16_##CL(benchmark::State& state) {HalfDotProductBenchMulti<CL>(state, Bf16Matrix());} \
+BENCHMARK(DotPrBf16_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchHalf(THalfProductNaive)
+    ->B_RANGES;
+DeclareBenchHalf(THalfProductAvx2F16C)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchHalf(THalfProductAvx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchHalf(THalfProductDetectPointer)
+    ->B_RANGES;
+
+DeclareBenchBf16(TBf16ProductAvx2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchBf16(TBf16ProductAvx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+static void DotPrBf16_TBf16ProductAvx512Bf16ASM(benchmark::State& state) {
+    if (!TRuntimeCpuInfoDispatch::Features.UsableAvx512Bf16()) {
+        state.SkipWithError("not supported by cpu");
+        return;
+    }
+    HalfDotProductBenchMulti<TBf16ProductAvx512Bf16ASM>(state, Bf16Matrix());
+}
+BENCHMARK(DotPrBf16_TBf16ProductAvx512Bf16ASM)->Unit(benchmark::kMillisecond)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchBf16(TBf16ProductDetectPointer)
+    ->B_RANGES;
+
+// Matrix rows of the benchmarked dim packed to 4 bits on first use, only the last dim is kept
+static const std::vector<uint8_t>& NibbleMatrix(size_t dim) {
+    static size_t packedDim = 0;
+    static std::vector<uint8_t> matrix;
+    if (packedDim != dim) {
+        matrix = PackNibbleMatrix(Base.Matrix().data(), MaxRowNumber, dim);
+        packedDim = dim;
+    }
+    return matrix;
+}
+
+template<class TProductImpl>
+inline void NibbleDotProductBenchMulti(benchmark::State& state) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    const std::vector<uint8_t>& matrix = NibbleMatrix(dim);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            0.7f,
+            0.4f,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, double(TNibbleRows::RowBytes(dim)) / dim);
+}
+
+#define DeclareBenchNibble(CL) \
+static void DotPrNibble_##CL(benchmark::State& state) {NibbleDotProductBenchMulti<CL>(state);} \
+BENCHMARK(DotPrNibble_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchNibble(TNibbleProductNaive)
+    ->B_RANGES;
+DeclareBenchNibble(TNibbleProductAvx2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchNibble(TNibbleProductAvx512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+static void DotPrNibble_TNibbleProductAvx512Vnni(benchmark::State& state) {
+    if (!TRuntimeCpuInfoDispatch::Features.UsableAvx512Vnni()) {
+        state.SkipWithError("not supported by cpu");
+        return;
+    }
+    NibbleDotProductBenchMulti<TNibbleProductAvx512Vnni>(state);
+}
+BENCHMARK(DotPrNibble_TNibbleProductAvx512Vnni)->Unit(benchmark::kMillisecond)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchNibble(TNibbleProductDetectPointer)
+    ->B_RANGES;
+
+// Matrix rows of the benchmarked dim quantized on first use, only the last dim is kept
+static const std::vector<uint8_t>& RowScaledMatrix(size_t dim) {
+    static size_t packedDim = 0;
+    static std::vector<uint8_t> matrix;
+    if (packedDim != dim) {
+        matrix = PackScaledRowsMatrix(Base.Matrix().data(), MaxRowNumber, dim);
+        packedDim = dim;
+    }
+    return matrix;
+}
+
+static const std::pair<TDimScales, std::vector<uint8_t>>& DimScaledMatrix(size_t dim) {
+    static size_t packedDim = 0;
+    static std::pair<TDimScales, std::vector<uint8_t>> matrix;
+    if (packedDim != dim) {
+        matrix.first = TDimScales::Fit(Base.Matrix().data(), MaxRowNumber, dim);
+        matrix.second = matrix.first.Pack(Base.Matrix().data(), MaxRowNumber);
+        packedDim = dim;
+    }
+    return matrix;
+}
+
+template<class TProductImpl>
+inline void RowScaledDotProductBenchMulti(benchmark::State& state) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    const std::vector<uint8_t>& matrix = RowScaledMatrix(dim);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, double(TScaledRows::RowBytes(dim)) / dim);
+}
+
+template<class TProductImpl>
+inline void DimScaledDotProductBenchMulti(benchmark::State& state) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    const auto& [scales, matrix] = DimScaledMatrix(dim);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TDimScaledProduct<TProductImpl>::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            scales,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(uint8_t));
+}
+
+#define DeclareBenchRowScaled(CL) \
+static void DotPrRowScaled_##CL(benchmark::State& state) {RowScaledDotProductBenchMulti<CL>(state);} \
+BENCHMARK(DotPrRowScaled_##CL)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchDimScaled(CL) \
+static void DotPrDimScaled_##CL(benchmark::State& state) {DimScaledDotProductBenchMulti<CL>(state);} \
+BENCHMARK(DotPrDimScaled_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchRowScaled(TRowScaledProductNaive)
+    ->B_RANGES;
+DeclareBenchRowScaled(TRowScaledProductAvx2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchRowScaled(TRowScaledProductAvx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchRowScaled(TRowScaledProductDetectPointer)
+    ->B_RANGES;
+
+DeclareBenchDimScaled(TPackedProductAvx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchDimScaled(TPackedProductDetectPointer)
+    ->B_RANGES;
+DeclareBenchDimScaled(TPackedProductQuantizedDetectPointer)
+    ->B_RANGES;
+
+struct TPqMatrix {
+    size_t Dim = 0;
+    size_t Subspaces = 0;
+    TPqCodebook Codebook;
+    std::vector<uint8_t> Codes;
+    std::vector<uint8_t> Blocks;
+};
+
+// Matrix rows encoded on first use, only the last dim and subspaces are kept
+static const TPqMatrix& PqMatrix(size_t dim, size_t subspaces) {
+    static TPqMatrix matrix;
+    if (matrix.Dim != dim || matrix.Subspaces != subspaces) {
+        matrix.Codebook = TPqCodebook::Train(Base.Matrix().data(), MaxRowNumber, dim, subspaces);
+        matrix.Codes = matrix.Codebook.Encode(Base.Matrix().data(), MaxRowNumber);
+        matrix.Blocks = PqFastScanLayout(matrix.Codes.data(), MaxRowNumber, subspaces);
+        matrix.Dim = dim;
+        matrix.Subspaces = subspaces;
+    }
+    return matrix;
+}
+
+// the lookup table is built per query inside the loop, it is a part of the scoring cost. The roofline counts the code
+// bytes of a row and the flops of the float dot the lookups stand for
+template<class TProductImpl>
+inline void PqDotProductBenchMulti(benchmark::State& state) {
+    size_t taskId = 0;
+    const TPqMatrix& matrix = PqMatrix(state.range(0), state.range(1));
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        const TPqLookup lookup(matrix.Codebook, tasks[taskId].Query.cbegin());
+        TProductImpl::MultiDotProduct(
+            lookup,
+            matrix.Codes.data(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.data()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, matrix.Codebook.Dim(), double(matrix.Codebook.CodeBytes()) / matrix.Codebook.Dim());
+    state.counters["rowBytes"] = matrix.Codebook.CodeBytes();
+}
+
+template<class TProductImpl>
+inline void PqFullScanBench(benchmark::State& state) {
+    size_t taskId = 0;
+    const TPqMatrix& matrix = PqMatrix(state.range(0), state.range(1));
+    std::vector<float> results(MaxRowNumber, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        const TPqLookup lookup(matrix.Codebook, tasks[taskId].Query.cbegin());
+        TProductImpl::FullScan(lookup, matrix.Blocks.data(), MaxRowNumber, results.data());
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, MaxRowNumber, matrix.Codebook.Dim(), double(matrix.Codebook.CodeBytes()) / matrix.Codebook.Dim(), 0);
+    state.counters["rows"] = benchmark::Counter(MaxRowNumber, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+#define B_RANGES_PQ ArgsProduct({{64, 128}, {8, 16, 32}})
+
+#define DeclareBenchPq(CL) \
+static void DotPrPq_##CL(benchmark::State& state) {PqDotProductBenchMulti<CL>(state);} \
+BENCHMARK(DotPrPq_##CL)->Unit(benchmark::kMillisecond)->B_RANGES_PQ; \
+static void DotPrPqFullScan_##CL(benchmark::State& state) {PqFullScanBench<CL>(state);} \
+BENCHMARK(DotPrPqFullScan_##CL)->Unit(benchmark::kMillisecond)->B_RANGES_PQ
+
+DeclareBenchPq(TPqProductNaive);
+DeclareBenchPq(TPqProductAvx2);
+DeclareBenchPq(TPqProductAvx512);
+DeclareBenchPq(TPqProductDetectPointer);
+
+// Matrix rows of the benchmarked dim signed on first use, only the last dim is kept
+static const std::vector<uint64_t>& SignMatrix(size_t dim) {
+    static size_t packedDim = 0;
+    static std::vector<uint64_t> matrix;
+    if (packedDim != dim) {
+        matrix = PackSignMatrix(Base.Matrix().data(), MaxRowNumber, dim);
+        packedDim = dim;
+    }
+    return matrix;
+}
+
+template<class TProductImpl>
+inline void BinaryDotProductBenchMulti(benchmark::State& state) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    const std::vector<uint64_t>& matrix = SignMatrix(dim);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, double(TBinaryRows::RowWords(dim) * sizeof(uint64_t)) / dim);
+}
+
+#define DeclareBenchBinary(CL) \
+static void DotPrBinary_##CL(benchmark::State& state) {BinaryDotProductBenchMulti<CL>(state);} \
+BENCHMARK(DotPrBinary_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchBinary(TBinaryProductNaive)
+    ->B_RANGES;
+DeclareBenchBinary(TBinaryProductAvx2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchBinary(TBinaryProductAvx512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchBinary(TBinaryProductDetectPointer)
+    ->B_RANGES;
+DeclareBenchBinary(THammingProductNaive)
+    ->B_RANGES;
+DeclareBenchBinary(THammingProductPopcnt)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchBinary(THammingProductAvx2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+static void DotPrBinary_THammingProductAvx512Vpopcnt(benchmark::State& state) {
+    if (!TRuntimeCpuInfoDispatch::Features.UsableAvx512Vpopcntdq()) {
+        state.SkipWithError("not supported by cpu");
+        return;
+    }
+    BinaryDotProductBenchMulti<THammingProductAvx512Vpopcnt>(state);
+}
+BENCHMARK(DotPrBinary_THammingProductAvx512Vpopcnt)->Unit(benchmark::kMillisecond)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchBinary(THammingProductDetectPointer)
+    ->B_RANGES;
+
+// range(1) ENumaPlacement, range(2) simulated nodes or 0 for the detected topology. Remote is the share of
+// rows scored by a thread of another node than the one holding them, estimated from the placement when simulated
+static std::unique_ptr<TNumaMatrix<float>> NumaMatrix;
+
+static void DotPrNuma(benchmark::State& state) {
+    const size_t dim = state.range(0);
+    const ENumaPlacement placement = ENumaPlacement(state.range(1));
+    const TNumaTopology topology = state.range(2) ? TNumaTopology::Simulate(state.range(2)) : TNumaTopology::Detect();
+    // pinned before the matrix is built, so the first touch copy lands on the node of worker 0
+    TPinnedScope pinned(topology.Cpus()[0]);
+    // the previous matrix goes first, replicas of the full one do not fit twice
+    NumaMatrix.reset();
+    NumaMatrix.reset(new TNumaMatrix<float>(Base.Matrix().data(), MaxRowNumber, dim, topology, placement));
+    // the pool of numaDot starts under the meter to inherit its counters, untimed
+    TBenchMeter meter(topology.Cpus().size());
+    meter.Pause();
+    TNumaMultiDot<TMultiDotDetectPointer> numaDot(*NumaMatrix, topology);
+    meter.Resume();
+
+    size_t taskId = 0;
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    for (auto _ : state) {
+        numaDot.MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(float));
+    state.counters["rows"] = benchmark::Counter(CasesNumPerTask, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["nodes"] = topology.NodesNum();
+    state.counters["remote"] = numaDot.Stats().RemoteRatio();
+    state.SetLabel(std::string(ToString(placement)) + (topology.Simulated() ? " simulated" : NumaMatrix->Bound() ? " bound" : ""));
+    NumaMatrix.reset();
+}
+
+static void NumaRanges(benchmark::internal::Benchmark* b) {
+    for (int dim : {64, 128}) {
+        for (int placement = 0; placement <= int(ENumaPlacement::Shard); placement += 1) {
+            for (int nodes : {0, 2}) {
+                b->Args({dim, placement, nodes});
+            }
+        }
+    }
+}
+
+BENCHMARK(DotPrNuma)->Unit(benchmark::kMillisecond)->UseRealTime()->Apply(NumaRanges);
+
+template<class TProductImpl>
+inline void PackedDotProductBenchMulti(benchmark::State& state) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    // made before the timed loop on the first run
+    const std::vector<uint8_t>& matrix = Base.Matrix8();
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            0.7,
+            0.4,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(uint8_t));
+}
+
+#define DeclareBenchMultiPackedN(CL, name) \
+static void DotPrMultiPacked_##name(benchmark::State& state) {PackedDotProductBenchMulti<CL>(state);} \
+BENCHMARK(DotPrMultiPacked_##name)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchMultiPacked(CL) DeclareBenchMultiPackedN(CL, CL)
+
+// for kernels built for isa extensions beyond the avx512 baseline of the stand
+#define DeclareBenchMultiPackedRequires(CL, usable) \
+static void DotPrMultiPacked_##CL(benchmark::State& state) {\
+    if (!TRuntimeCpuInfoDispatch::Features.usable()) {\
+        state.SkipWithError("not supported by cpu");\
+        return;\
+    }\
+    PackedDotProductBenchMulti<CL>(state);\
+} \
+BENCHMARK(DotPrMultiPacked_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchMultiPackedN(TPackedProductUnpack<TNaive>, Packed_Naive)
+    ->B_RANGES;
+
+DeclareBenchMultiPackedN(TPackedProductUnpack<TVirtualJump>, Packed_Virtual)
+    ->B_RANGES;
+
+DeclareBenchMultiPacked(TPackedProductInlined)
+    ->B_RANGES;
+DeclareBenchMultiPacked(TPackedProductInlinedAvx512Auto)
+    ->B_RANGES;
+
+DeclareBenchMultiPacked(TPackedProductInlinedWithMath)
+    ->B_RANGES;
+DeclareBenchMultiPacked(TPackedProductInlinedWithMathAvx512Auto)
+    ->B_RANGES;
+DeclareBenchMultiPacked(TPackedProductAvx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMultiPacked(TPackedProductV2Avx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMultiPacked(TPackedProductDeepPrefetchAvx512ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMultiPacked(TPackedProductDetectPointer)
+    ->B_RANGES;
+DeclareBenchMultiPacked(TFixedDimPackedDetectPointer)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMultiPacked(TPackedProductQuantizedDetectPointer)
+    ->B_RANGES;
+DeclareBenchMultiPackedRequires(TPackedProductAvx512VnniASM, UsableAvx512Vnni)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchMultiPacked(TPackedProductAvx2Int8ASM)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+
+// norms of the Matrix and Matrix8 rows of the benchmarked dim, made on first use as the index build would make them
+// with the rows, only the last dim is kept
+static const TRowNorms& MatrixNorms(size_t dim) {
+    static size_t normsDim = 0;
+    static TRowNorms norms;
+    if (normsDim != dim) {
+        norms = TRowNorms::Compute(Base.Matrix().data(), MaxRowNumber, dim);
+        normsDim = dim;
+    }
+    return norms;
+}
+
+static const TRowNorms& Matrix8Norms(size_t dim) {
+    static size_t normsDim = 0;
+    static TRowNorms norms;
+    if (normsDim != dim) {
+        norms = TRowNorms::Compute(Base.Matrix8().data(), MaxRowNumber, dim, 0.7f, 0.4f);
+        normsDim = dim;
+    }
+    return norms;
+}
+
+// norms is the TRowNorms part the family takes: Squared for l2, Inverse for cosine
+template<class TProductImpl>
+inline void DistanceBenchMulti(benchmark::State& state, std::vector<float> TRowNorms::* norms) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    // made before the timed loop on the first run
+    const std::vector<float>& matrix = Base.Matrix();
+    const std::vector<float>& rowNorms = MatrixNorms(dim).*norms;
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            rowNorms.cbegin(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(float));
+}
+
+template<class TProductImpl>
+inline void PackedDistanceBenchMulti(benchmark::State& state, std::vector<float> TRowNorms::* norms) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    std::vector<float> results(CasesNumPerTask, 0.f);
+    // made before the timed loop on the first run
+    const std::vector<uint8_t>& matrix = Base.Matrix8();
+    const std::vector<float>& rowNorms = Matrix8Norms(dim).*norms;
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::MultiDotProduct(
+            tasks[taskId].Query.cbegin(),
+            matrix.cbegin(),
+            dim,
+            rowNorms.cbegin(),
+            tasks[taskId].DocIds.cbegin(),
+            tasks[taskId].DocIds.size(),
+            0.7,
+            0.4,
+            results.begin()
+        );
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, CasesNumPerTask, dim, sizeof(uint8_t));
+}
+
+#define DeclareBenchL2(CL) \
+static void DotPrL2_##CL(benchmark::State& state) {DistanceBenchMulti<CL>(state, &TRowNorms::Squared);} \
+BENCHMARK(DotPrL2_##CL)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchCosine(CL) \
+static void DotPrCosine_##CL(benchmark::State& state) {DistanceBenchMulti<CL>(state, &TRowNorms::Inverse);} \
+BENCHMARK(DotPrCosine_##CL)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchPackedL2(CL) \
+static void DotPrPackedL2_##CL(benchmark::State& state) {PackedDistanceBenchMulti<CL>(state, &TRowNorms::Squared);} \
+BENCHMARK(DotPrPackedL2_##CL)->Unit(benchmark::kMillisecond)
+
+#define DeclareBenchPackedCosine(CL) \
+static void DotPrPackedCosine_##CL(benchmark::State& state) {PackedDistanceBenchMulti<CL>(state, &TRowNorms::Inverse);} \
+BENCHMARK(DotPrPackedCosine_##CL)->Unit(benchmark::kMillisecond)
+
+DeclareBenchL2(TL2MultiDotNaive)
+    ->B_RANGES;
+DeclareBenchL2(TL2MultiDot_AVX2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchL2(TL2MultiDot_AVX512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchL2(TL2MultiDotDetectPointer)
+    ->B_RANGES;
+
+DeclareBenchCosine(TCosineMultiDotNaive)
+    ->B_RANGES;
+DeclareBenchCosine(TCosineMultiDot_AVX2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchCosine(TCosineMultiDot_AVX512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchCosine(TCosineMultiDotDetectPointer)
+    ->B_RANGES;
+
+DeclareBenchPackedL2(TL2PackedNaive)
+    ->B_RANGES;
+DeclareBenchPackedL2(TL2Packed_AVX2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchPackedL2(TL2Packed_AVX512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchPackedL2(TL2PackedDetectPointer)
+    ->B_RANGES;
+
+DeclareBenchPackedCosine(TCosinePackedNaive)
+    ->B_RANGES;
+DeclareBenchPackedCosine(TCosinePacked_AVX2)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchPackedCosine(TCosinePacked_AVX512)
+    ->B_RANGES
+    ->B_RANGES_TAIL;
+DeclareBenchPackedCosine(TCosinePackedDetectPointer)
+    ->B_RANGES;
+
+// the first rows of Matrix at the benchmarked dim regrouped on first use, only the last dim and rows are kept
+static const TInterleavedMatrix& InterleavedMatrix(size_t dim, size_t rows) {
+    static size_t interleavedDim = 0;
+    static size_t interleavedRows = 0;
+    static std::unique_ptr<TInterleavedMatrix> matrix;
+    if (interleavedDim != dim || interleavedRows != rows) {
+        // the previous one goes first, two of the full size may not fit
+        matrix.reset();
+        matrix.reset(new TInterleavedMatrix(Base.Matrix().data(), rows, dim));
+        interleavedDim = dim;
+        interleavedRows = rows;
+    }
+    return *matrix;
+}
+
+// range(0) dim, range(1) rows scanned: the first rows of Matrix as they are or regrouped to a TInterleavedMatrix
+// before the timed loop. No ids are read, so bytesPerSec is the scan bandwidth; a scan is far below the ridge,
+// roof is its share of the measured read peak once the rows do not fit the llc
+template<class TProductImpl, bool Interleaved>
+inline void FullScanBench(benchmark::State& state) {
+    size_t taskId = 0;
+    size_t dim = state.range(0);
+    size_t rows = std::min<size_t>(state.range(1), MaxRowNumber);
+    const std::vector<float>& matrix = Base.Matrix();
+    const float* data = Interleaved ? InterleavedMatrix(dim, rows).Data() : matrix.data();
+    std::vector<float> results(rows, 0.f);
+    const std::vector<TCalcTask>& tasks = Base.Tasks();
+    TBenchMeter meter;
+    for (auto _ : state) {
+        TProductImpl::FullScan(tasks[taskId].Query.cbegin(), data, dim, rows, results.data());
+        benchmark::DoNotOptimize(results);
+        taskId += 1;
+        taskId = taskId % TasksNum;
+    }
+    meter.Report(state, rows, dim, sizeof(float), 0);
+}
+
+// 64K rows stay in the llc of the bigger hosts up to dim 128, all of them go to memory
+#define B_RANGES_SCAN ArgsProduct({{64, 128, 200}, {64 * 1024, MaxRowNumber}})
+
+#define DeclareBenchScanRowsN(CL, name) \
+static void DotPrScan_##name(benchmark::State& state) {FullScanBench<CL, false>(state);} \
+BENCHMARK(DotPrScan_##name)->Unit(benchmark::kMillisecond)->B_RANGES_SCAN
+
+#define DeclareBenchScanInterleaved(CL) \
+static void DotPrScan_##CL(benchmark::State& state) {FullScanBench<CL, true>(state);} \
+BENCHMARK(DotPrScan_##CL)->Unit(benchmark::kMillisecond)->B_RANGES_SCAN
+
+DeclareBenchScanRowsN(TFullScanFromMulti<TMultiDotV3_ASM_AVX512>, Rows_V3_ASM_AVX512);
+DeclareBenchScanRowsN(TFullScanFromMulti<TMultiDotDetectPointer>, Rows_DetectPointer);
+DeclareBenchScanInterleaved(TInterleavedScanNaive);
+DeclareBenchScanInterleaved(TInterleavedScanAvx2);
+DeclareBenchScanInterleaved(TInterleavedScanAvx512);
+DeclareBenchScanInterleaved(TInterleavedScanStreamAvx512);
+DeclareBenchScanInterleaved(TInterleavedScanDetectPointer);
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "dot_product.h"
+#include "multidot.h"
+#include "dotpacked.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// keeps the K best (score, id) pairs, the worst of them is on top of a min-heap and is the threshold for new ones
+class TTopKCollector {
+public:
+    explicit TTopKCollector(size_t topK)
+        : TopK_(topK)
+    {
+        Heap_.reserve(topK);
+    }
+
+    float Threshold() const {
+        return Threshold_;
+    }
+
+    void Push(float score, uint32_t id) {
+        // with K = 0 the heap stays empty and there is no worst to replace
+        if (TopK_ == 0 || !(score > Threshold_)) {
+            return;
+        }
+        if (Heap_.size() < TopK_) {
+            Heap_.push_back({score, id});
+            std::push_heap(Heap_.begin(), Heap_.end(), Greater);
+            if (Heap_.size() == TopK_) {
+                Threshold_ = Heap_.front().first;
+            }
+            return;
+        }
+        std::pop_heap(Heap_.begin(), Heap_.end(), Greater);
+        Heap_.back() = {score, id};
+        std::push_heap(Heap_.begin(), Heap_.end(), Greater);
+        Threshold_ = Heap_.front().first;
+    }
+
+    // best first, returns the number of written pairs - min(K, pushed)
+    size_t Finish(uint32_t* ids, float* scores) {
+        std::sort_heap(Heap_.begin(), Heap_.end(), Greater);
+        for(size_t i = 0; i < Heap_.size(); i += 1) {
+            scores[i] = Heap_[i].first;
+            ids[i] = Heap_[i].second;
+        }
+        return Heap_.size();
+    }
+
+private:
+    static bool Greater(const std::pair<float, uint32_t>& l, const std::pair<float, uint32_t>& r) {
+        return l.first > r.first;
+    }
+
+    size_t TopK_;
+    float Threshold_ = -std::numeric_limits<float>::infinity();
+    std::vector<std::pair<float, uint32_t>> Heap_;
+};
+
+// filters answer with a bit mask of scores[0..16) that are greater than the threshold, scores are 64 bytes aligned
+struct TTopKFilterScalar {
+    static constexpr size_t Block = 16;
+
+    inline static uint32_t Above(const float* scores, float threshold) {
+        uint32_t mask = 0;
+        for(size_t i = 0; i < Block; i += 1) {
+            mask |= uint32_t(scores[i] > threshold) << i;
+        }
+        return mask;
+    }
+};
+
+struct TTopKFilterAvx2 {
+    static constexpr size_t Block = 16;
+
+    static uint32_t Above(const float* scores, float threshold);
+};
+
+struct TTopKFilterAvx512 {
+    static constexpr size_t Block = 16;
+
+    static uint32_t Above(const float* scores, float threshold);
+};
+
+// rows scored by one kernel call: the kernels pay their query setup (sum of the query, its quantization) per call,
+// so a few hundred rows spread it, and 4 KB of scores stay in l1
+constexpr size_t TopKScoreRows = 1024;
+
+// scores TopKScoreRows rows into a buffer on the stack, then one vector compare of Block of them against the current
+// threshold drops the whole group in the common case, so only the candidates go to the heap
+template<class TFilter, class TBlockCollector>
+inline size_t CollectTopK(
+    TBlockCollector&& scoreBlock,
+    const uint32_t* elemsIds,
+    size_t elemsNum,
+    size_t topK,
+    uint32_t* topIds,
+    float* topScores
+) {
+    constexpr size_t Block = TFilter::Block;
+    static_assert(TopKScoreRows % Block == 0, "the filter groups tile the scored rows");
+    TTopKCollector top(topK);
+    alignas(64) float scores[TopKScoreRows];
+    for(size_t e = 0; e < elemsNum; e += TopKScoreRows) {
+        const size_t n = std::min(TopKScoreRows, elemsNum - e);
+        scoreBlock(elemsIds + e, n, scores);
+        const size_t padded = (n + Block - 1) / Block * Block;
+        for(size_t i = n; i < padded; i += 1) {
+            scores[i] = -std::numeric_limits<float>::infinity();
+        }
+        for(size_t b = 0; b < padded; b += Block) {
+            uint32_t mask = TFilter::Above(scores + b, top.Threshold());
+            while (mask) {
+                const size_t i = b + __builtin_ctz(mask);
+                mask &= mask - 1;
+                top.Push(scores[i], elemsIds[e + i]);
+            }
+        }
+    }
+    return top.Finish(topIds, topScores);
+}
+
+// the topK best of the full results by nth_element, best first; returns min(topK, results.size())
+inline size_t SelectTopK(
+    const std::vector<float>& results,
+    const uint32_t* elemsIds,
+    size_t topK,
+    uint32_t* topIds,
+    float* topScores
+) {
+    std::vector<uint32_t> order(results.size());
+    for(size_t e = 0; e < order.size(); e += 1) {
+        order[e] = e;
+    }
+    const size_t found = std::min(topK, order.size());
+    auto better = [&](uint32_t l, uint32_t r) {
+        return results[l] > results[r];
+    };
+    std::nth_element(order.begin(), order.begin() + found, order.end(), better);
+    std::sort(order.begin(), order.begin() + found, better);
+    for(size_t i = 0; i < found; i += 1) {
+        topIds[i] = elemsIds[order[i]];
+        topScores[i] = results[order[i]];
+    }
+    return found;
+}
+
+template<class TMultiDotImpl, class TFilter = TTopKFilterScalar>
+struct TMultiDotTopK {
+    inline static size_t MultiDotProductTopK(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        size_t topK,
+        uint32_t* topIds,
+        float* topScores
+    ) {
+        return CollectTopK<TFilter>(
+            ScoreBlock(a, allB, dim), elemsIds, elemsNum, topK, topIds, topScores
+        );
+    }
+
+private:
+    inline static auto ScoreBlock(const float* a, const float* allB, size_t dim) {
+        return [=](const uint32_t* ids, size_t n, float* scores) {
+            TMultiDotImpl::MultiDotProduct(a, allB, dim, ids, n, scores);
+        };
+    }
+};
+
+template<class TPackedImpl, class TFilter = TTopKFilterScalar>
+struct TPackedProductTopK {
+    inline static size_t MultiDotProductTopK(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        size_t topK,
+        uint32_t* topIds,
+        float* topScores
+    ) {
+        return CollectTopK<TFilter>(
+            ScoreBlock(a, allB, dim, bias, coeff), elemsIds, elemsNum, topK, topIds, topScores
+        );
+    }
+
+private:
+    inline static auto ScoreBlock(const float* a, const uint8_t* allB, size_t dim, float bias, float coeff) {
+        return [=](const uint32_t* ids, size_t n, float* scores) {
+            TPackedImpl::MultiDotProduct(a, allB, dim, ids, n, bias, coeff, scores);
+        };
+    }
+};
+
+// what the callers do without fusing: all scores to a buffer, then nth_element over it
+template<class TMultiDotImpl>
+struct TMultiDotThenSelect {
+    inline static size_t MultiDotProductTopK(
+        const float* a,
+        const float* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        size_t topK,
+        uint32_t* topIds,
+        float* topScores
+    ) {
+        std::vector<float> results(elemsNum);
+        TMultiDotImpl::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, results.data());
+        return SelectTopK(results, elemsIds, topK, topIds, topScores);
+    }
+};
+
+template<class TPackedImpl>
+struct TPackedProductThenSelect {
+    inline static size_t MultiDotProductTopK(
+        const float* a,
+        const uint8_t* allB,
+        size_t dim,
+        const uint32_t* elemsIds,
+        size_t elemsNum,
+        float bias,
+        float coeff,
+        size_t topK,
+        uint32_t* topIds,
+        float* topScores
+    ) {
+        std::vector<float> results(elemsNum);
+        TPackedImpl::MultiDotProduct(a, allB, dim, elemsIds, elemsNum, bias, coeff, results.data());
+        return SelectTopK(results, elemsIds, topK, topIds, topScores);
+    }
+};